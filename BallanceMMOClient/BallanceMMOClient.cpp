@@ -62,7 +62,7 @@ inline void BallanceMMOClient::update_player_list(int& last_player_count, int& l
     player_status_list_.reserve(db_.player_count() + !spectator_mode_);
     auto push_entry = [&, this](const bmmo::map& map, const std::string& name, int sector, int64_t timestamp, bool cheated) {
         std::lock_guard lk(client_mtx_);
-        const auto& times = maps_[map.get_hash_bytes_string()].sector_timestamps;
+        const auto& times = maps_[map.key()].sector_timestamps;
         auto time_it = times.find(sector);
         auto map_name = map.get_display_name(map_names_);
         if (time_it != times.end()) {
@@ -217,9 +217,9 @@ void BallanceMMOClient::OnLoadObject(BMMO_CKSTRING filename, BOOL isMap, BMMO_CK
         did_not_finish_ = false;
         max_sector_ = 0;
         if (connected()) {
-            const auto name_it = map_names_.find(current_map_.get_hash_bytes_string());
+            const auto name_it = map_names_.find(current_map_.key());
             if (name_it == map_names_.end()) {
-                map_names_.try_emplace(current_map_.get_hash_bytes_string(), current_map_.name);
+                map_names_.try_emplace(current_map_.key(), current_map_.name);
                 send_current_map_name();
             } else
                 current_map_.name = name_it->second;
@@ -430,7 +430,7 @@ void BallanceMMOClient::OnStartLevel()
         local_state_handler_->set_ball_type(db_.get_ball_id(player_ball_->GetName()));
 
     if (reset_timer_) {
-        maps_[current_map_.get_hash_bytes_string()].level_start_timestamp = m_bml->GetTimeManager()->GetTime();
+        maps_[current_map_.key()].level_start_timestamp = m_bml->GetTimeManager()->GetTime();
         reset_timer_ = false;
     }
 
@@ -445,7 +445,7 @@ void BallanceMMOClient::OnStartLevel()
     hs_calibrated_ = false;
 
     m_bml->AddTimer(CKDWORD(10), [this]() {
-        if (auto maps_it = maps_.find(current_map_.get_hash_bytes_string()); maps_it != maps_.end()) {
+        if (auto maps_it = maps_.find(current_map_.key()); maps_it != maps_.end()) {
             add_lives(maps_it->second.initial_life_count);
         }
 
@@ -538,7 +538,7 @@ void BallanceMMOClient::OnLevelFinish() {
         array_energy->GetElementValue(0, 5, &msg.content.lifeBonus);
         static_cast<CKDataArray*>(m_bml->GetCKContext()->GetObject(current_level_array_))->GetElementValue(0, 0, &current_map_.level);
         m_bml->GetArrayByName("AllLevel")->GetElementValue(current_map_.level - 1, 6, &msg.content.levelBonus);
-        msg.content.timeElapsed = (m_bml->GetTimeManager()->GetTime() - maps_[current_map_.get_hash_bytes_string()].level_start_timestamp) / 1e3f;
+        msg.content.timeElapsed = (m_bml->GetTimeManager()->GetTime() - maps_[current_map_.key()].level_start_timestamp) / 1e3f;
         reset_timer_ = true;
         msg.content.cheated = m_bml->IsCheatEnabled();
         msg.content.mode = current_level_mode_;
@@ -714,7 +714,7 @@ void BallanceMMOClient::init_commands() {
             msg.chat_content.assign(new_text);
 
         msg.serialize();
-        send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         return;
     });
     console_.register_aliases("say", {"s"});
@@ -725,7 +725,7 @@ void BallanceMMOClient::init_commands() {
         msg.type = (console_.get_command_name() == "notice") ? in_msg::Notice : in_msg::Announcement;
         msg.serialize();
 
-        send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         return;
     });
     console_.register_aliases("announce", {"a", "notice"});
@@ -733,7 +733,7 @@ void BallanceMMOClient::init_commands() {
         bmmo::permanent_notification_msg msg{};
         msg.text_content = console_.get_rest_of_line();
         msg.serialize();
-        send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
     });
     console_.register_aliases("bulletin", {"b"});
     console_.register_command("kick", [&] {
@@ -749,7 +749,7 @@ void BallanceMMOClient::init_commands() {
         msg.reason = console_.get_rest_of_line();
 
         msg.serialize();
-        send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
     });
     console_.register_aliases("kick", {"crash"});
     console_.register_command("restartlevel", [&] {
@@ -766,10 +766,7 @@ void BallanceMMOClient::init_commands() {
             mode = console_.get_next_word(true);
         }
         if (!console_.empty()) {
-            int level = std::clamp(atoi(console_.get_next_word().c_str()), 1, 13);
-            bmmo::hex_chars_from_string(rank_map.md5, bmmo::map::original_map_hashes[level]);
-            rank_map.level = level;
-            rank_map.type = bmmo::map_type::OriginalLevel;
+            rank_map.set_original_level(std::clamp(atoi(console_.get_next_word().c_str()), 1, 13));
         } else
             rank_map = last_countdown_map_;
 
@@ -779,11 +776,11 @@ void BallanceMMOClient::init_commands() {
             msg.mode = (mode == "hs") ? bmmo::level_mode::Highscore : bmmo::level_mode::Speedrun;
             if (!use_local_data) {
                 msg.serialize();
-                send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+                send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
                 return;
             }
             std::unique_lock lk(client_mtx_);
-            auto map_it = maps_.find(rank_map.get_hash_bytes_string());
+            auto map_it = maps_.find(rank_map.key());
             if (map_it == maps_.end() ||
                     (map_it->second.rankings.first.empty() && map_it->second.rankings.second.empty())) {
                 SendIngameMessage("Error: ranking info not found for the specified map.",
@@ -791,7 +788,7 @@ void BallanceMMOClient::init_commands() {
                 return;
             }
             msg.serialize(map_it->second.rankings);
-            receive(msg.raw.str().data(), msg.size());
+            receive(msg.raw.data(), msg.size());
         });
     });
     console_.register_command("whisper", [&] {
@@ -799,7 +796,7 @@ void BallanceMMOClient::init_commands() {
         msg.player_id = get_client_id_from_console();
         msg.chat_content = console_.get_rest_of_line();
         msg.serialize();
-        send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         SendIngameMessage(std::format("Whispered to {}: {}",
             get_username(msg.player_id), msg.chat_content), bmmo::color_code(msg.code));
     });
@@ -1015,9 +1012,9 @@ void BallanceMMOClient::init_commands() {
         bmmo::map map; srand((uint32_t)time(nullptr));
         for (auto& i : map.md5) i = rand() % std::numeric_limits<uint8_t>::max();
         bmmo::map_names_msg name_msg{};
-        name_msg.maps.emplace(map.get_hash_bytes_string(), next_word);
+        name_msg.maps.emplace(map.key(), next_word);
         name_msg.serialize();
-        send(name_msg.raw.str().data(), name_msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(name_msg.data(), name_msg.size(), k_nSteamNetworkingSend_Reliable);
         send(bmmo::current_map_msg{ .content = {.map = map, .type = bmmo::current_map_state::NameChange} }, k_nSteamNetworkingSend_Reliable);
         SendIngameMessage(std::format("Current map name set to \"{}\".", next_word), bmmo::ansi::WhiteInverse);
     });
@@ -1481,13 +1478,16 @@ void BallanceMMOClient::on_connection_status_changed(SteamNetConnectionStatusCha
             local_state_handler_->set_ball_type(db_.get_ball_id(player_ball_->GetName()));
 
         SendIngameMessage(("Logging in as \"" + nickname + "\"...").c_str());
+        // V3 with capability groups, so that servers which predate them still let us in
         bmmo::login_request_v3_msg msg{};
         msg.nickname = nickname;
         msg.version = bmmo::current_version;
         msg.cheated = m_bml->IsCheatEnabled() && !spectator_mode_; // always false in spectator mode
         memcpy(msg.uuid, &(config_manager_.get_uuid()), sizeof(config_manager_.get_uuid()));
+        msg.capability_groups.encodings = bmmo::capability::DeltaBallState | bmmo::capability::QuantizedBallState;
+        msg.capabilities = msg.capability_groups.encodings;
         msg.serialize();
-        send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         if (ping_thread_.joinable())
             ping_thread_.join();
         ping_thread_ = std::thread([this]() {
@@ -1556,6 +1556,25 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
     }
     case bmmo::OwnedTimedBallState:
         break;
+    case bmmo::OwnedQuantizedBallState: {
+        bmmo::owned_quantized_ball_state_msg msg;
+        msg.raw.write(reinterpret_cast<char*>(network_msg->m_pData), network_msg->m_cbSize);
+        if (!msg.deserialize())
+            break;
+
+        std::lock_guard<std::mutex> lk(bml_mtx_);
+        for (const auto& i : msg.balls) {
+            if (!db_.update(i.player_id, TimedBallState(i.state)) && i.player_id != db_.get_client_id()) {
+                logger_->Warn("Update db failed: Cannot find such ConnectionID %u. (on_message - OwnedQuantizedBallState)", i.player_id);
+            }
+        }
+        for (const auto& i : msg.unchanged_balls) {
+            if (!db_.update(i.player_id, i.timestamp) && i.player_id != db_.get_client_id()) {
+                logger_->Warn("Update db failed: Cannot find such ConnectionID %u. (on_message - OwnedQuantizedBallState)", i.player_id);
+            }
+        }
+        break;
+    }
     case bmmo::OwnedCompressedBallState: {
         bmmo::owned_compressed_ball_state_msg msg;
         msg.raw.write(reinterpret_cast<char*>(network_msg->m_pData), network_msg->m_cbSize);
@@ -1581,6 +1600,22 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
         }
         break;
     }
+    case bmmo::OwnedDeltaBallState: {
+        bmmo::owned_delta_ball_state_msg msg;
+        msg.raw.write(reinterpret_cast<char*>(network_msg->m_pData), network_msg->m_cbSize);
+        std::vector<bmmo::owned_timed_ball_state> balls;
+        if (!msg.deserialize() || !delta_decoder_.decode(msg, balls))
+            break; // the server falls back to a keyframe if we don't acknowledge anything
+        send(bmmo::ball_state_ack_msg{.content = msg.sequence}, k_nSteamNetworkingSend_UnreliableNoDelay);
+
+        std::lock_guard<std::mutex> lk(bml_mtx_);
+        for (const auto& i : balls) {
+            if (!db_.update(i.player_id, TimedBallState(i.state)) && i.player_id != db_.get_client_id()) {
+                logger_->Warn("Update db failed: Cannot find such ConnectionID %u. (on_message - OwnedDeltaBallState)", i.player_id);
+            }
+        }
+        break;
+    }
     case bmmo::LoginAcceptedV2:
     case bmmo::LoginAccepted: {
         /*status_->update("Connected");
@@ -1604,9 +1639,13 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
         logger_->Warn("Outdated LoginAccepted%s msg received!", (raw_msg->code == bmmo::LoginAcceptedV2) ? "V2" : "");
         break;
     }
-    case bmmo::LoginAcceptedV3: {
-        auto msg = bmmo::message_utils::deserialize<bmmo::login_accepted_v3_msg>(network_msg);
+    case bmmo::LoginAcceptedV3:
+    case bmmo::LoginAcceptedV4: {
+        auto msg = (raw_msg->code == bmmo::LoginAcceptedV3)
+            ? bmmo::login_accepted_v4_msg::from(bmmo::message_utils::deserialize<bmmo::login_accepted_v3_msg>(network_msg))
+            : bmmo::message_utils::deserialize<bmmo::login_accepted_v4_msg>(network_msg);
         std::lock_guard<std::mutex> lk(bml_mtx_);
+        delta_decoder_.reset();
 
         if (logged_in_) {
             logger_->Info("New LoginAccepted message received. Resetting current data.");
@@ -1626,7 +1665,7 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
                 db_.create(id, data.name, data.cheated);
                 int64_t timestamp = db_.get_timestamp_ms();
                 db_.update_map(id, data.map, data.sector, timestamp);
-                maps_.try_emplace(data.map.get_hash_bytes_string());
+                maps_.try_emplace(data.map.key());
                 if (!bmmo::name_validator::is_spectator(data.name))
                     update_sector_timestamp(data.map, data.sector, timestamp);
             }
@@ -1659,9 +1698,9 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
         if (m_bml->IsIngame() && player_ball_ != nullptr)
             local_state_handler_->poll_and_send_state_forced(player_ball_);
         if (!current_map_.name.empty()) {
-            if (const auto name_it = map_names_.find(current_map_.get_hash_bytes_string()); name_it == map_names_.end()) {
+            if (const auto name_it = map_names_.find(current_map_.key()); name_it == map_names_.end()) {
                 send_current_map_name();
-                map_names_.try_emplace(current_map_.get_hash_bytes_string(), current_map_.name);
+                map_names_.try_emplace(current_map_.key(), current_map_.name);
             } else
                 current_map_.name = name_it->second;
         }
@@ -1685,12 +1724,12 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
             mod_msg.mods.try_emplace(bmmo::string_utils::ansi_to_utf8(mod->GetID()), bmmo::string_utils::ansi_to_utf8(mod->GetVersion()));
         }
         mod_msg.serialize();
-        send(mod_msg.raw.str().data(), mod_msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(mod_msg.data(), mod_msg.size(), k_nSteamNetworkingSend_Reliable);
 
         bmmo::hash_data_msg hash_msg{};
         hash_msg.data = md5_data_;
         hash_msg.serialize();
-        send(hash_msg.raw.str().data(), hash_msg.size(), k_nSteamNetworkingSend_Reliable);
+        send(hash_msg.raw.data(), hash_msg.size(), k_nSteamNetworkingSend_Reliable);
         break;
     }
     case bmmo::PlayerConnected: {
@@ -1824,7 +1863,7 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
                                   bmmo::color_code(msg->code));
                 // asio::post(thread_pool_, [this] { play_beep(int(440 * std::powf(2.0f, 5.0f / 12)), 1000); });
                 play_wave_sound(sound_go_, true);
-                auto& last_map_data = maps_[last_countdown_map_.get_hash_bytes_string()];
+                auto& last_map_data = maps_[last_countdown_map_.key()];
                 last_map_data.rankings = {};
                 last_map_data.sector_timestamps = {};
                 if ((!msg->content.force_restart && msg->content.map != current_map_) || !m_bml->IsIngame() || spectator_mode_)
@@ -1896,7 +1935,7 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
             did_not_finish_ = true;
 
         std::lock_guard lk(client_mtx_);
-        maps_[msg->content.map.get_hash_bytes_string()].rankings.second.push_back({
+        maps_[msg->content.map.key()].rankings.second.push_back({
             (bool)msg->content.cheated, player_name, msg->content.sector});
         play_wave_sound(sound_dnf_);
         utils_.flash_window();
@@ -1954,7 +1993,7 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
             bmmo::color_code(msg->code));
 
         std::lock_guard lk(client_mtx_);
-        maps_[msg->content.map.get_hash_bytes_string()].rankings.first.push_back({
+        maps_[msg->content.map.key()].rankings.first.push_back({
             (bool)msg->content.cheated, player_name, msg->content.mode,
             msg->content.rank, msg->content.timeElapsed, formatted_score});
         // TODO: Stop displaying objects on finish
@@ -2092,7 +2131,7 @@ void BallanceMMOClient::on_message(ISteamNetworkingMessage* network_msg) {
             int64_t timestamp = db_.get_timestamp_ms();
             std::lock_guard<std::mutex> lk(client_mtx_);
             db_.update_map(msg->content.player_id, msg->content.map, msg->content.sector, timestamp);
-            maps_.try_emplace(msg->content.map.get_hash_bytes_string());
+            maps_.try_emplace(msg->content.map.key());
             if (!bmmo::name_validator::is_spectator(get_username(msg->content.player_id)))
                 update_sector_timestamp(msg->content.map, msg->content.sector, timestamp);
         }
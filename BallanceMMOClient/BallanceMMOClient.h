@@ -269,7 +269,7 @@ private:
 	float counter_start_timestamp_ = 0;
 	int32_t current_sector_ = 0, max_sector_ = 0;
 	int64_t current_sector_timestamp_ = 0;
-	std::unordered_map<std::string, std::string> map_names_;
+	bmmo::map_name_table map_names_;
 	std::unordered_map<std::string, std::array<uint8_t, 16>> md5_data_;
 	SteamNetworkingMicroseconds map_enter_timestamp_ = 0, hs_begin_delay_ = 0;
 	bool force_hs_calibration_ = false, hs_calibrated_ = false;
@@ -281,7 +281,7 @@ private:
 		std::map<int, int64_t> sector_timestamps{};
 		bmmo::ranking_entry::player_rankings rankings{};
 	};
-	std::unordered_map<std::string, map_data> maps_;
+	bmmo::map_key_table<map_data> maps_;
 
 	int32_t initial_points_{}, initial_lives_{};
 	float point_decrease_interval_{};
@@ -298,6 +298,7 @@ private:
 	std::string server_addr_, server_name_;
 	std::atomic_bool resolving_endpoint_ = false;
 	bool logged_in_ = false;
+	bmmo::ball_delta_decoder delta_decoder_; // network thread only
 	SteamNetworkingMicroseconds next_update_timestamp_ = 0,
 		last_dnf_hotkey_timestamp_ = 0, dnf_cooldown_end_timestamp_ = 0;
 
@@ -407,7 +408,7 @@ private:
 
 	void update_sector_timestamp(const bmmo::map& map, int sector, int64_t timestamp) {
 		if (sector == 0) return;
-		auto map_it = maps_.find(map.get_hash_bytes_string());
+		auto map_it = maps_.find(map.key());
 		if (map_it == maps_.end()) return;
 		map_it->second.sector_timestamps.try_emplace(sector, timestamp);
 	}
@@ -932,9 +933,9 @@ private:
 
 	void send_current_map_name() {
 		bmmo::map_names_msg msg{};
-		msg.maps[current_map_.get_hash_bytes_string()] = current_map_.name;
+		msg.maps[current_map_.key()] = current_map_.name;
 		msg.serialize();
-		send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+		send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
 	}
 
 	void send_current_map(bmmo::current_map_state::state_type type = bmmo::current_map_state::EnteringMap) {
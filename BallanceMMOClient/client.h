@@ -49,7 +49,7 @@ public:
             get_connection_state() == k_ESteamNetworkingConnectionState_FindingRoute;
     }
 
-    EResult send(void* buffer, size_t size, int send_flags = k_nSteamNetworkingSend_Reliable, int64* out_message_number = nullptr) {
+    EResult send(const void* buffer, size_t size, int send_flags = k_nSteamNetworkingSend_Reliable, int64* out_message_number = nullptr) {
         return interface_->SendMessageToConnection(connection_,
             buffer,
             size,
@@ -6,6 +6,7 @@
 #endif
 #include "bml_includes.h"
 #include "entity/map.hpp"
+#include "utility/name_index.hpp"
 
 #include <unordered_map>
 #include <shared_mutex>
@@ -91,6 +92,7 @@ public:
 
 		std::unique_lock lk(mutex_);
 		states_.insert({id, {.name = name, .cheated = cheated}});
+		names_.insert_or_assign(name, id);
 		return true;
 	}
 
@@ -154,6 +156,7 @@ public:
 			return false;
 
 		std::unique_lock lk(mutex_);
+		names_.rename(states_[id].name, name);
 		states_[id].name = name;
 		set_pending_flush(true);
 		return true;
@@ -164,6 +167,8 @@ public:
 			return false;
 
 		std::unique_lock lk(mutex_);
+		if (state.name != states_[id].name)
+			names_.rename(states_[id].name, state.name);
 		states_[id] = state;
 		return true;
 	}
@@ -254,7 +259,12 @@ public:
 
 	bool remove(HSteamNetConnection id) {
 		std::unique_lock lk(mutex_);
-		return bool(states_.erase(id));
+		auto it = states_.find(id);
+		if (it == states_.end())
+			return false;
+		names_.erase(it->second.name);
+		states_.erase(it);
+		return true;
 	}
 
 	size_t player_count() {
@@ -293,6 +303,7 @@ public:
 	void clear() {
 		std::unique_lock lk(mutex_);
 		states_.clear();
+		names_.clear();
 	}
 
 	void set_nickname(const std::string& name) {
@@ -314,12 +325,12 @@ public:
 		return assigned_id_;
 	}
 
-	HSteamNetConnection get_client_id(std::string name) {
-		auto it = std::find_if(states_.begin(), states_.end(),
-								[&name](const auto& s) { return boost::iequals(s.second.name, name); });
-		if (it == states_.end())
-			return k_HSteamNetConnection_Invalid;
-		return it->first;
+	// Case-insensitive; `name` may also be shortened as long as it's unambiguous.
+	HSteamNetConnection get_client_id(const std::string& name) {
+		std::shared_lock lk(mutex_);
+		if (const auto* entry = names_.find_unique(name))
+			return entry->value;
+		return k_HSteamNetConnection_Invalid;
 	}
 
 	void set_ball_id(const std::string& name, const uint32_t id) {
@@ -372,6 +383,7 @@ public:
 private:
 	std::shared_mutex mutex_;
 	std::unordered_map<HSteamNetConnection, PlayerState> states_;
+	bmmo::name_index<HSteamNetConnection> names_; // of `states_`
 	std::unordered_map<std::string, uint32_t> ball_name_to_id_; 
 	std::string nickname_;
 	HSteamNetConnection assigned_id_ = k_HSteamNetConnection_Invalid;
@@ -23,6 +23,9 @@
 #include "utility/console.hpp"
 #include "utility/hostname_parser.hpp"
 #include "utility/misc.hpp"
+#include "utility/mpsc_queue.hpp"
+#include "utility/name_index.hpp"
+#include "utility/ball_delta_codec.hpp"
 #include "utility/string_utils.hpp"
 #include "message/message_all.hpp"
 
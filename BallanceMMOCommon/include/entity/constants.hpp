@@ -6,8 +6,13 @@
 namespace bmmo {
     constexpr std::chrono::nanoseconds SERVER_TICK_DELAY{(int)1e9 / 198},
                                        SERVER_RECEIVE_INTERVAL{(int)1e9 / 66},
+                                       SERVER_TICK_INTERVAL{(int)1e9 / 66},
                                        CLIENT_RECEIVE_INTERVAL{(int)1e9 / 66};
 
+    // upper bound of a single wait in the server loop when there's nothing to tick;
+    // network activity wakes the loop up before that anyway
+    constexpr std::chrono::milliseconds SERVER_IDLE_WAIT_INTERVAL{100};
+
 	constexpr SteamNetworkingMicroseconds CLIENT_MINIMUM_UPDATE_INTERVAL_MS = (int64_t)1e6 / 66;
 
     constexpr const char* RECORD_HEADER = "BallanceMMO FlightRecorder";
@@ -43,6 +48,44 @@ namespace bmmo {
             AutoReconnection_Max = AutoReconnection_Min + 50,
         };
     };
+
+    // Optional protocol features, negotiated at login; the server only
+    // uses those which both sides have listed. Each group has bits of its own.
+    struct capability {
+        enum : uint32_t { None = 0 };
+
+        // ways to send ball states other than OwnedCompressedBallState
+        enum encoding : uint32_t {
+            DeltaBallState = 1 << 0, // OwnedDeltaBallState + BallStateAck
+            QuantizedBallState = 1 << 1, // OwnedQuantizedBallState
+        };
+
+        // compressed message bodies; none defined yet
+        enum compression : uint32_t {};
+
+        // several messages sent as one; none defined yet
+        enum bundling : uint32_t {};
+    };
+
+    // What a client supports (LoginRequestV4) or what the server enabled for
+    // it (LoginAcceptedV4), by group. LoginRequestV3 and LoginAcceptedV3 only
+    // carry `encodings`.
+    struct capability_set {
+        uint32_t encodings = capability::None;
+        uint32_t compression = capability::None;
+        uint32_t bundling = capability::None;
+
+        // in wire order; new groups go at the end
+        static constexpr uint32_t capability_set::* groups[] = {
+            &capability_set::encodings, &capability_set::compression, &capability_set::bundling,
+        };
+
+        constexpr capability_set operator&(const capability_set& other) const {
+            return {encodings & other.encodings, compression & other.compression, bundling & other.bundling};
+        }
+
+        constexpr bool operator==(const capability_set&) const = default;
+    };
 }
 
 #endif //BALLANCEMMOSERVER_CONSTANTS_HPP
@@ -1,8 +1,11 @@
 #ifndef BALLANCEMMOSERVER_MAP_HPP
 #define BALLANCEMMOSERVER_MAP_HPP
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <unordered_map>
 #include "../message/message_utils.hpp"
@@ -41,35 +44,90 @@ namespace bmmo {
     using string_utils::hex_chars_from_string;
     using string_utils::string_from_hex_chars;
 
+    // The MD5 of a map, which is what tells maps apart; for keying lookup tables
+    // by maps without building strings.
+    struct map_key {
+        uint8_t md5[16] = {};
+
+        // `hex` has to be 32 hex digits.
+        static constexpr map_key from_hex(std::string_view hex) {
+            map_key key;
+            for (size_t i = 0; i < sizeof(md5); ++i)
+                key.md5[i] = uint8_t(string_utils::hex_digit_value(hex[i * 2]) << 4
+                                     | string_utils::hex_digit_value(hex[i * 2 + 1]));
+            return key;
+        }
+
+        // `bytes` as returned by `map::get_hash_bytes_string()`.
+        static map_key from_bytes(std::string_view bytes) {
+            map_key key;
+            std::memcpy(key.md5, bytes.data(), std::min(bytes.size(), sizeof(md5)));
+            return key;
+        }
+
+        std::string_view bytes() const { return {reinterpret_cast<const char*>(md5), sizeof(md5)}; }
+
+        bool operator==(const map_key&) const = default;
+    };
+
+    // MD5s are spread evenly already; folding them is as good as hashing them.
+    struct map_key_hash {
+        size_t operator()(const map_key& key) const noexcept {
+            uint64_t low, high;
+            std::memcpy(&low, key.md5, sizeof(low));
+            std::memcpy(&high, key.md5 + sizeof(low), sizeof(high));
+            return static_cast<size_t>(low ^ (high * 0x9e3779b97f4a7c15ull));
+        }
+    };
+
+    template <typename T>
+    using map_key_table = std::unordered_map<map_key, T, map_key_hash>;
+    // <md5, map_name>
+    typedef map_key_table<std::string> map_name_table;
+
+    // by level number; 0 is for none
+    inline constexpr std::array<map_key, 14> original_map_keys = {
+        map_key::from_hex("00000000000000000000000000000000"),
+        map_key::from_hex("a364b408fffaab4344806b427e37f1a7"),
+        map_key::from_hex("e90b2f535c8bf881e9cb83129fba241d"),
+        map_key::from_hex("22f895812942f954bab73a2924181d0d"),
+        map_key::from_hex("478faf2e028a7f352694fb2ab7326fec"),
+        map_key::from_hex("5797e3a9489a1cd6213c38c7ffcfb02a"),
+        map_key::from_hex("0dde7ec92927563bb2f34b8799b49e4c"),
+        map_key::from_hex("3473005097612bd0c0e9de5c4ea2e5de"),
+        map_key::from_hex("8b81694d53e6c5c87a6c7a5fa2e39a8d"),
+        map_key::from_hex("21283cde62e0f6d3847de85ae5abd147"),
+        map_key::from_hex("d80f54ffaa19be193a455908f8ff6e1d"),
+        map_key::from_hex("47f936f45540d67a0a1865eac334d2db"),
+        map_key::from_hex("2a1d29359b9802d4c6501dd2088884db"),
+        map_key::from_hex("9b5be1ca6a92ce56683fa208dd3453b4"),
+    };
+
     struct map {
         map_type type = map_type::Unknown;
         uint8_t md5[16] = {};
         int32_t level = 0;
 
-        static constexpr const char* const original_map_hashes[] = {
-            "00000000000000000000000000000000", // 0
-            "a364b408fffaab4344806b427e37f1a7",
-            "e90b2f535c8bf881e9cb83129fba241d",
-            "22f895812942f954bab73a2924181d0d",
-            "478faf2e028a7f352694fb2ab7326fec",
-            "5797e3a9489a1cd6213c38c7ffcfb02a",
-            "0dde7ec92927563bb2f34b8799b49e4c",
-            "3473005097612bd0c0e9de5c4ea2e5de",
-            "8b81694d53e6c5c87a6c7a5fa2e39a8d",
-            "21283cde62e0f6d3847de85ae5abd147",
-            "d80f54ffaa19be193a455908f8ff6e1d",
-            "47f936f45540d67a0a1865eac334d2db",
-            "2a1d29359b9802d4c6501dd2088884db",
-            "9b5be1ca6a92ce56683fa208dd3453b4"
-        };
+        map_key key() const {
+            map_key key;
+            std::memcpy(key.md5, md5, sizeof(md5));
+            return key;
+        }
+
+        void set_key(const map_key& key) {
+            std::memcpy(md5, key.md5, sizeof(md5));
+        }
+
+        // Makes this original level `level_number` (clamped to 0-13).
+        void set_original_level(int level_number) {
+            type = map_type::OriginalLevel;
+            level = std::clamp(level_number, 0, 13);
+            set_key(original_map_keys[level]);
+        }
 
         bool is_original_level() const {
             if (type != map_type::OriginalLevel) return false;
-            decltype(md5) level_md5;
-            hex_chars_from_string(level_md5, original_map_hashes[std::clamp(level, 0, 13)]);
-            if (memcmp(level_md5, md5, sizeof(md5)) == 0)
-                return true;
-            return false;
+            return std::memcmp(original_map_keys[std::clamp(level, 0, 13)].md5, md5, sizeof(md5)) == 0;
         }
 
         bool operator==(const map& that) const {
@@ -93,8 +151,8 @@ namespace bmmo {
             return map_name;
         }
 
-        std::string get_display_name(const std::unordered_map<std::string, std::string>& map_names) const {
-            if (auto it = map_names.find(get_hash_bytes_string()); it != map_names.end()) {
+        std::string get_display_name(const map_name_table& map_names) const {
+            if (auto it = map_names.find(key()); it != map_names.end()) {
                 return get_display_name(it->second);
             }
             std::string hash_string = get_hash_string();
@@ -121,14 +179,14 @@ namespace bmmo {
             return map::get_display_name(name);
         }
 
-        void serialize(std::stringstream& raw) {
+        void serialize(byte_stream& raw) {
             message_utils::write_string(name, raw);
             raw.write(reinterpret_cast<const char*>(&type), sizeof(type));
             raw.write(reinterpret_cast<const char*>(md5), sizeof(md5));
             raw.write(reinterpret_cast<const char*>(&level), sizeof(level));
         }
 
-        bool deserialize(std::stringstream& raw) {
+        bool deserialize(byte_stream& raw) {
             if (!message_utils::read_string(raw, name)) return false;
             raw.read(reinterpret_cast<char*>(&type), sizeof(type));
             if (!raw.good() || raw.gcount() != sizeof(type)) return false;
@@ -1,5 +1,6 @@
 #ifndef BALLANCEMMOSERVER_RANKING_ENTRY_HPP
 #define BALLANCEMMOSERVER_RANKING_ENTRY_HPP
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -17,6 +18,7 @@ namespace bmmo::ranking_entry {
         int sr_ranking{};
         float sr_time{};
         std::string formatted_hs_score;
+        int hs_score{}; // the number `formatted_hs_score` starts with; not sent over the network
 
         std::string to_string(int ranking, level_mode default_mode) const;
     };
@@ -27,30 +29,40 @@ namespace bmmo::ranking_entry {
         std::string to_string(int ranking) const;
     };
 
+    // Highscores are formatted as "<score>" or "<score> [<lives>]".
+    static inline int parse_hs_score(const std::string& formatted_hs_score) {
+        return std::atoi(formatted_hs_score.c_str());
+    }
+
     static constexpr bool sr_sorter(const finish_entry& r1, decltype(r1) r2) {
         return r1.sr_ranking < r2.sr_ranking;
     };
 
-    static inline bool hs_sorter(const finish_entry& r1, decltype(r1) r2) {
-        const auto score_diff = atoi(r1.formatted_hs_score.c_str()) - atoi(r2.formatted_hs_score.c_str());
-        if (score_diff == 0) return sr_sorter(r1, r2);
-        return score_diff > 0;
+    // Needs `hs_score` filled in; see `sort_rankings`.
+    static constexpr bool hs_sorter(const finish_entry& r1, decltype(r1) r2) {
+        if (r1.hs_score == r2.hs_score) return sr_sorter(r1, r2);
+        return r1.hs_score > r2.hs_score;
     };
 
     static constexpr bool dnf_sorter(const dnf_entry& r1, decltype(r1) r2) {
-        return r1.dnf_sector >= r2.dnf_sector;
+        return r1.dnf_sector > r2.dnf_sector;
     };
 
     typedef std::vector<finish_entry> player_finish_rankings;
     typedef std::vector<dnf_entry> player_dnf_rankings;
     typedef std::pair<player_finish_rankings, player_dnf_rankings> player_rankings;
-    typedef std::unordered_map<std::string, player_rankings> map_rankings;
+    typedef map_key_table<player_rankings> map_rankings;
 
+    // Also fills in `hs_score` of entries received over the network.
     void sort_rankings(player_rankings& rankings, bool hs_mode = false);
 
-    // std::pair<text, color>
+    // std::pair<text, color>; `rankings` as sorted by `sort_rankings`.
     std::vector<std::pair<std::string, int>> get_formatted_rankings(
             const player_rankings& rankings, const std::string& map_name, bool hs_mode = false);
+    // Same for rankings kept sorted elsewhere.
+    std::vector<std::pair<std::string, int>> get_formatted_rankings(
+            const std::vector<const finish_entry*>& finishes, const std::vector<const dnf_entry*>& dnfs,
+            const std::string& map_name, bool hs_mode = false);
 }
 
 #endif //BALLANCEMMOSERVER_RANKING_ENTRY_HPP
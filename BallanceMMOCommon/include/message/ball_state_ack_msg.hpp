@@ -0,0 +1,11 @@
+#ifndef BALLANCEMMOSERVER_BALL_STATE_ACK_MSG_HPP
+#define BALLANCEMMOSERVER_BALL_STATE_ACK_MSG_HPP
+#include "message.hpp"
+
+namespace bmmo {
+    // Sequence number of a received OwnedDeltaBallState message,
+    // which the server may then use as a baseline.
+    typedef struct message<uint16_t, BallStateAck> ball_state_ack_msg;
+}
+
+#endif //BALLANCEMMOSERVER_BALL_STATE_ACK_MSG_HPP
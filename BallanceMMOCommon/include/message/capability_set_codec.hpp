@@ -0,0 +1,39 @@
+#ifndef BALLANCEMMOSERVER_CAPABILITY_SET_CODEC_HPP
+#define BALLANCEMMOSERVER_CAPABILITY_SET_CODEC_HPP
+#include "message_schema.hpp"
+#include "../entity/constants.hpp"
+
+namespace bmmo::schema {
+    // uint8 group count, then a uint32 per group (see capability_set::groups).
+    // Groups a peer doesn't know about yet are skipped; ones it didn't send are empty.
+    struct capability_set_codec {
+        static constexpr size_t GROUP_COUNT = std::size(capability_set::groups);
+        static constexpr size_t min_size = sizeof(uint8_t);
+
+        static constexpr size_t size(const capability_set&) {
+            return sizeof(uint8_t) + GROUP_COUNT * sizeof(uint32_t);
+        }
+
+        static void write(const capability_set& value, byte_stream& stream) {
+            pod<uint8_t>::write(uint8_t(GROUP_COUNT), stream);
+            for (auto group: capability_set::groups)
+                pod<uint32_t>::write(value.*group, stream);
+        }
+
+        static bool read(capability_set& value, byte_stream& stream) {
+            uint8_t count{};
+            if (!pod<uint8_t>::read(count, stream) || stream.remaining() < count * sizeof(uint32_t))
+                return false;
+            value = {};
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t bits{};
+                pod<uint32_t>::read(bits, stream);
+                if (i < GROUP_COUNT)
+                    value.*capability_set::groups[i] = bits;
+            }
+            return true;
+        }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_CAPABILITY_SET_CODEC_HPP
@@ -7,7 +7,7 @@
 
 namespace bmmo {
     struct extra_life_msg: public serializable_message {
-        std::unordered_map<std::string, int> life_count_goals;
+        map_key_table<int> life_count_goals;
 
         constexpr static auto HASH_SIZE = sizeof(bmmo::map::md5);
 
@@ -19,7 +19,7 @@ namespace bmmo {
             uint32_t size = life_count_goals.size();
             raw.write(reinterpret_cast<const char*>(&size), sizeof(size));
             for (const auto& [hash, goal]: life_count_goals) {
-                raw.write(hash.c_str(), HASH_SIZE);
+                raw.write(reinterpret_cast<const char*>(hash.md5), HASH_SIZE);
                 raw.write(reinterpret_cast<const char*>(&goal), sizeof(goal));
             }
 
@@ -34,8 +34,8 @@ namespace bmmo {
             if (!raw.good()) return false;
             life_count_goals.reserve(size);
             for (uint32_t i = 0; i < size; ++i) {
-                std::string hash(HASH_SIZE, 0);
-                raw.read(hash.data(), HASH_SIZE);
+                map_key hash;
+                raw.read(reinterpret_cast<char*>(hash.md5), HASH_SIZE);
                 if (!raw.good() || raw.gcount() != HASH_SIZE)
                     return false;
                 int goal;
@@ -1,6 +1,7 @@
 #ifndef BALLANCEMMO_SERVER_HASH_DATA_MSG_HPP
 #define BALLANCEMMO_SERVER_HASH_DATA_MSG_HPP
 #include "message.hpp"
+#include "message_schema.hpp"
 #include "../entity/map.hpp"
 #include <cstdint>
 #include <unordered_map>
@@ -14,13 +15,11 @@ namespace bmmo {
         {"Managers\\ParameterOperations.dll", "0219ec8f74215cfca083b5020f8c48e9"},
     };
 
-    struct hash_data_msg: public serializable_message {
+    struct hash_data_msg: public schema_message<hash_data_msg, HashData> {
         // std::string data_name;
         // uint8_t md5[16];
         std::unordered_map<std::string, std::array<uint8_t, 16>> data;
 
-        hash_data_msg(): serializable_message(bmmo::HashData) {};
-
         bool is_same_data(std::string name, std::string hash_string) {
             decltype(data)::mapped_type md5;
             if (hash_string.size() != 2 * md5.size())
@@ -37,32 +36,8 @@ namespace bmmo {
         };
 
         // without the length to preserve compatibility
-        bool serialize() {
-            serializable_message::serialize();
-
-            for (const auto& [name, md5]: data) {
-                message_utils::write_string(name, raw);
-                raw.write(reinterpret_cast<const char*>(md5.data()), md5.size());
-            }
-
-            return raw.good();
-        };
-
-        bool deserialize() {
-            serializable_message::deserialize();
-
-            while (raw.good() && raw.peek() != std::ifstream::traits_type::eof()) {
-                std::string data_name;
-                if (!message_utils::read_string(raw, data_name))
-                    return false;
-                auto& md5 = data[data_name];
-                raw.read(reinterpret_cast<char*>(md5.data()), md5.size());
-                if (!raw.good() || raw.gcount() != (std::streamsize) md5.size())
-                    return false;
-            }
-
-            return raw.good();
-        };
+        using layout = schema::record<
+            schema::field<&hash_data_msg::data, schema::map_until_end<schema::string<>, schema::pod<decltype(data)::mapped_type>>>>;
     };
 };
 
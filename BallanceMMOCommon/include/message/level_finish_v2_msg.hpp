@@ -19,12 +19,17 @@ namespace bmmo {
         struct map map;
         int32_t rank = 0;
 
-        std::string get_formatted_score() {
+        int get_score() const {
             int score = points + lives * lifeBonus;
-            if (map.is_original_level()) {
+            if (map.is_original_level())
                 score += levelBonus;
+            return score;
+        }
+
+        std::string get_formatted_score() {
+            const int score = get_score();
+            if (map.is_original_level())
                 return std::to_string(score);
-            }
             std::string text(64, 0);
             text.resize(std::snprintf(text.data(), text.size(), "%d [%d]", score, lives));
             return text;
@@ -0,0 +1,34 @@
+#ifndef BALLANCEMMOSERVER_LOGIN_ACCEPTED_V4_MSG_HPP
+#define BALLANCEMMOSERVER_LOGIN_ACCEPTED_V4_MSG_HPP
+#include "message.hpp"
+#include "message_schema.hpp"
+#include "capability_set_codec.hpp"
+#include "login_accepted_v3_msg.hpp"
+#include "../entity/constants.hpp"
+
+namespace bmmo {
+    // LoginAcceptedV3 with every group of capabilities enabled for this connection,
+    // in reply to LoginRequestV4. The capabilities come first, so the roster after them
+    // can be copied as is from a prepared message.
+    struct login_accepted_v4_msg: public schema_message<login_accepted_v4_msg, LoginAcceptedV4> {
+        capability_set capabilities;
+        std::unordered_map<HSteamNetConnection, player_status_v3> online_players;
+
+        using player_layout = login_accepted_v3_msg::player_layout;
+
+        using layout = schema::record<
+            schema::field<&login_accepted_v4_msg::capabilities, schema::capability_set_codec>,
+            schema::field<&login_accepted_v4_msg::online_players,
+                    schema::map<uint32_t, schema::pod<HSteamNetConnection>, player_layout>>>;
+
+        // so that replies from older servers can be handled the same way
+        static login_accepted_v4_msg from(login_accepted_v3_msg&& msg) {
+            login_accepted_v4_msg upgraded;
+            upgraded.capabilities.encodings = msg.capabilities;
+            upgraded.online_players = std::move(msg.online_players);
+            return upgraded;
+        }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_LOGIN_ACCEPTED_V4_MSG_HPP
@@ -0,0 +1,44 @@
+#ifndef BALLANCEMMOSERVER_LOGIN_REQUEST_V4_MSG_HPP
+#define BALLANCEMMOSERVER_LOGIN_REQUEST_V4_MSG_HPP
+#include <cstring>
+#include "message.hpp"
+#include "message_schema.hpp"
+#include "capability_set_codec.hpp"
+#include "login_request_v3_msg.hpp"
+#include "../entity/version.hpp"
+#include "../entity/constants.hpp"
+
+namespace bmmo {
+    // LoginRequestV3 with every group of capabilities the client supports;
+    // answered with LoginAcceptedV4. Servers from before capability groups close
+    // the connection on it, so for now clients send LoginRequestV3 with
+    // `capability_groups` instead; the server handles both as this.
+    struct login_request_v4_msg: public schema_message<login_request_v4_msg, LoginRequestV4> {
+        std::string nickname;
+        bmmo::version_t version;
+        uint8_t cheated = false;
+        uint8_t uuid[16];
+        capability_set capabilities;
+
+        using layout = schema::record<
+            schema::field<&login_request_v4_msg::version>,
+            schema::field<&login_request_v4_msg::nickname>,
+            schema::field<&login_request_v4_msg::cheated>,
+            schema::field<&login_request_v4_msg::uuid>,
+            schema::field<&login_request_v4_msg::capabilities, schema::capability_set_codec>>;
+
+        // so that older clients can be handled the same way
+        static login_request_v4_msg from(login_request_v3_msg&& msg) {
+            login_request_v4_msg upgraded;
+            upgraded.nickname = std::move(msg.nickname);
+            upgraded.version = msg.version;
+            upgraded.cheated = msg.cheated;
+            std::memcpy(upgraded.uuid, msg.uuid, sizeof(upgraded.uuid));
+            upgraded.capabilities = msg.capability_groups;
+            upgraded.capabilities.encodings |= msg.capabilities;
+            return upgraded;
+        }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_LOGIN_REQUEST_V4_MSG_HPP
@@ -5,8 +5,9 @@
 #include <steam/steamnetworkingtypes.h>
 #include <vector>
 #include <unordered_map>
-#include <sstream>
 #include <concepts>
+#include <iterator>
+#include "../utility/byte_stream.hpp"
 
 namespace bmmo {
     enum opcode : uint32_t {
@@ -77,8 +78,37 @@ namespace bmmo {
         RestartRequest,
         ExtraLife,
         LatencyData,
+        OwnedDeltaBallState,
+        BallStateAck,
+        OwnedQuantizedBallState,
+        LoginRequestV4,
+        LoginAcceptedV4,
     };
 
+    inline const char* opcode_name(opcode code) {
+        static constexpr const char* names[] = {
+            "None", "LoginRequest", "LoginAccepted", "SimpleAction", "PlayerDisconnected", "PlayerConnected",
+            "Ping", "BallState", "OwnedBallState", "KeyboardInput",
+            "Chat",
+            "LevelFinish",
+            "LoginRequestV2", "LoginAcceptedV2", "PlayerConnectedV2",
+            "CheatState", "OwnedCheatState", "CheatToggle", "OwnedCheatToggle",
+            "KickRequest", "PlayerKicked",
+            "OwnedBallStateV2", "LoginRequestV3", "LevelFinishV2",
+            "ActionDenied", "OpState",
+            "Countdown", "DidNotFinish",
+            "MapNames", "PlainText", "CurrentMap", "HashData",
+            "TimedBallState", "OwnedTimedBallState", "Timestamp",
+            "PrivateChat", "PlayerReady", "ImportantNotification", "ModList", "PopupBox", "CurrentSector",
+            "LoginAcceptedV3", "PermanentNotification", "SoundData", "PublicNotification",
+            "OwnedCompressedBallState", "SoundStream", "ScoreList", "HighscoreTimerCalibration", "NameUpdate",
+            "OwnedSimpleAction", "RestartRequest", "ExtraLife", "LatencyData", "OwnedDeltaBallState",
+            "BallStateAck", "OwnedQuantizedBallState", "LoginRequestV4", "LoginAcceptedV4",
+        };
+        static_assert(std::size(names) == LoginAcceptedV4 + 1, "opcode_name is missing an opcode");
+        return (code < std::size(names)) ? names[code] : "Unknown";
+    }
+
     template<typename T, opcode C = None>
     struct message {
         opcode code = C;
@@ -92,21 +122,18 @@ namespace bmmo {
         explicit serializable_message(opcode code): code(code) {}
 
         opcode code;
-        std::stringstream raw;
+        byte_stream raw;
 
-        size_t size() {
-            // return raw.str().size();
-            return static_cast<size_t>(raw.tellp()); // why this is non-const!!!
+        size_t size() const {
+            return raw.size();
         }
 
-        // returns garbage
-        // inline char* data() noexcept {
-        //     return raw.str().data();
-        // }
+        const char* data() const noexcept {
+            return raw.data();
+        }
 
         virtual void clear() {
-            std::stringstream temp;
-            raw.swap(temp);
+            raw.reset();
         }
 
         // entity -> raw
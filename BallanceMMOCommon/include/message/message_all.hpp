@@ -3,6 +3,7 @@
 
 #include "message.hpp"
 #include "message_colors.hpp"
+#include "message_dispatcher.hpp"
 #include "login_request_msg.hpp"
 #include "login_request_v2_msg.hpp"
 #include "login_request_v3_msg.hpp"
@@ -54,5 +55,10 @@
 #include "restart_request_msg.hpp"
 #include "extra_life_msg.hpp"
 #include "latency_data_msg.hpp"
+#include "owned_delta_ball_state_msg.hpp"
+#include "ball_state_ack_msg.hpp"
+#include "owned_quantized_ball_state_msg.hpp"
+#include "login_request_v4_msg.hpp"
+#include "login_accepted_v4_msg.hpp"
 
 #endif //BALLANCEMMOSERVER_MESSAGE_ALL_HPP
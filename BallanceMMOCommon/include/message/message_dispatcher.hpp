@@ -0,0 +1,143 @@
+#ifndef BALLANCEMMOSERVER_MESSAGE_DISPATCHER_HPP
+#define BALLANCEMMOSERVER_MESSAGE_DISPATCHER_HPP
+#include "message.hpp"
+#include <steam/steamnetworkingtypes.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace bmmo {
+    // Table of message handlers indexed by opcode.
+    //
+    // Handlers are registered per message type and get the decoded message, the
+    // networking message it came from and whatever `Args` the caller of `dispatch`
+    // passes along:
+    //
+    //   dispatcher.on<bmmo::chat_msg>([](bmmo::chat_msg& msg, ISteamNetworkingMessage* networking_msg, int extra) {...});
+    //
+    // Trivially copyable messages are handed over in place (so handlers may modify
+    // them before relaying them) once the payload is known to be large enough;
+    // serializable ones are deserialized first. Messages failing either check never
+    // reach their handler and are counted as rejected instead.
+    //
+    // Not thread-safe. Handlers may dispatch further messages themselves, but must not
+    // register new handlers while a dispatch is in progress.
+    template <typename... Args>
+    class message_dispatcher {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        struct opcode_stats {
+            uint64_t calls = 0;
+            uint64_t rejected = 0;
+            uint64_t bytes = 0;
+            clock::duration time{}; // spent in the handler, including decoding
+        };
+
+        enum class result {
+            Handled,
+            Rejected, // malformed; the handler hasn't been called
+            Unknown,  // no handler registered for this opcode
+        };
+
+        using raw_handler = std::function<void(ISteamNetworkingMessage*, Args...)>;
+
+        // Registers `handler` for messages of type `T`, replacing any previous one.
+        template <typename T, typename F>
+        void on(F handler) {
+            const opcode code = T{}.code;
+            if constexpr (trivially_copyable_msg<T>) {
+                entry_for(code).invoke = [handler = std::move(handler)](ISteamNetworkingMessage* networking_msg, Args... args) {
+                    if (networking_msg->m_cbSize < static_cast<int>(sizeof(T)))
+                        return false;
+                    handler(*static_cast<T*>(networking_msg->m_pData), networking_msg, args...);
+                    return true;
+                };
+            } else {
+                static_assert(non_trivially_copyable_msg<T>);
+                entry_for(code).invoke = [handler = std::move(handler)](ISteamNetworkingMessage* networking_msg, Args... args) {
+                    T msg{};
+                    msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
+                    if (!msg.deserialize())
+                        return false;
+                    handler(msg, networking_msg, args...);
+                    return true;
+                };
+            }
+        }
+
+        // Registers a handler which does its own parsing (if any) of `code` messages.
+        void on(opcode code, raw_handler handler) {
+            entry_for(code).invoke = [handler = std::move(handler)](ISteamNetworkingMessage* networking_msg, Args... args) {
+                handler(networking_msg, args...);
+                return true;
+            };
+        }
+
+        // Accepts these messages without doing anything with them
+        // (e.g. ones only meant to travel in the other direction).
+        void ignore(std::initializer_list<opcode> codes) {
+            for (auto code: codes)
+                entry_for(code).invoke = [](ISteamNetworkingMessage*, Args...) { return true; };
+        }
+
+        bool has_handler(opcode code) const {
+            return code < table_.size() && table_[code].invoke;
+        }
+
+        // `networking_msg` must hold at least an opcode.
+        result dispatch(ISteamNetworkingMessage* networking_msg, Args... args) {
+            const auto code = *static_cast<const opcode*>(networking_msg->m_pData);
+            if (!has_handler(code))
+                return result::Unknown;
+            // the table doesn't change during dispatch, so this stays valid even if we're reentered
+            auto& e = table_[code];
+            const auto start = clock::now();
+            const bool accepted = e.invoke(networking_msg, args...);
+            e.stats.time += clock::now() - start;
+            ++e.stats.calls;
+            e.stats.bytes += networking_msg->m_cbSize;
+            if (!accepted)
+                ++e.stats.rejected;
+            return accepted ? result::Handled : result::Rejected;
+        }
+
+        const opcode_stats& stats(opcode code) const {
+            static const opcode_stats none{};
+            return has_handler(code) ? table_[code].stats : none;
+        }
+
+        // Calls `f(opcode, const opcode_stats&)` for every opcode which has a handler.
+        template <typename F>
+        void for_each_stats(F&& f) const {
+            for (size_t i = 0; i < table_.size(); ++i) {
+                if (table_[i].invoke)
+                    f(static_cast<opcode>(i), table_[i].stats);
+            }
+        }
+
+        void reset_stats() {
+            for (auto& e: table_)
+                e.stats = {};
+        }
+
+    private:
+        struct entry {
+            std::function<bool(ISteamNetworkingMessage*, Args...)> invoke;
+            opcode_stats stats;
+        };
+
+        entry& entry_for(opcode code) {
+            if (code >= table_.size())
+                table_.resize(code + 1);
+            return table_[code];
+        }
+
+        std::vector<entry> table_;
+    };
+}
+
+#endif //BALLANCEMMOSERVER_MESSAGE_DISPATCHER_HPP
@@ -0,0 +1,321 @@
+#ifndef BALLANCEMMOSERVER_MESSAGE_SCHEMA_HPP
+#define BALLANCEMMOSERVER_MESSAGE_SCHEMA_HPP
+#include "message.hpp"
+#include "message_utils.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+// Declarative wire layouts for messages.
+//
+// A codec says how one value goes over the wire. It provides
+//   static constexpr size_t min_size;   // smallest possible encoding, for bounds checks
+//   static size_t size(const T&);       // exact encoded size
+//   static void write(const T&, byte_stream&);
+//   static bool read(T&, byte_stream&);
+// `record` makes a codec for a struct out of a list of `field`s, so a message
+// only has to list its members in wire order:
+//
+//   struct foo_msg: schema_message<foo_msg, Foo> {
+//       HSteamNetConnection player_id;
+//       std::string text;
+//       using layout = schema::record<
+//           schema::field<&foo_msg::player_id>,
+//           schema::field<&foo_msg::text>>;
+//   };
+//
+// and gets serialize(), deserialize() and serialized_size() generated from that.
+namespace bmmo::schema {
+    template <typename>
+    struct member_pointer_traits;
+
+    template <typename C, typename M>
+    struct member_pointer_traits<M C::*> {
+        using class_type = C;
+        using member_type = M;
+    };
+
+    // raw bytes of a trivially copyable value
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    struct pod {
+        static constexpr size_t min_size = sizeof(T);
+
+        static constexpr size_t size(const T&) { return sizeof(T); }
+
+        static void write(const T& value, byte_stream& stream) {
+            stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        static bool read(T& value, byte_stream& stream) {
+            stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+            return stream.good() && stream.gcount() == sizeof(T);
+        }
+    };
+
+    // a string prefixed by its length; longer strings are cut off at what `Length` can hold
+    template <typename Length = uint32_t>
+    struct string {
+        static constexpr size_t min_size = sizeof(Length);
+
+        static size_t length(const std::string& value) {
+            return std::min<size_t>(value.size(), std::numeric_limits<Length>::max());
+        }
+
+        static size_t size(const std::string& value) { return sizeof(Length) + length(value); }
+
+        static void write(const std::string& value, byte_stream& stream) {
+            const auto len = static_cast<Length>(length(value));
+            stream.write(reinterpret_cast<const char*>(&len), sizeof(len));
+            stream.write(value.data(), len);
+        }
+
+        static bool read(std::string& value, byte_stream& stream) {
+            return message_utils::read_string<Length>(stream, value);
+        }
+    };
+
+    // exactly `N` bytes held in a string (e.g. md5 bytes), zero-padded if shorter
+    template <size_t N>
+    struct fixed_string {
+        static constexpr size_t min_size = N;
+
+        static constexpr size_t size(const std::string&) { return N; }
+
+        static void write(const std::string& value, byte_stream& stream) {
+            char* dest = stream.extend(N);
+            const size_t count = std::min(value.size(), N);
+            std::memcpy(dest, value.data(), count);
+            std::memset(dest + count, 0, N - count);
+        }
+
+        static bool read(std::string& value, byte_stream& stream) {
+            if (stream.remaining() < N)
+                return false;
+            value.resize(N);
+            stream.read(value.data(), N);
+            return stream.good();
+        }
+    };
+
+    template <typename T>
+    struct default_codec { using type = pod<T>; };
+
+    template <>
+    struct default_codec<std::string> { using type = string<>; };
+
+    // a length-prefixed vector
+    template <typename Length, typename ElementCodec>
+    struct sequence {
+        static constexpr size_t min_size = sizeof(Length);
+
+        template <typename Container>
+        static size_t size(const Container& values) {
+            size_t total = sizeof(Length);
+            for (const auto& value: values)
+                total += ElementCodec::size(value);
+            return total;
+        }
+
+        template <typename Container>
+        static void write(const Container& values, byte_stream& stream) {
+            const auto count = static_cast<Length>(values.size());
+            pod<Length>::write(count, stream);
+            for (const auto& value: values)
+                ElementCodec::write(value, stream);
+        }
+
+        template <typename Container>
+        static bool read(Container& values, byte_stream& stream) {
+            Length count{};
+            if (!pod<Length>::read(count, stream))
+                return false;
+            // don't let a bogus count allocate more than the message could possibly hold
+            if (ElementCodec::min_size > 0 && count > stream.remaining() / ElementCodec::min_size)
+                return false;
+            values.resize(count);
+            for (auto& value: values) {
+                if (!ElementCodec::read(value, stream))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    template <typename KeyCodec, typename ValueCodec>
+    struct map_entry {
+        static constexpr size_t min_size = KeyCodec::min_size + ValueCodec::min_size;
+
+        template <typename Entry>
+        static size_t size(const Entry& entry) {
+            return KeyCodec::size(entry.first) + ValueCodec::size(entry.second);
+        }
+
+        template <typename Entry>
+        static void write(const Entry& entry, byte_stream& stream) {
+            KeyCodec::write(entry.first, stream);
+            ValueCodec::write(entry.second, stream);
+        }
+
+        template <typename Map>
+        static bool read_into(Map& values, byte_stream& stream) {
+            typename Map::key_type key{};
+            if (!KeyCodec::read(key, stream))
+                return false;
+            return ValueCodec::read(values[key], stream);
+        }
+    };
+
+    // a length-prefixed associative container; later duplicates of a key win
+    template <typename Length, typename KeyCodec, typename ValueCodec>
+    struct map {
+        using entry = map_entry<KeyCodec, ValueCodec>;
+        static constexpr size_t min_size = sizeof(Length);
+
+        template <typename Map>
+        static size_t size(const Map& values) {
+            size_t total = sizeof(Length);
+            for (const auto& value: values)
+                total += entry::size(value);
+            return total;
+        }
+
+        template <typename Map>
+        static void write(const Map& values, byte_stream& stream) {
+            const auto count = static_cast<Length>(values.size());
+            pod<Length>::write(count, stream);
+            for (const auto& value: values)
+                entry::write(value, stream);
+        }
+
+        template <typename Map>
+        static bool read(Map& values, byte_stream& stream) {
+            Length count{};
+            if (!pod<Length>::read(count, stream))
+                return false;
+            if (entry::min_size > 0 && count > stream.remaining() / entry::min_size)
+                return false;
+            if constexpr (requires { values.reserve(count); })
+                values.reserve(count);
+            for (Length i = 0; i < count; ++i) {
+                if (!entry::read_into(values, stream))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    // an associative container without a length prefix, running until the end of the message
+    template <typename KeyCodec, typename ValueCodec>
+    struct map_until_end {
+        using entry = map_entry<KeyCodec, ValueCodec>;
+        static constexpr size_t min_size = 0;
+
+        template <typename Map>
+        static size_t size(const Map& values) {
+            size_t total = 0;
+            for (const auto& value: values)
+                total += entry::size(value);
+            return total;
+        }
+
+        template <typename Map>
+        static void write(const Map& values, byte_stream& stream) {
+            for (const auto& value: values)
+                entry::write(value, stream);
+        }
+
+        template <typename Map>
+        static bool read(Map& values, byte_stream& stream) {
+            while (stream.remaining() > 0) {
+                if (!entry::read_into(values, stream))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    template <auto Member, typename Codec = typename default_codec<
+            typename member_pointer_traits<decltype(Member)>::member_type>::type>
+    struct field {
+        static constexpr size_t min_size = Codec::min_size;
+
+        template <typename T>
+        static size_t size(const T& object) { return Codec::size(object.*Member); }
+
+        template <typename T>
+        static void write(const T& object, byte_stream& stream) { Codec::write(object.*Member, stream); }
+
+        template <typename T>
+        static bool read(T& object, byte_stream& stream) { return Codec::read(object.*Member, stream); }
+    };
+
+    // A field added to the end of an existing message. Older peers stop reading
+    // before it; if it's missing, the member is reset to its default value.
+    template <auto Member, typename Codec = typename default_codec<
+            typename member_pointer_traits<decltype(Member)>::member_type>::type>
+    struct optional_field: field<Member, Codec> {
+        static constexpr size_t min_size = 0;
+
+        template <typename T>
+        static bool read(T& object, byte_stream& stream) {
+            if (stream.remaining() == 0) {
+                object.*Member = {};
+                return true;
+            }
+            return Codec::read(object.*Member, stream);
+        }
+    };
+
+    template <typename... Fields>
+    struct record {
+        static constexpr size_t min_size = (size_t{0} + ... + Fields::min_size);
+
+        template <typename T>
+        static size_t size(const T& object) { return (size_t{0} + ... + Fields::size(object)); }
+
+        template <typename T>
+        static void write(const T& object, byte_stream& stream) { (Fields::write(object, stream), ...); }
+
+        template <typename T>
+        static bool read(T& object, byte_stream& stream) {
+            if (stream.remaining() < min_size)
+                return false;
+            return (Fields::read(object, stream) && ...);
+        }
+    };
+}
+
+namespace bmmo {
+    // Base for messages laid out by a schema; `Derived::layout` must be a
+    // `schema::record` over `Derived`.
+    template <typename Derived, opcode Code>
+    struct schema_message: public serializable_message {
+        schema_message(): serializable_message(Code) {}
+
+        size_t serialized_size() const {
+            return sizeof(opcode) + Derived::layout::size(self());
+        }
+
+        bool serialize() override {
+            raw.reserve(raw.size() + serialized_size());
+            serializable_message::serialize();
+            Derived::layout::write(self(), raw);
+            return true;
+        }
+
+        bool deserialize() override {
+            if (!serializable_message::deserialize())
+                return false;
+            return Derived::layout::read(self(), raw);
+        }
+
+    private:
+        const Derived& self() const { return static_cast<const Derived&>(*this); }
+        Derived& self() { return static_cast<Derived&>(*this); }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_MESSAGE_SCHEMA_HPP
@@ -2,7 +2,6 @@
 #define BALLANCEMMOSERVER_MESSAGE_UTILS_HPP
 #include <steam/steamnetworkingtypes.h>
 #include <string>
-#include <sstream>
 #include <concepts>
 #include "message.hpp"
 #include "../utility/string_utils.hpp"
@@ -14,7 +13,7 @@ namespace bmmo::message_utils {
 
     // template T: type to store length of the string
     template<typename T = uint32_t>
-    inline void write_string(std::string str, std::stringstream& stream) {
+    inline void write_string(const std::string& str, byte_stream& stream) {
         T length = static_cast<T>(str.length());
         stream.write(reinterpret_cast<const char*>(&length), sizeof(length));
         stream.write(str.c_str(), str.length());
@@ -22,36 +21,72 @@ namespace bmmo::message_utils {
 
     // template T: type to store length of the string
     template<typename T = uint32_t>
-    inline bool read_string(std::stringstream& stream, std::string& str) {
+    inline bool read_string(byte_stream& stream, std::string& str) {
         T length = 0;
         stream.read(reinterpret_cast<char*>(&length), sizeof(length));
-        if (length > stream.tellp())
+        if (!stream.good() || length > stream.remaining())
             return false;
-        str.resize(length);
-        stream.read(str.data(), length);
+        str.assign(stream.data() + stream.tellg(), length);
+        stream.ignore(length);
         return true;
     }
 
-    template<std::semiregular T>
-    constexpr inline bool read_variable(std::istream& stream, T* t) {
+    // also used on std::istream's (e.g. record files)
+    template<std::semiregular T, typename Stream>
+    constexpr inline bool read_variable(Stream& stream, T* t) {
         stream.read(reinterpret_cast<char*>(t), sizeof(T));
         if (stream.good() && stream.gcount() == sizeof(T))
             return true;
         return false;
     }
 
-    template<std::semiregular T>
-    constexpr inline T read_variable(std::istream& stream) {
+    template<std::semiregular T, typename Stream>
+    constexpr inline T read_variable(Stream& stream) {
         T t;
         stream.read(reinterpret_cast<char*>(&t), sizeof(T));
         return t;
     }
 
-    template<std::semiregular T>
-    constexpr inline void write_variable(const T* t, std::ostream& stream) {
+    template<std::semiregular T, typename Stream>
+    constexpr inline void write_variable(const T* t, Stream& stream) {
         stream.write(reinterpret_cast<const char*>(t), sizeof(T));
     }
 
+    // LEB128-style unsigned variable-length integers; 7 bits per byte.
+    inline void write_varint(uint64_t value, byte_stream& stream) {
+        char buf[10];
+        int length = 0;
+        do {
+            buf[length] = static_cast<char>(value & 0x7f);
+            value >>= 7;
+            if (value != 0) buf[length] |= 0x80;
+            ++length;
+        } while (value != 0);
+        stream.write(buf, length);
+    }
+
+    inline bool read_varint(byte_stream& stream, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const int byte = stream.get();
+            if (byte == byte_stream::traits_type::eof())
+                return false;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // maps signed integers with small absolute values to small unsigned ones
+    constexpr inline uint64_t zigzag_encode(int64_t value) {
+        return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    }
+
+    constexpr inline int64_t zigzag_decode(uint64_t value) {
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
     template<trivially_copyable_msg T>
     constexpr inline T deserialize(void* data, int) {
         return *reinterpret_cast<T*>(data);
@@ -3,6 +3,9 @@
 #include "message.hpp"
 #include "message_utils.hpp"
 #include "owned_timed_ball_state_msg.hpp"
+#include "../utility/ball_state_codec.hpp"
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <type_traits>
 #include <cmath>
@@ -35,70 +38,100 @@ namespace bmmo {
         static constexpr int ROTATION_COUNT = 512;
         static constexpr float ROTATION_STEP = std::numbers::sqrt2_v<float> / (ROTATION_COUNT - 2);
         static constexpr int TIMESTAMP_SIZE = 6;
+        static constexpr size_t BALL_SIZE = sizeof(uint8_t) + sizeof(vec3) + sizeof(uint32_t) + TIMESTAMP_SIZE + sizeof(HSteamNetConnection);
+        static constexpr size_t UNCHANGED_BALL_SIZE = TIMESTAMP_SIZE + sizeof(HSteamNetConnection);
+        // rotations are (de)compressed this many at a time, see ball_state_codec
+        static constexpr size_t ROTATION_BATCH_SIZE = 256;
 
         struct compressed_bitfield {
             signed int flag: compressed_flag::used_bits,
                 rotation0: ROTATION_BIT_LENGTH, rotation1: ROTATION_BIT_LENGTH, rotation2: ROTATION_BIT_LENGTH;
         };
 
-        bool serialize() override {
-            serializable_message::serialize();
-
-            auto size = (uint16_t)balls.size();
-            raw.write(reinterpret_cast<const char*>(&size), sizeof(size));
-            for (const auto& ball: balls) {
-                const uint8_t type = ball.state.type;
-                raw.write(reinterpret_cast<const char*>(&type), sizeof(type));
-                raw.write(reinterpret_cast<const char*>(&ball.state.position), sizeof(ball.state.position));
-
-                // Compress rotation
-                int max_value_index = 0;
-                float max_value = std::abs(ball.state.rotation.v[0]);
-                for (int i = 1; i < ROTATION_LENGTH; ++i) {
-                    float f = std::abs(ball.state.rotation.v[i]);
-                    if (f > max_value) {
-                        max_value_index = i;
-                        max_value = f;
-                    }
+        // Smallest-three quaternion compression: the largest component is omitted
+        // (and made positive), the other three are stored in 9 bits each.
+        static compressed_bitfield compress_rotation(const quaternion& rotation) {
+            int max_value_index = 0;
+            float max_value = std::abs(rotation.v[0]);
+            for (int i = 1; i < ROTATION_LENGTH; ++i) {
+                float f = std::abs(rotation.v[i]);
+                if (f > max_value) {
+                    max_value_index = i;
+                    max_value = f;
                 }
-                assert(max_value_index >= 0 && max_value_index < ROTATION_LENGTH);
-                const bool sign_inverted = (ball.state.rotation.v[max_value_index] < 0);
+            }
+            assert(max_value_index >= 0 && max_value_index < ROTATION_LENGTH);
+            const bool sign_inverted = (rotation.v[max_value_index] < 0);
 
-                compressed_bitfield bits;
-                static_assert(sizeof(bits) == 4);
+            compressed_bitfield bits{}; // zeroes the 2 unused bits as well
+            static_assert(sizeof(bits) == 4);
 
-                bits.flag = static_cast<std::underlying_type_t<compressed_flag::flag_t>>(max_value_index << 1);
+            bits.flag = static_cast<std::underlying_type_t<compressed_flag::flag_t>>(max_value_index << 1);
 
-                // TODO: Implement ball trafo compression
-                // flag |= compressed_flag::BallSwitched; // Short circuit for now 
+            // TODO: Implement ball trafo compression
+            // flag |= compressed_flag::BallSwitched; // Short circuit for now 
 
-                int compressed_rotation[ROTATION_LENGTH - 1], i = 0;
-                for (auto& v: compressed_rotation) {
-                    if (i == max_value_index) ++i;
-                    v = int(((sign_inverted) ? -1 : 1) * std::round(ball.state.rotation.v[i] / ROTATION_STEP));
-                    ++i;
-                }
-                bits.rotation0 = compressed_rotation[0];
-                bits.rotation1 = compressed_rotation[1];
-                bits.rotation2 = compressed_rotation[2];
+            int compressed_rotation[ROTATION_LENGTH - 1], i = 0;
+            for (auto& v: compressed_rotation) {
+                if (i == max_value_index) ++i;
+                v = int(((sign_inverted) ? -1 : 1) * std::round(rotation.v[i] / ROTATION_STEP));
+                ++i;
+            }
+            bits.rotation0 = compressed_rotation[0];
+            bits.rotation1 = compressed_rotation[1];
+            bits.rotation2 = compressed_rotation[2];
+            return bits;
+        }
 
-                raw.write(reinterpret_cast<const char*>(&bits), sizeof(bits));
+        static quaternion decompress_rotation(const compressed_bitfield& bits) {
+            quaternion rotation;
+            int max_value_index = (bits.flag >> 1) & 0b11;
+            float max_value_squared = 1;
+
+            int compressed_rotation[] = {bits.rotation0, bits.rotation1, bits.rotation2}, i = 0;
+            for (const int v: compressed_rotation) {
+                if (i == max_value_index) ++i;
+                rotation.v[i] = v * ROTATION_STEP;
+                max_value_squared -= rotation.v[i] * rotation.v[i];
+                ++i;
+            }
+            rotation.v[max_value_index] = std::sqrt(max_value_squared);
+            return rotation;
+        }
 
-                // Compress timestamp
-                const auto timestamp = int64_t(ball.state.timestamp);
-                raw.write(reinterpret_cast<const char*>(&timestamp), TIMESTAMP_SIZE);
+        bool serialize() override {
+            serializable_message::serialize();
 
-                raw.write(reinterpret_cast<const char*>(&ball.player_id), sizeof(ball.player_id));
+            auto size = (uint16_t)balls.size();
+            raw.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            char* out = raw.extend(size * BALL_SIZE);
+            uint32_t rotations[ROTATION_BATCH_SIZE];
+            for (size_t first = 0; first < size; first += ROTATION_BATCH_SIZE) {
+                const size_t count = std::min<size_t>(ROTATION_BATCH_SIZE, size - first);
+                ball_state_codec::compress_rotations(&balls[first].state.rotation, sizeof(owned_timed_ball_state),
+                                                     count, rotations);
+                for (size_t i = 0; i < count; ++i) {
+                    const auto& ball = balls[first + i];
+                    const uint8_t type = ball.state.type;
+                    out = put(out, &type, sizeof(type));
+                    out = put(out, &ball.state.position, sizeof(ball.state.position));
+                    out = put(out, &rotations[i], sizeof(rotations[i]));
+                    // Compress timestamp
+                    const auto timestamp = int64_t(ball.state.timestamp);
+                    out = put(out, &timestamp, TIMESTAMP_SIZE);
+                    out = put(out, &ball.player_id, sizeof(ball.player_id));
+                }
             }
 
             size = (uint16_t)unchanged_balls.size();
             if (size == 0)
                 return raw.good();
             raw.write(reinterpret_cast<const char*>(&size), sizeof(size));
-            for (const auto& ball: unchanged_balls) {
-                const auto timestamp = int64_t(ball.timestamp);
-                raw.write(reinterpret_cast<const char*>(&timestamp), TIMESTAMP_SIZE);
-                raw.write(reinterpret_cast<const char*>(&ball.player_id), sizeof(ball.player_id));
+            out = raw.extend(size * UNCHANGED_BALL_SIZE);
+            for (size_t i = 0; i < size; ++i) {
+                const auto timestamp = int64_t(unchanged_balls[i].timestamp);
+                out = put(out, &timestamp, TIMESTAMP_SIZE);
+                out = put(out, &unchanged_balls[i].player_id, sizeof(unchanged_balls[i].player_id));
             }
 
             return raw.good();
@@ -111,63 +144,70 @@ namespace bmmo {
             raw.read(reinterpret_cast<char*>(&size), sizeof(size));
             if (!raw.good() || raw.gcount() != sizeof(size))
                 return false;
+            const char* in = take(size * BALL_SIZE);
+            if (!in)
+                return false;
             balls.resize(size);
 
-            for (auto& ball: balls) {
-                raw.read(reinterpret_cast<char*>(&ball.state.type), sizeof(uint8_t));
-                if (!raw.good() || raw.gcount() != sizeof(uint8_t))
-                    return false;
-
-                raw.read(reinterpret_cast<char*>(&ball.state.position), sizeof(ball.state.position));
-                if (!raw.good() || raw.gcount() != sizeof(ball.state.position))
-                    return false;
-                
-                compressed_bitfield bits;
-                raw.read(reinterpret_cast<char*>(&bits), sizeof(bits));
-                if (!raw.good() || raw.gcount() != sizeof(bits))
-                    return false;
-                int max_value_index = (bits.flag >> 1) & 0b11;
-                float max_value_squared = 1;
-
-                int compressed_rotation[] = {bits.rotation0, bits.rotation1, bits.rotation2}, i = 0;
-                for (const int v: compressed_rotation) {
-                    if (i == max_value_index) ++i;
-                    ball.state.rotation.v[i] = v * ROTATION_STEP;
-                    max_value_squared -= ball.state.rotation.v[i] * ball.state.rotation.v[i];
-                    ++i;
+            uint32_t rotations[ROTATION_BATCH_SIZE];
+            for (size_t first = 0; first < size; first += ROTATION_BATCH_SIZE) {
+                const size_t count = std::min<size_t>(ROTATION_BATCH_SIZE, size - first);
+                for (size_t i = 0; i < count; ++i) {
+                    auto& ball = balls[first + i];
+                    uint8_t type;
+                    in = get(in, &type, sizeof(type));
+                    ball.state.type = type;
+                    in = get(in, &ball.state.position, sizeof(ball.state.position));
+                    in = get(in, &rotations[i], sizeof(rotations[i]));
+                    int64_t timestamp{};
+                    in = get(in, &timestamp, TIMESTAMP_SIZE);
+                    ball.state.timestamp = timestamp;
+                    in = get(in, &ball.player_id, sizeof(ball.player_id));
                 }
-                ball.state.rotation.v[max_value_index] = std::sqrt(max_value_squared);
-
-                int64_t timestamp{};
-                raw.read(reinterpret_cast<char*>(&timestamp), TIMESTAMP_SIZE);
-                if (!raw.good() || raw.gcount() != TIMESTAMP_SIZE)
-                    return false;
-                ball.state.timestamp = timestamp;
-                raw.read(reinterpret_cast<char*>(&ball.player_id), sizeof(ball.player_id));
-                if (!raw.good() || raw.gcount() != sizeof(ball.player_id))
-                    return false;
+                ball_state_codec::decompress_rotations(rotations, count, &balls[first].state.rotation,
+                                                       sizeof(owned_timed_ball_state));
             }
 
-            if (raw.peek() == std::stringstream::traits_type::eof())
+            if (raw.peek() == byte_stream::traits_type::eof())
                 return raw.good();
             raw.read(reinterpret_cast<char*>(&size), sizeof(size));
             if (!raw.good() || raw.gcount() != sizeof(size))
                 return false;
+            in = take(size * UNCHANGED_BALL_SIZE);
+            if (!in)
+                return false;
             unchanged_balls.resize(size);
 
             for (auto& ball: unchanged_balls) {
                 int64_t timestamp{};
-                raw.read(reinterpret_cast<char*>(&timestamp), TIMESTAMP_SIZE);
-                if (!raw.good() || raw.gcount() != TIMESTAMP_SIZE)
-                    return false;
+                in = get(in, &timestamp, TIMESTAMP_SIZE);
                 ball.timestamp = timestamp;
-                raw.read(reinterpret_cast<char*>(&ball.player_id), sizeof(ball.player_id));
-                if (!raw.good() || raw.gcount() != sizeof(ball.player_id))
-                    return false;
+                in = get(in, &ball.player_id, sizeof(ball.player_id));
             }
 
             return raw.good();
         }
+
+    private:
+        static char* put(char* out, const void* value, size_t size) {
+            std::memcpy(out, value, size);
+            return out + size;
+        }
+
+        static const char* get(const char* in, void* value, size_t size) {
+            std::memcpy(value, in, size);
+            return in + size;
+        }
+
+        // Skips over the next `size` bytes, which are then read directly from the buffer.
+        // @returns `nullptr` if the message is shorter than that.
+        const char* take(size_t size) {
+            if (!raw.good() || raw.remaining() < size)
+                return nullptr;
+            const char* in = raw.data() + raw.tellg();
+            raw.ignore(size);
+            return in;
+        }
     };
 }
 
@@ -0,0 +1,289 @@
+#ifndef BALLANCEMMOSERVER_OWNED_DELTA_BALL_STATE_MSG_HPP
+#define BALLANCEMMOSERVER_OWNED_DELTA_BALL_STATE_MSG_HPP
+#include "message.hpp"
+#include "message_utils.hpp"
+#include "owned_compressed_ball_state_msg.hpp"
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace bmmo {
+    // A ball state reduced to exactly what goes over the wire, so that both sides
+    // compute deltas against identical values.
+    struct quantized_ball_state {
+        uint8_t type = 0;
+        int32_t position[3]{};
+        uint32_t rotation = 0; // bits of owned_compressed_ball_state_msg::compressed_bitfield
+        int64_t timestamp = 0;
+
+        static constexpr float POSITION_STEP = 1.0f / 1024;
+
+        bool operator==(const quantized_ball_state&) const = default;
+
+        static quantized_ball_state from(const timed_ball_state& state) {
+            quantized_ball_state q;
+            q.type = static_cast<uint8_t>(state.type);
+            for (int i = 0; i < 3; ++i) {
+                const double v = std::isnan(state.position.v[i]) ? 0.0 : state.position.v[i] / POSITION_STEP;
+                q.position[i] = static_cast<int32_t>(std::clamp(std::round(v), (double) INT32_MIN, (double) INT32_MAX));
+            }
+            const auto bits = owned_compressed_ball_state_msg::compress_rotation(state.rotation);
+            std::memcpy(&q.rotation, &bits, sizeof(q.rotation));
+            q.timestamp = int64_t(state.timestamp);
+            return q;
+        }
+
+        timed_ball_state to_ball_state() const {
+            timed_ball_state state{};
+            state.type = type;
+            for (int i = 0; i < 3; ++i)
+                state.position.v[i] = position[i] * POSITION_STEP;
+            owned_compressed_ball_state_msg::compressed_bitfield bits;
+            std::memcpy(&bits, &rotation, sizeof(bits));
+            state.rotation = owned_compressed_ball_state_msg::decompress_rotation(bits);
+            state.timestamp = timestamp;
+            return state;
+        }
+    };
+
+    struct snapshot_ball {
+        HSteamNetConnection player_id = k_HSteamNetConnection_Invalid;
+        quantized_ball_state state;
+    };
+
+    // All balls a client is supposed to know about at some point, sorted by player id.
+    typedef std::vector<snapshot_ball> ball_snapshot;
+
+    // The most recent snapshots by sequence number, for use as delta baselines.
+    class ball_snapshot_history {
+        static constexpr int SIZE = 32;
+        struct entry {
+            bool valid = false;
+            uint16_t sequence = 0;
+            ball_snapshot snapshot;
+        };
+        std::array<entry, SIZE> entries_;
+
+    public:
+        ball_snapshot& store(uint16_t sequence) {
+            auto& e = entries_[sequence % SIZE];
+            e.valid = true;
+            e.sequence = sequence;
+            return e.snapshot;
+        }
+
+        const ball_snapshot* find(uint16_t sequence) const {
+            const auto& e = entries_[sequence % SIZE];
+            return (e.valid && e.sequence == sequence) ? &e.snapshot : nullptr;
+        }
+
+        void clear() {
+            for (auto& e: entries_)
+                e.valid = false;
+        }
+    };
+
+    // Ball states as changes against a snapshot the recipient has acknowledged
+    // (see BallStateAck), or against nothing if there is no usable baseline.
+    // Only sent to clients which announced capability::DeltaBallState.
+    struct owned_delta_ball_state_msg: public serializable_message {
+        uint16_t sequence = 0;
+        bool has_baseline = false;
+        uint16_t baseline_sequence = 0;
+        size_t change_count = 0; // set by serialize; not transmitted
+
+        owned_delta_ball_state_msg(): serializable_message(OwnedDeltaBallState) {}
+
+        enum field_mask: uint8_t {
+            Type = 1 << 0,
+            PositionX = 1 << 1,
+            PositionY = 1 << 2,
+            PositionZ = 1 << 3,
+            RotationDelta = 1 << 4, // same omitted component, smaller numbers
+            RotationFull = 1 << 5,
+            Timestamp = 1 << 6,
+        };
+
+        // Writes how `current` differs from `baseline` (or from nothing if `nullptr`).
+        // Entries for balls in the baseline refer to them by index instead of player id.
+        bool serialize(const ball_snapshot* baseline, const ball_snapshot& current) {
+            serializable_message::serialize();
+            has_baseline = (baseline != nullptr);
+            raw.write(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+            const uint8_t baseline_flag = has_baseline;
+            raw.write(reinterpret_cast<const char*>(&baseline_flag), sizeof(baseline_flag));
+            if (has_baseline)
+                raw.write(reinterpret_cast<const char*>(&baseline_sequence), sizeof(baseline_sequence));
+
+            static const ball_snapshot empty_snapshot;
+            const auto& base = baseline ? *baseline : empty_snapshot;
+            std::vector<uint32_t> removed;
+            std::vector<std::pair<int64_t, const snapshot_ball*>> changed; // <baseline index or -1, ball>
+            size_t i = 0, j = 0;
+            while (i < base.size() || j < current.size()) {
+                if (j == current.size() || (i < base.size() && base[i].player_id < current[j].player_id)) {
+                    removed.push_back(uint32_t(i++));
+                } else if (i == base.size() || current[j].player_id < base[i].player_id) {
+                    changed.emplace_back(-1, &current[j++]);
+                } else {
+                    if (!(base[i].state == current[j].state))
+                        changed.emplace_back(int64_t(i), &current[j]);
+                    ++i, ++j;
+                }
+            }
+            change_count = removed.size() + changed.size();
+
+            message_utils::write_varint(removed.size(), raw);
+            for (auto index: removed)
+                message_utils::write_varint(index, raw);
+            message_utils::write_varint(changed.size(), raw);
+            for (const auto& [index, ball]: changed) {
+                if (index < 0) {
+                    message_utils::write_varint(1, raw);
+                    raw.write(reinterpret_cast<const char*>(&ball->player_id), sizeof(ball->player_id));
+                    write_entry({}, ball->state);
+                } else {
+                    message_utils::write_varint(uint64_t(index) << 1, raw);
+                    write_entry(base[index].state, ball->state);
+                }
+            }
+            return raw.good();
+        }
+
+        // Only reads the header; pass the snapshot named by `baseline_sequence` to `decode` afterwards.
+        bool deserialize() override {
+            if (!serializable_message::deserialize())
+                return false;
+            uint8_t baseline_flag = 0;
+            if (!message_utils::read_variable(raw, &sequence) || !message_utils::read_variable(raw, &baseline_flag))
+                return false;
+            has_baseline = baseline_flag;
+            if (has_baseline && !message_utils::read_variable(raw, &baseline_sequence))
+                return false;
+            return true;
+        }
+
+        bool decode(const ball_snapshot* baseline, ball_snapshot& current) {
+            if (has_baseline != (baseline != nullptr))
+                return false;
+            current = baseline ? *baseline : ball_snapshot{};
+            std::vector<bool> removed(current.size());
+            uint64_t count, value;
+            if (!message_utils::read_varint(raw, count) || count > current.size())
+                return false;
+            for (uint64_t k = 0; k < count; ++k) {
+                if (!message_utils::read_varint(raw, value) || value >= current.size())
+                    return false;
+                removed[value] = true;
+            }
+            if (!message_utils::read_varint(raw, count))
+                return false;
+            ball_snapshot added;
+            for (uint64_t k = 0; k < count; ++k) {
+                if (!message_utils::read_varint(raw, value))
+                    return false;
+                if (value == 1) {
+                    auto& ball = added.emplace_back();
+                    if (!message_utils::read_variable(raw, &ball.player_id) || !read_entry(ball.state))
+                        return false;
+                } else {
+                    value >>= 1;
+                    if (value >= current.size() || !read_entry(current[value].state))
+                        return false;
+                }
+            }
+
+            size_t index = 0;
+            std::erase_if(current, [&](const auto&) { return removed[index++]; });
+            current.insert(current.end(), added.begin(), added.end());
+            std::ranges::sort(current, {}, &snapshot_ball::player_id);
+            return true;
+        }
+
+    private:
+        void write_delta(int64_t delta) {
+            message_utils::write_varint(message_utils::zigzag_encode(delta), raw);
+        }
+
+        bool read_delta(int64_t& delta) {
+            uint64_t value;
+            if (!message_utils::read_varint(raw, value))
+                return false;
+            delta = message_utils::zigzag_decode(value);
+            return true;
+        }
+
+        static owned_compressed_ball_state_msg::compressed_bitfield unpack_rotation(uint32_t rotation) {
+            owned_compressed_ball_state_msg::compressed_bitfield bits;
+            std::memcpy(&bits, &rotation, sizeof(bits));
+            return bits;
+        }
+
+        void write_entry(const quantized_ball_state& base, const quantized_ball_state& state) {
+            const auto base_rotation = unpack_rotation(base.rotation), rotation = unpack_rotation(state.rotation);
+            uint8_t mask = 0;
+            if (state.type != base.type) mask |= Type;
+            if (state.position[0] != base.position[0]) mask |= PositionX;
+            if (state.position[1] != base.position[1]) mask |= PositionY;
+            if (state.position[2] != base.position[2]) mask |= PositionZ;
+            if (state.rotation != base.rotation)
+                mask |= (rotation.flag == base_rotation.flag) ? RotationDelta : RotationFull;
+            if (state.timestamp != base.timestamp) mask |= Timestamp;
+            raw.write(reinterpret_cast<const char*>(&mask), sizeof(mask));
+
+            if (mask & Type)
+                raw.write(reinterpret_cast<const char*>(&state.type), sizeof(state.type));
+            for (int i = 0; i < 3; ++i) {
+                if (mask & (PositionX << i))
+                    write_delta(int64_t(state.position[i]) - base.position[i]);
+            }
+            if (mask & RotationDelta) {
+                write_delta(rotation.rotation0 - base_rotation.rotation0);
+                write_delta(rotation.rotation1 - base_rotation.rotation1);
+                write_delta(rotation.rotation2 - base_rotation.rotation2);
+            } else if (mask & RotationFull) {
+                raw.write(reinterpret_cast<const char*>(&state.rotation), sizeof(state.rotation));
+            }
+            if (mask & Timestamp)
+                write_delta(state.timestamp - base.timestamp);
+        }
+
+        bool read_entry(quantized_ball_state& state) {
+            uint8_t mask;
+            if (!message_utils::read_variable(raw, &mask))
+                return false;
+            int64_t delta;
+            if ((mask & Type) && !message_utils::read_variable(raw, &state.type))
+                return false;
+            for (int i = 0; i < 3; ++i) {
+                if (!(mask & (PositionX << i)))
+                    continue;
+                if (!read_delta(delta))
+                    return false;
+                state.position[i] = int32_t(state.position[i] + delta);
+            }
+            if (mask & RotationDelta) {
+                auto bits = unpack_rotation(state.rotation);
+                int64_t d0, d1, d2;
+                if (!read_delta(d0) || !read_delta(d1) || !read_delta(d2))
+                    return false;
+                bits.rotation0 = int(bits.rotation0 + d0);
+                bits.rotation1 = int(bits.rotation1 + d1);
+                bits.rotation2 = int(bits.rotation2 + d2);
+                std::memcpy(&state.rotation, &bits, sizeof(state.rotation));
+            } else if ((mask & RotationFull) && !message_utils::read_variable(raw, &state.rotation)) {
+                return false;
+            }
+            if (mask & Timestamp) {
+                if (!read_delta(delta))
+                    return false;
+                state.timestamp += delta;
+            }
+            return true;
+        }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_OWNED_DELTA_BALL_STATE_MSG_HPP
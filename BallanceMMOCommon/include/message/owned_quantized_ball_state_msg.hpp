@@ -0,0 +1,223 @@
+#ifndef BALLANCEMMOSERVER_OWNED_QUANTIZED_BALL_STATE_MSG_HPP
+#define BALLANCEMMOSERVER_OWNED_QUANTIZED_BALL_STATE_MSG_HPP
+#include "message.hpp"
+#include "message_utils.hpp"
+#include "owned_compressed_ball_state_msg.hpp"
+#include "../utility/ball_state_codec.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace bmmo {
+    // The same as OwnedCompressedBallState, in about half the size: positions are
+    // fixed-point offsets from an origin sent once per message, and timestamps and
+    // player ids are varints relative to a base time and the previous ball.
+    // Only sent to clients which announced capability::QuantizedBallState.
+    //
+    // varint ball count, varint unchanged ball count
+    // [if any] base (lowest) timestamp in 6 bytes
+    // [if any balls] uint8 step shift, uint8 bits of x/y/z, zigzag varint origin x/y/z in steps
+    // per ball: uint8 type, x/y/z offsets packed LSB first into whole bytes,
+    //           uint32 rotation (as in OwnedCompressedBallState),
+    //           varint timestamp - base, zigzag varint player id - previous one
+    // per unchanged ball: varint timestamp - base, zigzag varint player id - previous one
+    struct owned_quantized_ball_state_msg: public serializable_message {
+        std::vector<owned_timed_ball_state> balls;
+        std::vector<owned_timestamp> unchanged_balls;
+        // The most bits used per position axis. Positions are a millimetre apart (see
+        // BASE_POSITION_STEP) unless the balls are too far apart for that, in which case
+        // the step is doubled until the spread fits.
+        int position_bits = DEFAULT_POSITION_BITS;
+
+        static constexpr int MIN_POSITION_BITS = 8, MAX_POSITION_BITS = 21, DEFAULT_POSITION_BITS = 20;
+        static constexpr int BASE_POSITION_SHIFT = 10; // steps of 2^-10
+        static constexpr int MAX_STEP_SHIFT = 24;
+        static constexpr int TIMESTAMP_SIZE = owned_compressed_ball_state_msg::TIMESTAMP_SIZE;
+
+        owned_quantized_ball_state_msg(): serializable_message(OwnedQuantizedBallState) {}
+
+        // @returns `false` if a position can't be represented (e.g. balls hidden at infinity);
+        // send an OwnedCompressedBallState instead then.
+        bool serialize() override {
+            serializable_message::serialize();
+            message_utils::write_varint(balls.size(), raw);
+            message_utils::write_varint(unchanged_balls.size(), raw);
+            if (balls.empty() && unchanged_balls.empty())
+                return raw.good();
+
+            int64_t base_time = INT64_MAX;
+            for (const auto& ball: balls)
+                base_time = std::min(base_time, int64_t(ball.state.timestamp));
+            for (const auto& ball: unchanged_balls)
+                base_time = std::min(base_time, int64_t(ball.timestamp));
+            raw.write(reinterpret_cast<const char*>(&base_time), TIMESTAMP_SIZE);
+
+            uint32_t previous_id = 0;
+            const auto write_ids = [&](int64_t timestamp, uint32_t player_id) {
+                message_utils::write_varint(uint64_t(timestamp - base_time), raw);
+                message_utils::write_varint(message_utils::zigzag_encode(int64_t(player_id) - previous_id), raw);
+                previous_id = player_id;
+            };
+
+            if (!balls.empty()) {
+                grid g;
+                if (!fit_grid(g))
+                    return false;
+                const uint8_t header[] = {uint8_t(g.shift), uint8_t(g.bits[0]), uint8_t(g.bits[1]), uint8_t(g.bits[2])};
+                raw.write(reinterpret_cast<const char*>(header), sizeof(header));
+                for (int i = 0; i < 3; ++i)
+                    message_utils::write_varint(message_utils::zigzag_encode(g.origin[i]), raw);
+                const int packed_size = (g.bits[0] + g.bits[1] + g.bits[2] + 7) / 8;
+
+                uint32_t rotations[owned_compressed_ball_state_msg::ROTATION_BATCH_SIZE];
+                for (size_t first = 0; first < balls.size(); first += std::size(rotations)) {
+                    const size_t count = std::min(std::size(rotations), balls.size() - first);
+                    ball_state_codec::compress_rotations(&balls[first].state.rotation, sizeof(owned_timed_ball_state),
+                                                         count, rotations);
+                    for (size_t i = 0; i < count; ++i) {
+                        const auto& ball = balls[first + i];
+                        const uint8_t type = ball.state.type;
+                        raw.write(reinterpret_cast<const char*>(&type), sizeof(type));
+                        uint64_t packed = 0;
+                        for (int axis = 0, offset = 0; axis < 3; offset += g.bits[axis++])
+                            packed |= uint64_t(g.quantize(ball.state.position.v[axis]) - g.origin[axis]) << offset;
+                        raw.write(reinterpret_cast<const char*>(&packed), packed_size);
+                        raw.write(reinterpret_cast<const char*>(&rotations[i]), sizeof(rotations[i]));
+                        write_ids(int64_t(ball.state.timestamp), ball.player_id);
+                    }
+                }
+            }
+
+            for (const auto& ball: unchanged_balls)
+                write_ids(int64_t(ball.timestamp), ball.player_id);
+            return raw.good();
+        }
+
+        bool deserialize() override {
+            if (!serializable_message::deserialize())
+                return false;
+            uint64_t ball_count, unchanged_count;
+            if (!message_utils::read_varint(raw, ball_count) || !message_utils::read_varint(raw, unchanged_count))
+                return false;
+            // every entry takes at least 2 bytes, which keeps garbage counts from allocating much
+            if (ball_count > raw.remaining() || unchanged_count > raw.remaining())
+                return false;
+            balls.resize(ball_count);
+            unchanged_balls.resize(unchanged_count);
+            if (ball_count == 0 && unchanged_count == 0)
+                return true;
+
+            int64_t base_time{};
+            raw.read(reinterpret_cast<char*>(&base_time), TIMESTAMP_SIZE);
+            if (!raw.good() || raw.gcount() != TIMESTAMP_SIZE)
+                return false;
+
+            uint32_t previous_id = 0;
+            const auto read_ids = [&](int64_t& timestamp, uint32_t& player_id) {
+                uint64_t time_offset, id_delta;
+                if (!message_utils::read_varint(raw, time_offset) || !message_utils::read_varint(raw, id_delta))
+                    return false;
+                timestamp = base_time + int64_t(time_offset);
+                player_id = previous_id = uint32_t(previous_id + message_utils::zigzag_decode(id_delta));
+                return true;
+            };
+
+            if (ball_count > 0) {
+                grid g;
+                uint8_t header[4];
+                raw.read(reinterpret_cast<char*>(header), sizeof(header));
+                if (!raw.good() || raw.gcount() != sizeof(header) || header[0] > MAX_STEP_SHIFT)
+                    return false;
+                g.shift = header[0];
+                for (int i = 0; i < 3; ++i) {
+                    g.bits[i] = header[i + 1];
+                    uint64_t origin;
+                    if (g.bits[i] > MAX_POSITION_BITS || !message_utils::read_varint(raw, origin))
+                        return false;
+                    g.origin[i] = message_utils::zigzag_decode(origin);
+                }
+                const int packed_size = (g.bits[0] + g.bits[1] + g.bits[2] + 7) / 8;
+
+                uint32_t rotations[owned_compressed_ball_state_msg::ROTATION_BATCH_SIZE];
+                for (size_t first = 0; first < balls.size(); first += std::size(rotations)) {
+                    const size_t count = std::min(std::size(rotations), balls.size() - first);
+                    for (size_t i = 0; i < count; ++i) {
+                        auto& ball = balls[first + i];
+                        uint8_t type;
+                        uint64_t packed = 0;
+                        raw.read(reinterpret_cast<char*>(&type), sizeof(type));
+                        raw.read(reinterpret_cast<char*>(&packed), packed_size);
+                        raw.read(reinterpret_cast<char*>(&rotations[i]), sizeof(rotations[i]));
+                        int64_t timestamp;
+                        if (!raw.good() || !read_ids(timestamp, ball.player_id))
+                            return false;
+                        ball.state.type = type;
+                        for (int axis = 0; axis < 3; ++axis) {
+                            ball.state.position.v[axis] = g.position(g.origin[axis] + int64_t(packed & ((uint64_t(1) << g.bits[axis]) - 1)));
+                            packed >>= g.bits[axis];
+                        }
+                        ball.state.timestamp = timestamp;
+                    }
+                    ball_state_codec::decompress_rotations(rotations, count, &balls[first].state.rotation,
+                                                           sizeof(owned_timed_ball_state));
+                }
+            }
+
+            for (auto& ball: unchanged_balls) {
+                int64_t timestamp;
+                if (!read_ids(timestamp, ball.player_id))
+                    return false;
+                ball.timestamp = timestamp;
+            }
+            return true;
+        }
+
+    private:
+        // Positions are integers in steps of 2^(shift - BASE_POSITION_SHIFT).
+        struct grid {
+            int shift = 0;
+            int bits[3]{};
+            int64_t origin[3]{};
+
+            int64_t quantize(float v) const {
+                return int64_t(std::round(std::ldexp(double(v), BASE_POSITION_SHIFT - shift)));
+            }
+
+            float position(int64_t q) const {
+                return float(std::ldexp(double(q), shift - BASE_POSITION_SHIFT));
+            }
+        };
+
+        // Picks the finest step for which the spread of every axis fits into `position_bits`.
+        bool fit_grid(grid& g) const {
+            float low[3], high[3];
+            for (int i = 0; i < 3; ++i)
+                low[i] = high[i] = balls.front().state.position.v[i];
+            for (const auto& ball: balls) {
+                for (int i = 0; i < 3; ++i) {
+                    const float v = ball.state.position.v[i];
+                    if (!std::isfinite(v) || std::abs(v) > 1e9f)
+                        return false;
+                    low[i] = std::min(low[i], v);
+                    high[i] = std::max(high[i], v);
+                }
+            }
+            const int budget = std::clamp(position_bits, MIN_POSITION_BITS, MAX_POSITION_BITS);
+            for (g.shift = 0; g.shift <= MAX_STEP_SHIFT; ++g.shift) {
+                bool fits = true;
+                for (int i = 0; i < 3 && fits; ++i) {
+                    g.origin[i] = g.quantize(low[i]);
+                    g.bits[i] = std::bit_width(uint64_t(g.quantize(high[i]) - g.origin[i]));
+                    fits = g.bits[i] <= budget;
+                }
+                if (fits)
+                    return true;
+            }
+            return false;
+        }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_OWNED_QUANTIZED_BALL_STATE_MSG_HPP
@@ -1,75 +1,60 @@
 #ifndef BALLANCEMMOSERVER_SCORE_LIST_MSG_HPP
 #define BALLANCEMMOSERVER_SCORE_LIST_MSG_HPP
 #include "message.hpp"
+#include "message_schema.hpp"
 #include "../entity/ranking_entry.hpp"
 
 namespace bmmo {
     // compressed score list
-    struct score_list_msg: public serializable_message {
-        score_list_msg(): serializable_message(bmmo::ScoreList) {}
-
+    struct score_list_msg: public schema_message<score_list_msg, ScoreList> {
         struct map map;
         level_mode mode = bmmo::level_mode::Speedrun;
         ranking_entry::player_rankings rankings;
 
-        bool serialize() override {
-            return serialize(rankings);
-        }
-
-        bool serialize(const ranking_entry::player_rankings& rankings) {
-            if (!serializable_message::serialize()) return false;
-
-            message_utils::write_variable(&map, raw);
-            message_utils::write_variable(&mode, raw);
+        using finish_layout = schema::record<
+            schema::field<&ranking_entry::finish_entry::cheated>,
+            schema::field<&ranking_entry::finish_entry::name, schema::string<uint8_t>>,
+            schema::field<&ranking_entry::finish_entry::mode>,
+            schema::field<&ranking_entry::finish_entry::sr_ranking>,
+            schema::field<&ranking_entry::finish_entry::sr_time>,
+            schema::field<&ranking_entry::finish_entry::formatted_hs_score, schema::string<uint8_t>>>;
 
-            auto size = static_cast<uint16_t>(rankings.first.size());
-            message_utils::write_variable(&size, raw);
-            for (const auto& entry: rankings.first) {
-                message_utils::write_variable(&entry.cheated, raw);
-                message_utils::write_string<uint8_t>(entry.name, raw);
-                message_utils::write_variable(&entry.mode, raw);
-                message_utils::write_variable(&entry.sr_ranking, raw);
-                message_utils::write_variable(&entry.sr_time, raw);
-                message_utils::write_string<uint8_t>(entry.formatted_hs_score, raw);
-            }
-            size = static_cast<uint16_t>(rankings.second.size());
-            message_utils::write_variable(&size, raw);
-            for (const auto& entry: rankings.second) {
-                message_utils::write_variable(&entry.cheated, raw);
-                message_utils::write_string<uint8_t>(entry.name, raw);
-                message_utils::write_variable(&entry.dnf_sector, raw);
-            }
+        using dnf_layout = schema::record<
+            schema::field<&ranking_entry::dnf_entry::cheated>,
+            schema::field<&ranking_entry::dnf_entry::name, schema::string<uint8_t>>,
+            schema::field<&ranking_entry::dnf_entry::dnf_sector>>;
 
-            return raw.good();
-        }
+        using rankings_layout = schema::record<
+            schema::field<&ranking_entry::player_rankings::first, schema::sequence<uint16_t, finish_layout>>,
+            schema::field<&ranking_entry::player_rankings::second, schema::sequence<uint16_t, dnf_layout>>>;
 
-        bool deserialize() override {
-            if (!serializable_message::deserialize()) return false;
+        using layout = schema::record<
+            schema::field<&score_list_msg::map>,
+            schema::field<&score_list_msg::mode>,
+            schema::field<&score_list_msg::rankings, rankings_layout>>;
 
-            if (!message_utils::read_variable(raw, &map)) return false;
-            if (!message_utils::read_variable(raw, &mode)) return false;
+        using schema_message::serialize;
 
-            auto size = message_utils::read_variable<uint16_t>(raw);
-            rankings.first.resize(size);
-            for (auto& entry: rankings.first) {
-                if (!message_utils::read_variable(raw, &entry.cheated)) return false;
-                if (!message_utils::read_string<uint8_t>(raw, entry.name)) return false;
-                if (!message_utils::read_variable(raw, &entry.mode)) return false;
-                if (!message_utils::read_variable(raw, &entry.sr_ranking)) return false;
-                if (!message_utils::read_variable(raw, &entry.sr_time)) return false;
-                if (!message_utils::read_string<uint8_t>(raw, entry.formatted_hs_score)) return false;
-            }
-            size = message_utils::read_variable<uint16_t>(raw);
-            rankings.second.resize(size);
-            for (auto& entry: rankings.second) {
-                if (!message_utils::read_variable(raw, &entry.cheated)) return false;
-                if (!message_utils::read_string<uint8_t>(raw, entry.name)) return false;
-                if (!message_utils::read_variable(raw, &entry.dnf_sector)) return false;
-            }
+        // Serializes `rankings` in place of the member, to spare copying them in.
+        bool serialize(const ranking_entry::player_rankings& rankings) {
+            raw.reserve(raw.size() + sizeof(opcode) + sizeof(map) + sizeof(mode) + rankings_layout::size(rankings));
+            serializable_message::serialize();
+            schema::pod<decltype(map)>::write(map, raw);
+            schema::pod<decltype(mode)>::write(mode, raw);
+            rankings_layout::write(rankings, raw);
+            return true;
+        }
 
-            return raw.good();
+        // Same with the rankings already written by `rankings_layout`.
+        bool serialize(std::string_view serialized_rankings) {
+            raw.reserve(raw.size() + sizeof(opcode) + sizeof(map) + sizeof(mode) + serialized_rankings.size());
+            serializable_message::serialize();
+            schema::pod<decltype(map)>::write(map, raw);
+            schema::pod<decltype(mode)>::write(mode, raw);
+            raw.write(serialized_rankings.data(), serialized_rankings.size());
+            return true;
         }
     };
 }
 
-#endif //BALLANCEMMOSERVER_SCORE_LIST_MSG_HPP
\ No newline at end of file
+#endif //BALLANCEMMOSERVER_SCORE_LIST_MSG_HPP
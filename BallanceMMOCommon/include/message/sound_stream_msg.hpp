@@ -1,6 +1,5 @@
 #ifndef BALLANCEMMOSERVER_SOUND_STREAM_MSG_HPP
 #define BALLANCEMMOSERVER_SOUND_STREAM_MSG_HPP
-#include <sstream>
 #include <fstream>
 #include "message.hpp"
 #include "message_utils.hpp"
@@ -54,7 +53,8 @@ namespace bmmo {
                 return false;
 
             ifile.seekg(std::ios::beg);
-            raw << ifile.rdbuf();
+            if (!ifile.read(raw.extend(size), size))
+                return false;
 
             return raw.good();
         }
@@ -77,8 +77,9 @@ namespace bmmo {
             if (!save_to_pwd) path = "..\\ModLoader\\Cache\\" + path;
             if (save_sound_file) {
                 std::ofstream ofile(path, std::ios::binary);
-                ofile << raw.rdbuf();
+                ofile.write(raw.data() + raw.tellg(), raw.remaining());
             }
+            raw.ignore(raw.remaining());
 
             return raw.good();
         }
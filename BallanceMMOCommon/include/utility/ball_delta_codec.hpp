@@ -0,0 +1,105 @@
+#ifndef BALLANCEMMOSERVER_BALL_DELTA_CODEC_HPP
+#define BALLANCEMMOSERVER_BALL_DELTA_CODEC_HPP
+#include "../message/owned_delta_ball_state_msg.hpp"
+#include <atomic>
+#include <memory>
+
+namespace bmmo {
+    // `true` if sequence number `a` comes after `b`, allowing for wraparound.
+    constexpr inline bool sequence_newer(uint16_t a, uint16_t b) {
+        return int16_t(a - b) > 0;
+    }
+
+    // Server side of delta ball states for a single recipient.
+    // `encode` is only ever called from one tick thread, `acknowledge` from the server thread.
+    // When the recipient moves to a room ticked by another thread, it gets a `successor`
+    // instead, as the old thread may still be encoding with this one.
+    class ball_delta_encoder {
+        ball_snapshot_history history_;
+        std::atomic_uint16_t next_sequence_ = 0; // only written by the tick thread
+        std::atomic_int32_t acked_sequence_ = -1;
+
+        // more than the messages the old tick thread may still send once replaced
+        static constexpr uint16_t SUCCESSOR_SEQUENCE_GAP = 16;
+
+    public:
+        ball_delta_encoder() = default;
+        explicit ball_delta_encoder(uint16_t first_sequence): next_sequence_(first_sequence) {}
+
+        // A new encoder for the same recipient, starting with a keyframe whose sequence
+        // number is newer than anything this one has sent or will send.
+        std::shared_ptr<ball_delta_encoder> successor() const {
+            return std::make_shared<ball_delta_encoder>(
+                    uint16_t(next_sequence_.load(std::memory_order_relaxed) + SUCCESSOR_SEQUENCE_GAP));
+        }
+
+        void acknowledge(uint16_t sequence) {
+            int32_t acked = acked_sequence_.load(std::memory_order_relaxed);
+            do {
+                if (acked >= 0 && !sequence_newer(sequence, uint16_t(acked)))
+                    return;
+            } while (!acked_sequence_.compare_exchange_weak(acked, sequence, std::memory_order_relaxed));
+        }
+
+        // Serializes `current` against the latest acknowledged snapshot, falling back
+        // to a keyframe if that one is too old or there is none yet.
+        // @returns `false` if there is nothing the recipient doesn't already have.
+        bool encode(const ball_snapshot& current, owned_delta_ball_state_msg& msg) {
+            const int32_t acked = acked_sequence_.load(std::memory_order_relaxed);
+            const ball_snapshot* baseline = (acked >= 0) ? history_.find(uint16_t(acked)) : nullptr;
+            const uint16_t sequence = next_sequence_.load(std::memory_order_relaxed);
+            msg.sequence = sequence;
+            msg.baseline_sequence = uint16_t(acked);
+            msg.serialize(baseline, current);
+            if (msg.change_count == 0 && (baseline || current.empty()))
+                return false;
+            history_.store(sequence) = current;
+            next_sequence_.store(sequence + 1, std::memory_order_relaxed);
+            return true;
+        }
+    };
+
+    // Client side of delta ball states.
+    class ball_delta_decoder {
+        ball_snapshot_history history_;
+        ball_snapshot latest_;
+        uint16_t latest_sequence_ = 0;
+        bool has_latest_ = false;
+
+    public:
+        // Decodes a message whose header has already been deserialized. Balls which differ
+        // from the newest snapshot so far are appended to `changed`; out-of-order messages
+        // are still stored (the server may pick them as baselines) but yield nothing.
+        // @returns `false` if the message is malformed or its baseline is unknown.
+        bool decode(owned_delta_ball_state_msg& msg, std::vector<owned_timed_ball_state>& changed) {
+            const ball_snapshot* baseline = msg.has_baseline ? history_.find(msg.baseline_sequence) : nullptr;
+            if (msg.has_baseline && !baseline)
+                return false;
+            ball_snapshot current;
+            if (!msg.decode(baseline, current))
+                return false;
+            if (!has_latest_ || sequence_newer(msg.sequence, latest_sequence_)) {
+                auto it = latest_.begin();
+                for (const auto& ball: current) {
+                    while (it != latest_.end() && it->player_id < ball.player_id) ++it;
+                    if (it != latest_.end() && it->player_id == ball.player_id && it->state == ball.state)
+                        continue;
+                    changed.push_back({ball.state.to_ball_state(), ball.player_id});
+                }
+                latest_ = current;
+                latest_sequence_ = msg.sequence;
+                has_latest_ = true;
+            }
+            history_.store(msg.sequence) = std::move(current);
+            return true;
+        }
+
+        void reset() {
+            history_.clear();
+            latest_.clear();
+            has_latest_ = false;
+        }
+    };
+}
+
+#endif //BALLANCEMMOSERVER_BALL_DELTA_CODEC_HPP
@@ -0,0 +1,40 @@
+#ifndef BALLANCEMMOSERVER_BALL_STATE_CODEC_HPP
+#define BALLANCEMMOSERVER_BALL_STATE_CODEC_HPP
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../entity/entity.hpp"
+
+// Batch versions of the smallest-three quaternion packing of
+// owned_compressed_ball_state_msg, which is what most of the time serializing
+// and deserializing ball states goes into. The kernels work on a few balls at
+// once (4 with SSE2, 8 with AVX2); which one is used is decided once at startup
+// from what the CPU supports, with a scalar one for everything else.
+// Every kernel produces exactly the bits of `compress_rotation` and the floats of
+// `decompress_rotation`, so the wire format doesn't depend on who serialized it.
+namespace bmmo::ball_state_codec {
+    enum class kernel {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    const char* get_kernel_name(kernel k);
+    kernel get_active_kernel();
+
+    // Rotations are read from / written to `stride` bytes apart, so that they can
+    // stay inside the ball states they belong to.
+    void compress_rotations(const quaternion* rotations, size_t stride, size_t count, uint32_t* bits);
+    void decompress_rotations(const uint32_t* bits, size_t count, quaternion* rotations, size_t stride);
+
+    struct benchmark_result {
+        kernel k = kernel::Scalar;
+        double compress_ns = 0, decompress_ns = 0; // per ball
+        bool identical = false; // to the scalar kernel
+    };
+
+    // Times every kernel the CPU supports on `ball_count` random rotations.
+    std::vector<benchmark_result> run_benchmark(size_t ball_count);
+}
+
+#endif //BALLANCEMMOSERVER_BALL_STATE_CODEC_HPP
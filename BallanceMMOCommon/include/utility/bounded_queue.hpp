@@ -0,0 +1,76 @@
+#ifndef BALLANCEMMOSERVER_BOUNDED_QUEUE_HPP
+#define BALLANCEMMOSERVER_BOUNDED_QUEUE_HPP
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace bmmo {
+// Fixed-capacity lock-free multi-producer single-consumer ring (Vyukov's bounded queue).
+// Elements live in the ring itself and are filled and read in place, so large records
+// are copied exactly once on each side. `try_push` may be called from any thread;
+// `try_pop` must only be called from one thread at a time.
+// `Capacity` must be a power of two.
+template <typename T, size_t Capacity>
+class bounded_queue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    struct slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<slot[]> slots_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) size_t dequeue_pos_ = 0;
+
+public:
+    bounded_queue(): slots_(new slot[Capacity]) {
+        for (size_t i = 0; i < Capacity; ++i)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+
+    // Calls `fill(T&)` on a free slot and publishes it.
+    // @returns false without calling `fill` if the queue is full.
+    template <typename Fill>
+    bool try_push(Fill&& fill) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        slot* s;
+        while (true) {
+            s = &slots_[pos & (Capacity - 1)];
+            const size_t seq = s->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        fill(s->value);
+        s->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Calls `consume(T&)` on the oldest published element and frees its slot.
+    // @returns false if there is nothing to consume.
+    template <typename Consume>
+    bool try_pop(Consume&& consume) {
+        slot* s = &slots_[dequeue_pos_ & (Capacity - 1)];
+        if (s->sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+            return false;
+        consume(s->value);
+        s->sequence.store(dequeue_pos_ + Capacity, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+};
+}
+
+#endif //BALLANCEMMOSERVER_BOUNDED_QUEUE_HPP
@@ -0,0 +1,191 @@
+#ifndef BALLANCEMMOSERVER_BYTE_STREAM_HPP
+#define BALLANCEMMOSERVER_BYTE_STREAM_HPP
+#include <cstddef>
+#include <cstring>
+#include <ios>
+#include <string>
+#include <algorithm>
+#include <utility>
+
+namespace bmmo {
+    // Contiguous growable byte buffer which messages serialize into and deserialize from.
+    // It offers the part of the iostream interface our messages were written against
+    // (read/write/get/peek/ignore, good/eof/gcount, tellg/tellp) with the same failure
+    // semantics, so a short read leaves `good()` false and `gcount()` below the request.
+    // The first INLINE_CAPACITY bytes are stored in the object itself; typical chat,
+    // login and ball state messages never touch the heap.
+    class byte_stream {
+    public:
+        using traits_type = std::char_traits<char>;
+        static constexpr size_t INLINE_CAPACITY = 512;
+
+        byte_stream() = default;
+
+        byte_stream(const byte_stream& other) { assign(other); }
+
+        byte_stream(byte_stream&& other) noexcept { take(other); }
+
+        byte_stream& operator=(const byte_stream& other) {
+            if (this != &other) {
+                size_ = 0;
+                assign(other);
+            }
+            return *this;
+        }
+
+        byte_stream& operator=(byte_stream&& other) noexcept {
+            if (this != &other) {
+                free_heap();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~byte_stream() { free_heap(); }
+
+        const char* data() const { return buffer_; }
+        char* data() { return buffer_; }
+        size_t size() const { return size_; }
+        size_t capacity() const { return capacity_; }
+        // bytes not read yet
+        size_t remaining() const { return size_ - read_pos_; }
+
+        void reserve(size_t capacity) {
+            if (capacity <= capacity_)
+                return;
+            capacity = std::max(capacity, capacity_ * 2);
+            char* buffer = new char[capacity];
+            std::memcpy(buffer, buffer_, size_);
+            free_heap();
+            buffer_ = buffer;
+            capacity_ = capacity;
+        }
+
+        // Drops the content and resets the state but keeps the storage for reuse.
+        void reset() {
+            size_ = 0;
+            read_pos_ = 0;
+            gcount_ = 0;
+            state_ = std::ios::goodbit;
+        }
+
+        byte_stream& write(const char* s, std::streamsize n) {
+            if (n > 0)
+                std::memcpy(extend(static_cast<size_t>(n)), s, static_cast<size_t>(n));
+            return *this;
+        }
+
+        // Appends `n` uninitialized bytes and returns where they start, for
+        // filling the buffer directly (e.g. from a file).
+        char* extend(size_t n) {
+            reserve(size_ + n);
+            char* dest = buffer_ + size_;
+            size_ += n;
+            return dest;
+        }
+
+        byte_stream& read(char* s, std::streamsize n) {
+            gcount_ = 0;
+            if (!good()) {
+                state_ |= std::ios::failbit;
+                return *this;
+            }
+            const size_t count = std::min(static_cast<size_t>(n), remaining());
+            std::memcpy(s, buffer_ + read_pos_, count);
+            read_pos_ += count;
+            gcount_ = static_cast<std::streamsize>(count);
+            if (count < static_cast<size_t>(n))
+                state_ |= std::ios::eofbit | std::ios::failbit;
+            return *this;
+        }
+
+        // Skips up to `n` bytes; unlike `read`, running out isn't a failure.
+        byte_stream& ignore(std::streamsize n) {
+            gcount_ = 0;
+            if (!good())
+                return *this;
+            const size_t count = std::min(static_cast<size_t>(n), remaining());
+            read_pos_ += count;
+            gcount_ = static_cast<std::streamsize>(count);
+            if (count < static_cast<size_t>(n))
+                state_ |= std::ios::eofbit;
+            return *this;
+        }
+
+        traits_type::int_type get() {
+            gcount_ = 0;
+            if (!good() || remaining() == 0) {
+                state_ |= std::ios::eofbit | std::ios::failbit;
+                return traits_type::eof();
+            }
+            gcount_ = 1;
+            return traits_type::to_int_type(buffer_[read_pos_++]);
+        }
+
+        // Like std::istream, hitting the end here sets eof, so `good()` becomes false.
+        traits_type::int_type peek() {
+            if (!good())
+                return traits_type::eof();
+            if (remaining() == 0) {
+                state_ |= std::ios::eofbit;
+                return traits_type::eof();
+            }
+            return traits_type::to_int_type(buffer_[read_pos_]);
+        }
+
+        std::streamsize gcount() const { return gcount_; }
+        bool good() const { return state_ == std::ios::goodbit; }
+        bool eof() const { return state_ & std::ios::eofbit; }
+        bool fail() const { return state_ & std::ios::failbit; }
+        explicit operator bool() const { return !fail(); }
+
+        std::streamoff tellg() const { return good() ? static_cast<std::streamoff>(read_pos_) : -1; }
+        std::streamoff tellp() const { return static_cast<std::streamoff>(size_); }
+
+    private:
+        void assign(const byte_stream& other) {
+            reserve(other.size_);
+            std::memcpy(buffer_, other.buffer_, other.size_);
+            size_ = other.size_;
+            read_pos_ = other.read_pos_;
+            gcount_ = other.gcount_;
+            state_ = other.state_;
+        }
+
+        // `this` must not own heap storage
+        void take(byte_stream& other) {
+            if (other.buffer_ == other.inline_buffer_) {
+                buffer_ = inline_buffer_;
+                capacity_ = INLINE_CAPACITY;
+                std::memcpy(inline_buffer_, other.inline_buffer_, other.size_);
+            } else {
+                buffer_ = other.buffer_;
+                capacity_ = other.capacity_;
+                other.buffer_ = other.inline_buffer_;
+                other.capacity_ = INLINE_CAPACITY;
+            }
+            size_ = other.size_;
+            read_pos_ = other.read_pos_;
+            gcount_ = other.gcount_;
+            state_ = other.state_;
+            other.reset();
+        }
+
+        void free_heap() {
+            if (buffer_ != inline_buffer_)
+                delete[] buffer_;
+            buffer_ = inline_buffer_;
+            capacity_ = INLINE_CAPACITY;
+        }
+
+        char* buffer_ = inline_buffer_;
+        size_t capacity_ = INLINE_CAPACITY;
+        size_t size_ = 0;
+        size_t read_pos_ = 0;
+        std::streamsize gcount_ = 0;
+        std::ios::iostate state_ = std::ios::goodbit;
+        char inline_buffer_[INLINE_CAPACITY];
+    };
+}
+
+#endif //BALLANCEMMOSERVER_BYTE_STREAM_HPP
@@ -2,13 +2,24 @@
 #define BALLANCEMMOSERVER_INTERNAL_HPP
 #include <cstdio>
 #include <cstdarg>
+#include <cstdint>
 #include <steam/steamnetworkingtypes.h>
 
 namespace bmmo {
+    // What DebugOutput does when the log writer is too far behind to take another line.
+    enum class log_overflow_policy {
+        Block, // wait for the writer to catch up
+        Drop,  // drop the line and report how many were dropped later
+    };
+
     void set_log_file(FILE* file);
+    void set_log_overflow_policy(log_overflow_policy policy);
+    // Drops lines of `eType` beyond `lines_per_second`; 0 means no limit. Bugs are never dropped.
+    void set_log_rate_limit(ESteamNetworkingSocketsDebugOutputType eType, uint32_t lines_per_second);
 
     void LogFileOutput(const char* pMsg);
 
+    // Queues the line for the background log writer; only bugs are written out right away.
     void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg, int ansiColor);
     void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg);
 
@@ -79,6 +90,12 @@ namespace bmmo {
     }
 
     void set_auto_flush_log(bool flush);
+    // Moves writing log output to a background thread, which is stopped at exit.
+    // Without it (e.g. in the client mod, where joining it while unloading could
+    // deadlock), output is written on the calling thread.
+    void start_log_writer();
+    // Waits until all lines queued so far have been written out.
+    void sync_log();
     void flush_log();
     void close_log();
 }
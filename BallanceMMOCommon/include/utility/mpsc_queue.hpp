@@ -0,0 +1,64 @@
+#ifndef BALLANCEMMOSERVER_MPSC_QUEUE_HPP
+#define BALLANCEMMOSERVER_MPSC_QUEUE_HPP
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace bmmo {
+// Unbounded lock-free multi-producer single-consumer queue (Vyukov-style linked list).
+// `push` may be called from any thread; `pop` must only be called from one thread at a time.
+// A producer preempted between its exchange and link steps makes the queue look empty
+// to the consumer until it resumes; nothing is lost, it's just picked up on a later pop.
+template <typename T>
+class mpsc_queue {
+    struct node {
+        std::atomic<node*> next{nullptr};
+        std::optional<T> value;
+    };
+
+    alignas(64) std::atomic<node*> head_; // producers push here
+    alignas(64) node* tail_; // consumer pops here; always points to the current stub
+
+public:
+    mpsc_queue() {
+        auto* stub = new node;
+        head_.store(stub, std::memory_order_relaxed);
+        tail_ = stub;
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    ~mpsc_queue() {
+        while (pop());
+        delete tail_;
+    }
+
+    template <typename... Args>
+    void push(Args&&... args) {
+        auto* n = new node;
+        n->value.emplace(std::forward<Args>(args)...);
+        node* prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    std::optional<T> pop() {
+        node* next = tail_->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return std::nullopt;
+        // `next` becomes the new stub; its value is moved out and the old stub freed
+        std::optional<T> value = std::move(next->value);
+        next->value.reset();
+        delete tail_;
+        tail_ = next;
+        return value;
+    }
+
+    // Only meaningful on the consumer thread.
+    bool empty() const {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+};
+}
+
+#endif //BALLANCEMMOSERVER_MPSC_QUEUE_HPP
@@ -0,0 +1,263 @@
+#ifndef BALLANCEMMOSERVER_NAME_INDEX_HPP
+#define BALLANCEMMOSERVER_NAME_INDEX_HPP
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace bmmo {
+// Case-insensitive radix tree of player names, for looking players up by
+// their full names, by unique prefixes (as typed into consoles) or by names
+// which are only close enough (for suggestions). Names are kept as inserted;
+// only the keys are folded to lowercase. Iteration is in order of the folded names.
+template <typename T>
+class name_index {
+public:
+    struct entry {
+        std::string name;
+        T value;
+    };
+
+    name_index() = default;
+    name_index(const name_index&) = delete;
+    name_index& operator=(const name_index&) = delete;
+    name_index(name_index&&) noexcept = default;
+    name_index& operator=(name_index&&) noexcept = default;
+
+    size_t size() const { return root_->count; }
+    bool empty() const { return size() == 0; }
+    void clear() { root_ = std::make_unique<node>(); }
+
+    // @returns false if the name was already there, in which case its value is replaced.
+    bool insert_or_assign(const std::string& name, T value) {
+        return insert_into(*root_, fold(name), name, std::move(value));
+    }
+
+    bool erase(std::string_view name) {
+        return erase_from(*root_, fold(name));
+    }
+
+    // Keeps the value of `old_name` under `new_name`.
+    bool rename(std::string_view old_name, const std::string& new_name) {
+        const auto* old_entry = find(old_name);
+        if (!old_entry)
+            return false;
+        T value = old_entry->value;
+        erase(old_name);
+        insert_or_assign(new_name, std::move(value));
+        return true;
+    }
+
+    const entry* find(std::string_view name) const {
+        const auto key = fold(name);
+        const auto [n, rest] = locate(key);
+        return (n && rest == 0 && n->value) ? &*n->value : nullptr;
+    }
+
+    bool contains(std::string_view name) const { return find(name) != nullptr; }
+
+    size_t count_prefix(std::string_view prefix) const {
+        const auto [n, rest] = locate(fold(prefix));
+        return n ? n->count : 0;
+    }
+
+    // Names starting with `prefix`, at most `limit` of them.
+    std::vector<const entry*> find_prefix(std::string_view prefix, size_t limit = size_t(-1)) const {
+        std::vector<const entry*> entries;
+        if (const auto [n, rest] = locate(fold(prefix)); n)
+            collect(*n, entries, limit);
+        return entries;
+    }
+
+    // The name matching `prefix` exactly, or else the only one starting with it.
+    const entry* find_unique(std::string_view prefix) const {
+        const auto [n, rest] = locate(fold(prefix));
+        if (!n)
+            return nullptr;
+        if (rest == 0 && n->value)
+            return &*n->value;
+        if (n->count != 1)
+            return nullptr;
+        const node* only = n;
+        while (!only->value)
+            only = only->children.front().get();
+        return &*only->value;
+    }
+
+    // Names at most `max_distance` single-character edits away from `name`, closest first.
+    std::vector<std::pair<size_t, const entry*>> find_fuzzy(std::string_view name, size_t max_distance) const {
+        const auto key = fold(name);
+        std::vector<size_t> row(key.size() + 1);
+        std::iota(row.begin(), row.end(), size_t(0));
+        std::vector<std::pair<size_t, const entry*>> matches;
+        for (const auto& child: root_->children)
+            collect_fuzzy(*child, key, row, max_distance, matches);
+        std::ranges::stable_sort(matches, {}, &std::pair<size_t, const entry*>::first);
+        return matches;
+    }
+
+    template <typename Function>
+    void for_each(Function&& f) const {
+        for_each_in(*root_, f);
+    }
+
+private:
+    struct node {
+        std::string label; // folded; empty only for the root
+        std::vector<std::unique_ptr<node>> children; // ordered by the first character of their labels
+        std::optional<entry> value;
+        size_t count = 0; // entries in this subtree
+    };
+
+    static char fold(char c) {
+        return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    }
+
+    static std::string fold(std::string_view s) {
+        std::string folded(s);
+        for (char& c: folded)
+            c = fold(c);
+        return folded;
+    }
+
+    static size_t common_prefix_length(std::string_view a, std::string_view b) {
+        return std::ranges::mismatch(a, b).in1 - a.begin();
+    }
+
+    template <typename Node> // const or not
+    static auto child_position(Node& n, char first) {
+        return std::ranges::lower_bound(n.children, first, {}, [](const auto& child) { return child->label.front(); });
+    }
+
+    static node* find_child(const node& n, char first) {
+        auto it = child_position(n, first);
+        return (it != n.children.end() && (*it)->label.front() == first) ? it->get() : nullptr;
+    }
+
+    // The node whose path spells out `key`, or the one below the edge `key` ends in;
+    // `rest` is how many characters of that edge are left over.
+    std::pair<const node*, size_t> locate(std::string_view key) const {
+        const node* n = root_.get();
+        while (!key.empty()) {
+            const node* child = find_child(*n, key.front());
+            if (!child)
+                return {nullptr, 0};
+            const size_t common = common_prefix_length(child->label, key);
+            if (common == key.size())
+                return {child, child->label.size() - common};
+            if (common < child->label.size())
+                return {nullptr, 0};
+            key.remove_prefix(common);
+            n = child;
+        }
+        return {n, 0};
+    }
+
+    static bool insert_into(node& n, std::string_view key, const std::string& name, T&& value) {
+        if (key.empty()) {
+            const bool inserted = !n.value;
+            n.value = entry{name, std::move(value)};
+            if (inserted)
+                ++n.count;
+            return inserted;
+        }
+        auto it = child_position(n, key.front());
+        if (it == n.children.end() || (*it)->label.front() != key.front()) {
+            auto leaf = std::make_unique<node>();
+            leaf->label = key;
+            leaf->value = entry{name, std::move(value)};
+            leaf->count = 1;
+            n.children.insert(it, std::move(leaf));
+            ++n.count;
+            return true;
+        }
+        const size_t common = common_prefix_length((*it)->label, key);
+        if (common < (*it)->label.size()) {
+            // split the edge where the keys part ways
+            auto middle = std::make_unique<node>();
+            middle->label = (*it)->label.substr(0, common);
+            middle->count = (*it)->count;
+            (*it)->label.erase(0, common);
+            middle->children.push_back(std::move(*it));
+            *it = std::move(middle);
+        }
+        const bool inserted = insert_into(**it, key.substr(common), name, std::move(value));
+        if (inserted)
+            ++n.count;
+        return inserted;
+    }
+
+    static bool erase_from(node& n, std::string_view key) {
+        if (key.empty()) {
+            if (!n.value)
+                return false;
+            n.value.reset();
+            --n.count;
+            return true;
+        }
+        auto it = child_position(n, key.front());
+        if (it == n.children.end() || (*it)->label.front() != key.front())
+            return false;
+        node& child = **it;
+        if (!key.starts_with(child.label) || !erase_from(child, key.substr(child.label.size())))
+            return false;
+        --n.count;
+        if (child.count == 0) {
+            n.children.erase(it);
+        } else if (!child.value && child.children.size() == 1) {
+            // nothing branches off here anymore, merge the edges
+            auto grandchild = std::move(child.children.front());
+            grandchild->label.insert(0, child.label);
+            *it = std::move(grandchild);
+        }
+        return true;
+    }
+
+    static void collect(const node& n, std::vector<const entry*>& entries, size_t limit) {
+        if (entries.size() >= limit)
+            return;
+        if (n.value)
+            entries.push_back(&*n.value);
+        for (const auto& child: n.children)
+            collect(*child, entries, limit);
+    }
+
+    // Levenshtein distances to `key`, one row per character down the tree;
+    // subtrees are skipped as soon as no distance in the row is small enough anymore.
+    static void collect_fuzzy(const node& n, std::string_view key, const std::vector<size_t>& parent_row,
+                              size_t max_distance, std::vector<std::pair<size_t, const entry*>>& matches) {
+        std::vector<size_t> row = parent_row, previous(row.size());
+        for (char c: n.label) {
+            std::swap(row, previous);
+            row[0] = previous[0] + 1;
+            for (size_t i = 1; i < row.size(); ++i) {
+                const size_t substitution = previous[i - 1] + (key[i - 1] == c ? 0 : 1);
+                row[i] = std::min({previous[i] + 1, row[i - 1] + 1, substitution});
+            }
+            if (std::ranges::min(row) > max_distance)
+                return;
+        }
+        if (n.value && row.back() <= max_distance)
+            matches.emplace_back(row.back(), &*n.value);
+        for (const auto& child: n.children)
+            collect_fuzzy(*child, key, row, max_distance, matches);
+    }
+
+    template <typename Function>
+    static void for_each_in(const node& n, Function& f) {
+        if (n.value)
+            f(*n.value);
+        for (const auto& child: n.children)
+            for_each_in(*child, f);
+    }
+
+    std::unique_ptr<node> root_ = std::make_unique<node>();
+};
+}
+
+#endif //BALLANCEMMOSERVER_NAME_INDEX_HPP
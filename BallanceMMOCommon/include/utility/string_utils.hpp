@@ -2,6 +2,7 @@
 #define BALLANCEMMOSERVER_STRING_UTILS_HPP
 #include <vector>
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
@@ -82,11 +83,21 @@ namespace bmmo::string_utils {
         return words;
     }
 
-    inline void hex_chars_from_string(uint8_t* dest, const std::string& src) {
-        for (unsigned int i = 0; i < src.length(); i += 2) {
-            std::string byte_string = src.substr(i, 2);
-            auto byte = (uint8_t) strtol(byte_string.c_str(), NULL, 16);
-            dest[i / 2] = byte;
+    // -1 if `c` isn't a hex digit.
+    constexpr int hex_digit_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Each pair of characters becomes a byte; like with strtol, parsing a pair stops
+    // at the first character which isn't a hex digit.
+    constexpr void hex_chars_from_string(uint8_t* dest, std::string_view src) {
+        for (size_t i = 0; i < src.length(); i += 2) {
+            const int high = hex_digit_value(src[i]);
+            const int low = (i + 1 < src.length()) ? hex_digit_value(src[i + 1]) : -1;
+            dest[i / 2] = uint8_t((high < 0) ? 0 : (low < 0) ? high : (high << 4 | low));
         }
     }
 
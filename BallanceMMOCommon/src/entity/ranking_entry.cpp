@@ -23,13 +23,32 @@ namespace bmmo::ranking_entry {
     }
 
     void sort_rankings(player_rankings& rankings, bool hs_mode) {
+        if (hs_mode) {
+            for (auto& entry: rankings.first)
+                entry.hs_score = parse_hs_score(entry.formatted_hs_score);
+        }
         std::sort(rankings.first.begin(), rankings.first.end(), hs_mode ? hs_sorter : sr_sorter);
-        std::sort(rankings.second.begin(), rankings.second.end(), dnf_sorter);
+        // equal sectors stay in the order they were reached in
+        std::stable_sort(rankings.second.begin(), rankings.second.end(), dnf_sorter);
     }
 
     std::vector<std::pair<std::string, int>> get_formatted_rankings(
             const player_rankings& rankings, const std::string& map_name, bool hs_mode) {
-        decltype(get_formatted_rankings({}, {}, {})) texts;
+        std::vector<const finish_entry*> finishes;
+        std::vector<const dnf_entry*> dnfs;
+        finishes.reserve(rankings.first.size());
+        dnfs.reserve(rankings.second.size());
+        for (const auto& entry: rankings.first)
+            finishes.push_back(&entry);
+        for (const auto& entry: rankings.second)
+            dnfs.push_back(&entry);
+        return get_formatted_rankings(finishes, dnfs, map_name, hs_mode);
+    }
+
+    std::vector<std::pair<std::string, int>> get_formatted_rankings(
+            const std::vector<const finish_entry*>& finishes, const std::vector<const dnf_entry*>& dnfs,
+            const std::string& map_name, bool hs_mode) {
+        std::vector<std::pair<std::string, int>> texts;
         char header[128];
         std::snprintf(header, sizeof(header), "Ranking info for %s [%s]:",
                 map_name.c_str(), hs_mode ? "HS" : "SR");
@@ -37,25 +56,22 @@ namespace bmmo::ranking_entry {
         using lm = level_mode;
 		const static int finish_color = bmmo::color_code(bmmo::LevelFinishV2),
                 dnf_color = bmmo::color_code(bmmo::DidNotFinish);
-        for (size_t i = 0; i < rankings.first.size(); ++i) {
-            const auto& entry = rankings.first[i];
-            int rank = i;
-            if (hs_mode) {
-                while (rank > 0 && atoi(entry.formatted_hs_score.c_str())
-                        == atoi(rankings.first[rank - 1].formatted_hs_score.c_str()))
-                    --rank;
-            }
+        // equal highscores and equal DNF sectors share their rank
+        int rank = 0;
+        for (size_t i = 0; i < finishes.size(); ++i) {
+            const auto& entry = *finishes[i];
+            if (!hs_mode || i == 0 || entry.hs_score != finishes[i - 1]->hs_score)
+                rank = i;
             texts.emplace_back(entry.to_string(rank + 1, hs_mode ? lm::Highscore : lm::Speedrun), finish_color);
         }
-        for (size_t i = 0; i < rankings.second.size(); ++i) {
-            const auto& entry = rankings.second[i];
-            int rank = i;
-            while (rank > 0 && entry.dnf_sector == rankings.second[rank - 1].dnf_sector)
-                --rank;
-            texts.emplace_back(entry.to_string(rank + 1 + rankings.first.size()), dnf_color);
+        for (size_t i = 0; i < dnfs.size(); ++i) {
+            const auto& entry = *dnfs[i];
+            if (i == 0 || entry.dnf_sector != dnfs[i - 1]->dnf_sector)
+                rank = i;
+            texts.emplace_back(entry.to_string(rank + 1 + finishes.size()), dnf_color);
         }
         char footer[32];
-        std::snprintf(footer, sizeof(footer), "%zu Completion(s), %zu DNF(s).", rankings.first.size(), rankings.second.size());
+        std::snprintf(footer, sizeof(footer), "%zu Completion(s), %zu DNF(s).", finishes.size(), dnfs.size());
         texts.emplace_back(footer, bmmo::ansi::Reset);
         return texts;
     }
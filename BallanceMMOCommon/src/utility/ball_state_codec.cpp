@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include "utility/ball_state_codec.hpp"
+#include "message/owned_compressed_ball_state_msg.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define BMMO_CODEC_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define BMMO_TARGET(isa)
+# else
+// lets the kernels use instructions the rest of the build isn't compiled for
+#  define BMMO_TARGET(isa) __attribute__((target(isa)))
+# endif
+#endif
+
+namespace bmmo::ball_state_codec {
+namespace {
+    using compressed_msg = owned_compressed_ball_state_msg;
+
+    typedef void (*compress_function)(const char* rotations, size_t stride, size_t count, uint32_t* bits);
+    typedef void (*decompress_function)(const uint32_t* bits, size_t count, char* rotations, size_t stride);
+
+    struct kernel_table {
+        kernel k;
+        compress_function compress;
+        decompress_function decompress;
+    };
+
+    // The reference: the same functions single ball states are compressed with.
+    void compress_scalar(const char* rotations, size_t stride, size_t count, uint32_t* bits) {
+        for (size_t i = 0; i < count; ++i, rotations += stride) {
+            quaternion rotation;
+            std::memcpy(&rotation, rotations, sizeof(rotation));
+            const auto compressed = compressed_msg::compress_rotation(rotation);
+            std::memcpy(&bits[i], &compressed, sizeof(bits[i]));
+        }
+    }
+
+    void decompress_scalar(const uint32_t* bits, size_t count, char* rotations, size_t stride) {
+        for (size_t i = 0; i < count; ++i, rotations += stride) {
+            compressed_msg::compressed_bitfield compressed;
+            std::memcpy(&compressed, &bits[i], sizeof(compressed));
+            const auto rotation = compressed_msg::decompress_rotation(compressed);
+            std::memcpy(rotations, &rotation, sizeof(rotation));
+        }
+    }
+
+    static_assert(sizeof(compressed_msg::compressed_bitfield) == sizeof(uint32_t));
+    static_assert(compressed_msg::compressed_flag::used_bits == 3 && compressed_msg::ROTATION_BIT_LENGTH == 9,
+                  "the vector kernels hardcode the bitfield layout");
+
+#ifdef BMMO_CODEC_X86
+    // Each lane holds one ball. Both kernels follow the scalar code step by step:
+    // the first component with the largest magnitude is omitted, the others are divided
+    // (not multiplied by the reciprocal) by the step and rounded half away from zero
+    // like std::round, then truncated into their 9 bits the way the bitfield does it.
+
+    BMMO_TARGET("sse2")
+    inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) { // mask ? a : b
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    BMMO_TARGET("sse2")
+    inline __m128i select_epi32(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    BMMO_TARGET("sse2")
+    inline __m128i quantize_sse2(__m128 v, __m128i negate) {
+        const __m128 q = _mm_div_ps(v, _mm_set1_ps(compressed_msg::ROTATION_STEP));
+        __m128i rounded = _mm_cvttps_epi32(q);
+        const __m128 fraction = _mm_sub_ps(q, _mm_cvtepi32_ps(rounded)); // exact
+        rounded = _mm_sub_epi32(rounded, _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f))));
+        rounded = _mm_add_epi32(rounded, _mm_castps_si128(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f))));
+        rounded = _mm_sub_epi32(_mm_xor_si128(rounded, negate), negate);
+        return _mm_and_si128(rounded, _mm_set1_epi32((1 << compressed_msg::ROTATION_BIT_LENGTH) - 1));
+    }
+
+    BMMO_TARGET("sse2")
+    inline __m128i compress_lanes_sse2(__m128 x, __m128 y, __m128 z, __m128 w) {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        __m128 max = _mm_andnot_ps(sign, x), max_value = x;
+        __m128i max_index = _mm_setzero_si128();
+        const __m128 components[] = {y, z, w};
+        for (int i = 0; i < 3; ++i) {
+            const __m128 magnitude = _mm_andnot_ps(sign, components[i]);
+            const __m128 greater = _mm_cmpgt_ps(magnitude, max);
+            max = select_ps(greater, magnitude, max);
+            max_value = select_ps(greater, components[i], max_value);
+            max_index = select_epi32(_mm_castps_si128(greater), _mm_set1_epi32(i + 1), max_index);
+        }
+        const __m128i negate = _mm_castps_si128(_mm_cmplt_ps(max_value, _mm_setzero_ps()));
+        const __m128i index_0 = _mm_cmpeq_epi32(max_index, _mm_setzero_si128()),
+                      index_below_2 = _mm_cmplt_epi32(max_index, _mm_set1_epi32(2)),
+                      index_below_3 = _mm_cmplt_epi32(max_index, _mm_set1_epi32(3));
+        const __m128i rotation0 = quantize_sse2(select_ps(_mm_castsi128_ps(index_0), y, x), negate),
+                      rotation1 = quantize_sse2(select_ps(_mm_castsi128_ps(index_below_2), z, y), negate),
+                      rotation2 = quantize_sse2(select_ps(_mm_castsi128_ps(index_below_3), w, z), negate);
+        return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(max_index, 1), _mm_slli_epi32(rotation0, 3)),
+                            _mm_or_si128(_mm_slli_epi32(rotation1, 12), _mm_slli_epi32(rotation2, 21)));
+    }
+
+    BMMO_TARGET("sse2")
+    void compress_sse2(const char* rotations, size_t stride, size_t count, uint32_t* bits) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const char* row = rotations + i * stride;
+            __m128 x = _mm_loadu_ps(reinterpret_cast<const float*>(row)),
+                   y = _mm_loadu_ps(reinterpret_cast<const float*>(row + stride)),
+                   z = _mm_loadu_ps(reinterpret_cast<const float*>(row + 2 * stride)),
+                   w = _mm_loadu_ps(reinterpret_cast<const float*>(row + 3 * stride));
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bits + i), compress_lanes_sse2(x, y, z, w));
+        }
+        compress_scalar(rotations + i * stride, stride, count - i, bits + i);
+    }
+
+    BMMO_TARGET("sse2")
+    void decompress_sse2(const uint32_t* bits, size_t count, char* rotations, size_t stride) {
+        const __m128 step = _mm_set1_ps(compressed_msg::ROTATION_STEP);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i word = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bits + i));
+            const __m128i max_index = _mm_and_si128(_mm_srli_epi32(word, 1), _mm_set1_epi32(0b11));
+            const __m128 rotation0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(word, 20), 23)), step),
+                         rotation1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(word, 11), 23)), step),
+                         rotation2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(word, 2), 23)), step);
+            __m128 max_squared = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(rotation0, rotation0));
+            max_squared = _mm_sub_ps(max_squared, _mm_mul_ps(rotation1, rotation1));
+            max_squared = _mm_sub_ps(max_squared, _mm_mul_ps(rotation2, rotation2));
+            const __m128 max = _mm_sqrt_ps(max_squared);
+            const __m128 index_0 = _mm_castsi128_ps(_mm_cmpeq_epi32(max_index, _mm_setzero_si128())),
+                         index_1 = _mm_castsi128_ps(_mm_cmpeq_epi32(max_index, _mm_set1_epi32(1))),
+                         index_2 = _mm_castsi128_ps(_mm_cmpeq_epi32(max_index, _mm_set1_epi32(2))),
+                         index_3 = _mm_castsi128_ps(_mm_cmpeq_epi32(max_index, _mm_set1_epi32(3))),
+                         index_below_2 = _mm_castsi128_ps(_mm_cmplt_epi32(max_index, _mm_set1_epi32(2)));
+            __m128 x = select_ps(index_0, max, rotation0),
+                   y = select_ps(index_1, max, select_ps(index_0, rotation0, rotation1)),
+                   z = select_ps(index_2, max, select_ps(index_below_2, rotation1, rotation2)),
+                   w = select_ps(index_3, max, rotation2);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            char* row = rotations + i * stride;
+            _mm_storeu_ps(reinterpret_cast<float*>(row), x);
+            _mm_storeu_ps(reinterpret_cast<float*>(row + stride), y);
+            _mm_storeu_ps(reinterpret_cast<float*>(row + 2 * stride), z);
+            _mm_storeu_ps(reinterpret_cast<float*>(row + 3 * stride), w);
+        }
+        decompress_scalar(bits + i, count - i, rotations + i * stride, stride);
+    }
+
+    // Same as the SSE2 kernel, with the 8 balls in two 128-bit halves: balls 0-3 in the
+    // lower one and 4-7 in the upper one, as the in-lane transpose leaves them.
+
+    BMMO_TARGET("avx2")
+    inline void transpose_avx2(__m256& a, __m256& b, __m256& c, __m256& d) {
+        const __m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b),
+                     t2 = _mm256_unpacklo_ps(c, d), t3 = _mm256_unpackhi_ps(c, d);
+        a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        b = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        c = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        d = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    BMMO_TARGET("avx2")
+    inline __m256 load_rows_avx2(const char* row, size_t stride) { // `row` and the one 4 balls later
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(reinterpret_cast<const float*>(row))),
+                                    _mm_loadu_ps(reinterpret_cast<const float*>(row + 4 * stride)), 1);
+    }
+
+    BMMO_TARGET("avx2")
+    inline void store_rows_avx2(char* row, size_t stride, __m256 v) {
+        _mm_storeu_ps(reinterpret_cast<float*>(row), _mm256_castps256_ps128(v));
+        _mm_storeu_ps(reinterpret_cast<float*>(row + 4 * stride), _mm256_extractf128_ps(v, 1));
+    }
+
+    BMMO_TARGET("avx2")
+    inline __m256i quantize_avx2(__m256 v, __m256i negate) {
+        const __m256 q = _mm256_div_ps(v, _mm256_set1_ps(compressed_msg::ROTATION_STEP));
+        __m256i rounded = _mm256_cvttps_epi32(q);
+        const __m256 fraction = _mm256_sub_ps(q, _mm256_cvtepi32_ps(rounded));
+        rounded = _mm256_sub_epi32(rounded, _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ)));
+        rounded = _mm256_add_epi32(rounded, _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ)));
+        rounded = _mm256_sub_epi32(_mm256_xor_si256(rounded, negate), negate);
+        return _mm256_and_si256(rounded, _mm256_set1_epi32((1 << compressed_msg::ROTATION_BIT_LENGTH) - 1));
+    }
+
+    BMMO_TARGET("avx2")
+    void compress_avx2(const char* rotations, size_t stride, size_t count, uint32_t* bits) {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const char* row = rotations + i * stride;
+            __m256 x = load_rows_avx2(row, stride), y = load_rows_avx2(row + stride, stride),
+                   z = load_rows_avx2(row + 2 * stride, stride), w = load_rows_avx2(row + 3 * stride, stride);
+            transpose_avx2(x, y, z, w);
+
+            __m256 max = _mm256_andnot_ps(sign, x), max_value = x;
+            __m256i max_index = _mm256_setzero_si256();
+            const __m256 components[] = {y, z, w};
+            for (int j = 0; j < 3; ++j) {
+                const __m256 magnitude = _mm256_andnot_ps(sign, components[j]);
+                const __m256 greater = _mm256_cmp_ps(magnitude, max, _CMP_GT_OQ);
+                max = _mm256_blendv_ps(max, magnitude, greater);
+                max_value = _mm256_blendv_ps(max_value, components[j], greater);
+                max_index = _mm256_blendv_epi8(max_index, _mm256_set1_epi32(j + 1), _mm256_castps_si256(greater));
+            }
+            const __m256i negate = _mm256_castps_si256(_mm256_cmp_ps(max_value, _mm256_setzero_ps(), _CMP_LT_OQ));
+            const __m256 index_0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(max_index, _mm256_setzero_si256())),
+                         index_below_2 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(2), max_index)),
+                         index_below_3 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(3), max_index));
+            const __m256i rotation0 = quantize_avx2(_mm256_blendv_ps(x, y, index_0), negate),
+                          rotation1 = quantize_avx2(_mm256_blendv_ps(y, z, index_below_2), negate),
+                          rotation2 = quantize_avx2(_mm256_blendv_ps(z, w, index_below_3), negate);
+            const __m256i word = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_slli_epi32(max_index, 1), _mm256_slli_epi32(rotation0, 3)),
+                    _mm256_or_si256(_mm256_slli_epi32(rotation1, 12), _mm256_slli_epi32(rotation2, 21)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(bits + i), word);
+        }
+        compress_sse2(rotations + i * stride, stride, count - i, bits + i);
+    }
+
+    BMMO_TARGET("avx2")
+    void decompress_avx2(const uint32_t* bits, size_t count, char* rotations, size_t stride) {
+        const __m256 step = _mm256_set1_ps(compressed_msg::ROTATION_STEP);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256i word = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits + i));
+            const __m256i max_index = _mm256_and_si256(_mm256_srli_epi32(word, 1), _mm256_set1_epi32(0b11));
+            const __m256 rotation0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(word, 20), 23)), step),
+                         rotation1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(word, 11), 23)), step),
+                         rotation2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(word, 2), 23)), step);
+            __m256 max_squared = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(rotation0, rotation0));
+            max_squared = _mm256_sub_ps(max_squared, _mm256_mul_ps(rotation1, rotation1));
+            max_squared = _mm256_sub_ps(max_squared, _mm256_mul_ps(rotation2, rotation2));
+            const __m256 max = _mm256_sqrt_ps(max_squared);
+            const __m256 index_0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(max_index, _mm256_setzero_si256())),
+                         index_1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(max_index, _mm256_set1_epi32(1))),
+                         index_2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(max_index, _mm256_set1_epi32(2))),
+                         index_3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(max_index, _mm256_set1_epi32(3))),
+                         index_below_2 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(2), max_index));
+            __m256 x = _mm256_blendv_ps(rotation0, max, index_0),
+                   y = _mm256_blendv_ps(_mm256_blendv_ps(rotation1, rotation0, index_0), max, index_1),
+                   z = _mm256_blendv_ps(_mm256_blendv_ps(rotation2, rotation1, index_below_2), max, index_2),
+                   w = _mm256_blendv_ps(rotation2, max, index_3);
+            transpose_avx2(x, y, z, w);
+            char* row = rotations + i * stride;
+            store_rows_avx2(row, stride, x);
+            store_rows_avx2(row + stride, stride, y);
+            store_rows_avx2(row + 2 * stride, stride, z);
+            store_rows_avx2(row + 3 * stride, stride, w);
+        }
+        decompress_sse2(bits + i, count - i, rotations + i * stride, stride);
+    }
+
+# ifdef _MSC_VER
+    bool cpu_supports_sse2() {
+        int info[4];
+        __cpuid(info, 1);
+        return info[3] & (1 << 26);
+    }
+
+    bool cpu_supports_avx2() {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        // the OS has to save the upper halves of the registers as well
+        if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 0b110) != 0b110)
+            return false;
+        __cpuidex(info, 7, 0);
+        return info[1] & (1 << 5);
+    }
+# else
+    bool cpu_supports_sse2() { return __builtin_cpu_supports("sse2"); }
+    bool cpu_supports_avx2() { return __builtin_cpu_supports("avx2"); }
+# endif
+#endif // BMMO_CODEC_X86
+
+    // Best first.
+    std::vector<kernel_table> get_supported_kernels() {
+        std::vector<kernel_table> kernels;
+#ifdef BMMO_CODEC_X86
+        if (cpu_supports_avx2())
+            kernels.push_back({kernel::AVX2, compress_avx2, decompress_avx2});
+        if (cpu_supports_sse2())
+            kernels.push_back({kernel::SSE2, compress_sse2, decompress_sse2});
+#endif
+        kernels.push_back({kernel::Scalar, compress_scalar, decompress_scalar});
+        return kernels;
+    }
+
+    const kernel_table& get_active_table() {
+        static const kernel_table active = get_supported_kernels().front();
+        return active;
+    }
+}
+
+    const char* get_kernel_name(kernel k) {
+        switch (k) {
+            case kernel::Scalar: return "scalar";
+            case kernel::SSE2: return "SSE2";
+            case kernel::AVX2: return "AVX2";
+        }
+        return "unknown";
+    }
+
+    kernel get_active_kernel() {
+        return get_active_table().k;
+    }
+
+    void compress_rotations(const quaternion* rotations, size_t stride, size_t count, uint32_t* bits) {
+        get_active_table().compress(reinterpret_cast<const char*>(rotations), stride, count, bits);
+    }
+
+    void decompress_rotations(const uint32_t* bits, size_t count, quaternion* rotations, size_t stride) {
+        get_active_table().decompress(bits, count, reinterpret_cast<char*>(rotations), stride);
+    }
+
+    std::vector<benchmark_result> run_benchmark(size_t ball_count) {
+        ball_count = std::max<size_t>(ball_count, 1);
+        std::mt19937 rng(ball_count);
+        std::normal_distribution<float> distribution;
+        std::vector<quaternion> rotations(ball_count);
+        for (auto& rotation: rotations) {
+            float length = 0;
+            for (auto& v: rotation.v) {
+                v = distribution(rng);
+                length += v * v;
+            }
+            for (auto& v: rotation.v)
+                v /= std::sqrt(length);
+        }
+
+        constexpr size_t stride = sizeof(quaternion);
+        std::vector<uint32_t> reference_bits(ball_count), bits(ball_count);
+        std::vector<quaternion> reference_rotations(ball_count), decompressed(ball_count);
+        compress_scalar(reinterpret_cast<const char*>(rotations.data()), stride, ball_count, reference_bits.data());
+        decompress_scalar(reference_bits.data(), ball_count, reinterpret_cast<char*>(reference_rotations.data()), stride);
+
+        // about a million balls per kernel and direction
+        const size_t rounds = std::max<size_t>((1 << 20) / ball_count, 1);
+        const auto time_per_ball = [&](auto&& function) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < rounds; ++i)
+                function();
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            return elapsed.count() / double(rounds * ball_count);
+        };
+
+        std::vector<benchmark_result> results;
+        for (const auto& table: get_supported_kernels()) {
+            benchmark_result result{table.k};
+            result.compress_ns = time_per_ball([&] {
+                table.compress(reinterpret_cast<const char*>(rotations.data()), stride, ball_count, bits.data());
+            });
+            result.decompress_ns = time_per_ball([&] {
+                table.decompress(bits.data(), ball_count, reinterpret_cast<char*>(decompressed.data()), stride);
+            });
+            result.identical = bits == reference_bits
+                    && std::memcmp(decompressed.data(), reference_rotations.data(), ball_count * sizeof(quaternion)) == 0;
+            results.push_back(result);
+        }
+        return results;
+    }
+}
@@ -1,7 +1,15 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <ctime>
 #include <cstring>
 #include <chrono>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
 #ifdef _WIN32
 # ifndef WIN32_LEAN_AND_MEAN
 # define WIN32_LEAN_AND_MEAN
@@ -16,6 +24,7 @@
 #include <replxx.hxx>
 #include "entity/globals.hpp"
 #include "utility/misc.hpp"
+#include "utility/bounded_queue.hpp"
 #include "utility/ansi_colors.hpp"
 #include "utility/string_utils.hpp"
 
@@ -40,20 +49,272 @@ namespace bmmo {
 #endif
 
     namespace {
-        FILE* log_file = nullptr;
-        bool auto_flush = false;
+        constexpr size_t LOG_QUEUE_CAPACITY = 1024;
+        constexpr size_t LOG_TEXT_SIZE = 2048; // same as the buffer of Printf
+        constexpr size_t LOG_BATCH_SIZE = 64 * 1024; // bytes of text to gather before writing them out
+
+        struct log_record {
+            time_t time;
+            ESteamNetworkingSocketsDebugOutputType type;
+            int color;
+            bool file_only;
+            uint16_t length;
+            char text[LOG_TEXT_SIZE];
+        };
+
+        std::atomic<FILE*> log_file = nullptr;
+        std::atomic_bool auto_flush = false;
+        std::atomic<log_overflow_policy> overflow_policy = log_overflow_policy::Block;
+        std::mutex output_mutex; // the log file, stdout and the console
+
+        // Lines per second allowed for one output type, counted in whole-second windows.
+        struct rate_limiter {
+            std::atomic<uint32_t> limit{0}; // 0 = unlimited
+            std::atomic<time_t> window{0};
+            std::atomic<uint32_t> count{0};
+
+            bool allow(time_t now) {
+                const uint32_t max = limit.load(std::memory_order_relaxed);
+                if (max == 0)
+                    return true;
+                time_t current = window.load(std::memory_order_relaxed);
+                if (current != now && window.compare_exchange_strong(current, now, std::memory_order_relaxed))
+                    count.store(0, std::memory_order_relaxed);
+                return count.fetch_add(1, std::memory_order_relaxed) < max;
+            }
+        };
+        rate_limiter rate_limiters[k_ESteamNetworkingSocketsDebugOutputType_Everything + 1];
+
+        // Formats records into whole chunks of text, so that writing them costs
+        // one file write and one console repaint no matter how many there are.
+        class output_batch {
+            std::string file_text_, console_text_;
+            time_t last_time_ = -1;
+            char time_str_[15]{};
+
+            const char* format_time(time_t time) {
+                if (time != last_time_) {
+                    std::strftime(time_str_, sizeof(time_str_), "%m-%d %T", std::localtime(&time));
+                    last_time_ = time;
+                }
+                return time_str_;
+            }
+
+        public:
+            size_t size() const { return file_text_.size() + console_text_.size(); }
+
+            void add(const log_record& record) {
+                add(record.time, {record.text, record.length}, record.color, record.file_only);
+            }
+
+            void add(time_t time, std::string_view text, int ansiColor = bmmo::ansi::Reset, bool file_only = false) {
+                const char* time_str = format_time(time);
+                if (log_file.load(std::memory_order_relaxed)) {
+                    file_text_.append("[").append(time_str).append("] ").append(text).append("\n");
+                }
+                if (file_only)
+                    return;
+                if (!isatty(fileno(stdout))) {
+                    console_text_.append("[").append(time_str).append("] ").append(text).append("\n");
+                }
+#ifdef _WIN32
+                else if (LOWER_THAN_WIN10) {
+                    console_text_.append("\r[").append(time_str).append("] ")
+                                 .append(bmmo::string_utils::utf8_to_ansi(std::string{text})).append("\n");
+                }
+#endif
+                else if (ansiColor == bmmo::ansi::Reset) {
+                    console_text_.append("\r[").append(time_str).append("] ").append(text).append("\n");
+                } else {
+                    console_text_.append("\r[").append(time_str).append("] ")
+                                 .append(bmmo::ansi::get_escape_code(ansiColor)).append(text).append("\033[m\n");
+                }
+            }
+
+            void write() {
+                std::lock_guard lk(output_mutex);
+                if (FILE* file = log_file.load(std::memory_order_relaxed); file && !file_text_.empty()) {
+                    fwrite(file_text_.data(), 1, file_text_.size(), file);
+                    if (auto_flush.load(std::memory_order_relaxed)) fflush(file);
+                }
+                if (!console_text_.empty()) {
+                    if (!isatty(fileno(stdout)))
+                        fwrite(console_text_.data(), 1, console_text_.size(), stdout);
+#ifdef _WIN32
+                    else if (LOWER_THAN_WIN10) {
+                        console_text_.append("> ");
+                        fwrite(console_text_.data(), 1, console_text_.size(), stdout);
+                    }
+#endif
+                    else
+                        replxx_instance.print("%s", console_text_.c_str());
+                    fflush(stdout);
+                }
+                file_text_.clear();
+                console_text_.clear();
+            }
+        };
+
+        // Once started, callers only format and enqueue a record; a background
+        // thread writes them out in batches. Before the thread is started (or if it
+        // never is, as in the client mod) and after it is stopped at exit, records
+        // are written on the calling thread instead.
+        class log_writer {
+            std::unique_ptr<bounded_queue<log_record, LOG_QUEUE_CAPACITY>> queue_; // only allocated by start()
+            std::atomic_bool running_ = false, stopping_ = false;
+            std::atomic<uint32_t> pushers_ = 0; // callers of log() that may still push to the queue
+            std::atomic<uint32_t> signal_ = 0; // set when there's something new for the writer
+            std::atomic<uint64_t> pushed_ = 0, written_ = 0;
+            std::atomic<uint32_t> dropped_ = 0, suppressed_ = 0;
+            std::thread thread_;
+
+            static void fill(log_record& record, time_t time, ESteamNetworkingSocketsDebugOutputType eType,
+                             const char* pszMsg, int ansiColor, bool file_only) {
+                record.time = time;
+                record.type = eType;
+                record.color = ansiColor;
+                record.file_only = file_only;
+                record.length = static_cast<uint16_t>(strnlen(pszMsg, sizeof(record.text)));
+                std::memcpy(record.text, pszMsg, record.length);
+            }
+
+            void wake() {
+                if (signal_.exchange(1, std::memory_order_acq_rel) == 0)
+                    signal_.notify_one();
+            }
+
+            // Writer thread (or the thread that stopped it) only.
+            void drain(output_batch& batch) {
+                uint64_t count = 0;
+                if (auto dropped = dropped_.exchange(0, std::memory_order_relaxed))
+                    batch.add(std::time(nullptr), std::to_string(dropped) + " log line(s) dropped; the log queue was full.");
+                if (auto suppressed = suppressed_.exchange(0, std::memory_order_relaxed))
+                    batch.add(std::time(nullptr), std::to_string(suppressed) + " log line(s) suppressed by rate limits.");
+                while (queue_->try_pop([&batch](log_record& record) { batch.add(record); })) {
+                    ++count;
+                    if (batch.size() >= LOG_BATCH_SIZE)
+                        batch.write();
+                }
+                if (batch.size() > 0)
+                    batch.write();
+                if (count > 0) {
+                    written_.fetch_add(count, std::memory_order_release);
+                    written_.notify_all();
+                }
+            }
+
+            void run() {
+                output_batch batch;
+                while (!stopping_.load(std::memory_order_acquire)) {
+                    signal_.store(0, std::memory_order_release);
+                    drain(batch);
+                    signal_.wait(0, std::memory_order_acquire);
+                }
+                drain(batch);
+            }
+
+            // Returns false if the writer isn't running; the caller has to write the record itself then.
+            // stop() waits for us before its final drain, so nothing we push is left behind.
+            bool push(time_t now, ESteamNetworkingSocketsDebugOutputType eType,
+                      const char* pszMsg, int ansiColor, bool file_only) {
+                pushers_.fetch_add(1);
+                const bool running = running_.load();
+                while (running) {
+                    const uint64_t written = written_.load(std::memory_order_acquire);
+                    if (queue_->try_push([&](log_record& record) { fill(record, now, eType, pszMsg, ansiColor, file_only); })) {
+                        pushed_.fetch_add(1, std::memory_order_release);
+                        wake();
+                        break;
+                    }
+                    if (overflow_policy.load(std::memory_order_relaxed) == log_overflow_policy::Drop) {
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    // sleep until the writer has taken something out; the queue is full, so it will
+                    wake();
+                    written_.wait(written, std::memory_order_acquire);
+                }
+                if (pushers_.fetch_sub(1) == 1 && !running_.load())
+                    pushers_.notify_all();
+                return running;
+            }
+
+        public:
+            static log_writer& instance() {
+                static log_writer* writer = new log_writer; // never freed; we may still get output while exiting
+                return *writer;
+            }
+
+            void start() {
+                if (thread_.joinable())
+                    return;
+                queue_ = std::make_unique<bounded_queue<log_record, LOG_QUEUE_CAPACITY>>();
+                thread_ = std::thread([this] { run(); });
+                running_.store(true, std::memory_order_release);
+                std::atexit([] { instance().stop(); });
+            }
+
+            void log(ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg, int ansiColor, bool file_only) {
+                const time_t now = std::time(nullptr);
+                if (!rate_limiters[std::clamp<int>(eType, 0, std::size(rate_limiters) - 1)].allow(now)) {
+                    suppressed_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                if (push(now, eType, pszMsg, ansiColor, file_only))
+                    return;
+                log_record record;
+                fill(record, now, eType, pszMsg, ansiColor, file_only);
+                output_batch batch;
+                batch.add(record);
+                batch.write();
+            }
+
+            // Waits until everything logged before the call has been written out.
+            void sync() {
+                if (!running_.load(std::memory_order_acquire) || std::this_thread::get_id() == thread_.get_id())
+                    return;
+                const uint64_t target = pushed_.load(std::memory_order_acquire);
+                wake();
+                for (uint64_t written; (written = written_.load(std::memory_order_acquire)) < target;)
+                    written_.wait(written, std::memory_order_acquire);
+            }
+
+            void stop() {
+                if (!running_.exchange(false))
+                    return;
+                // from here on, new records are written synchronously; wait for the ones still being pushed
+                for (uint32_t pushers; (pushers = pushers_.load()) != 0;)
+                    pushers_.wait(pushers);
+                stopping_.store(true, std::memory_order_release);
+                wake();
+                thread_.join(); // its last drain gets everything; nobody pushes anymore
+            }
+        };
+    }
+
+    void start_log_writer() {
+        log_writer::instance().start();
     }
 
-    void set_log_file(FILE* file) { log_file = file; }
+    void set_log_file(FILE* file) {
+        std::lock_guard lk(output_mutex);
+        log_file = file;
+    }
+
+    void set_log_overflow_policy(log_overflow_policy policy) {
+        overflow_policy = policy;
+    }
+
+    void set_log_rate_limit(ESteamNetworkingSocketsDebugOutputType eType, uint32_t lines_per_second) {
+        if (eType <= k_ESteamNetworkingSocketsDebugOutputType_Bug || eType >= std::ssize(rate_limiters))
+            return; // bugs are fatal; we always want to see them
+        rate_limiters[eType].limit = lines_per_second;
+    }
 
     void LogFileOutput(const char* pMsg) {
-        if (!log_file)
+        if (!log_file.load(std::memory_order_relaxed))
             return;
-        auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        char timeStr[15];
-        std::strftime(timeStr, sizeof(timeStr), "%m-%d %T", std::localtime(&time));
-        fprintf(log_file, "[%s] %s\n", timeStr, pMsg);
-        // fflush(log);
+        log_writer::instance().log(k_ESteamNetworkingSocketsDebugOutputType_Important, pMsg, bmmo::ansi::Reset, true);
     }
 
     void RightTrim(char* text) {
@@ -63,43 +324,25 @@ namespace bmmo {
     }
  
     void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg, int ansiColor) {
-        using namespace std;
-        // SteamNetworkingMicroseconds time = SteamNetworkingUtils()->GetLocalTimestamp() - init_timestamp_;
-        auto time = chrono::system_clock::to_time_t(chrono::system_clock::now());
-        char timeStr[15];
-        strftime(timeStr, sizeof(timeStr), "%m-%d %T", localtime(&time));
-
-        if (log_file) {
-            fprintf(log_file, "[%s] %s\n", timeStr, pszMsg);
-            if (auto_flush) fflush(log_file);
-        }
-
         if (eType == k_ESteamNetworkingSocketsDebugOutputType_Bug) {
-            fprintf(stderr, "\r[%s] %s\n> ", timeStr, pszMsg);
-            fflush(stdout);
-            fflush(stderr);
-            if (log_file) fflush(log_file);
+            // we're about to exit; write out everything before this synchronously
+            log_writer::instance().sync();
+            {
+                std::lock_guard lk(output_mutex);
+                auto time = std::time(nullptr);
+                char timeStr[15];
+                std::strftime(timeStr, sizeof(timeStr), "%m-%d %T", std::localtime(&time));
+                if (FILE* file = log_file.load()) {
+                    fprintf(file, "[%s] %s\n", timeStr, pszMsg);
+                    fflush(file);
+                }
+                fprintf(stderr, "\r[%s] %s\n> ", timeStr, pszMsg);
+                fflush(stdout);
+                fflush(stderr);
+            }
             return exit(2);
         }
-        else if (!isatty(fileno(stdout))) {
-            printf("[%s] %s\n", timeStr, pszMsg);
-        }
-#ifdef _WIN32
-        else if (LOWER_THAN_WIN10) {
-            printf("\r[%s] %s\n> ", timeStr, bmmo::string_utils::utf8_to_ansi(pszMsg).c_str());
-        }
-#endif
-        else {
-            // printf("\r%10.2f %s\n> ", time * 1e-6, pszMsg);
-            // bmmo::replxx_instance.invoke(replxx::Replxx::ACTION::CLEAR_SELF, '\0');
-            if (ansiColor == bmmo::ansi::Reset)
-                replxx_instance.print("\r[%s] %s\n", timeStr, pszMsg);
-            else
-                replxx_instance.print("\r[%s] %s%s\033[m\n", timeStr,
-                                      bmmo::ansi::get_escape_code(ansiColor).c_str(), pszMsg);
-        }
-        fflush(stdout);
-        // bmmo::replxx_instance.invoke(replxx::Replxx::ACTION::REPAINT, '\0');
+        log_writer::instance().log(eType, pszMsg, ansiColor, false);
     }
 
     void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType, const char* pszMsg) {
@@ -110,15 +353,29 @@ namespace bmmo {
         auto_flush = flush;
     }
 
+    void sync_log() {
+        log_writer::instance().sync();
+    }
+
     void flush_log() {
         if (!log_file) return;
-        if (fflush(log_file) == 0)
+        sync_log();
+        int result;
+        {
+            std::lock_guard lk(output_mutex);
+            FILE* file = log_file.load();
+            if (!file) return;
+            result = fflush(file);
+        }
+        if (result == 0)
             Printf("Log file flushed successfully.");
     }
 
     void close_log() {
         if (!log_file) return;
-        fclose(log_file);
-        log_file = nullptr;
+        sync_log();
+        std::lock_guard lk(output_mutex);
+        if (FILE* file = log_file.exchange(nullptr))
+            fclose(file);
     }
 }
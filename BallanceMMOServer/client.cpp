@@ -43,6 +43,7 @@ static struct option_t {
     std::string server_addr = "127.0.0.1:26676", username = "MockClient",
                 uuid = "00010002-0003-0004-0005-000600070008", log_path;
     bool print_states = false, recorder_mode = false, individual_packets = false, save_sound_files = true;
+    bool delta_ball_states = true;
     ESteamNetworkingSocketsDebugOutputType detail = k_ESteamNetworkingSocketsDebugOutputType_Important;
 } options;
 
@@ -102,13 +103,14 @@ public:
                 case 1: return bmmo::console::instance->get_command_hints(false, args[0].c_str());
             }
             std::vector<std::string> player_hints;
-            player_hints.reserve(clients_.size());
-            bool hint_client_id = (args[args.size() - 1].starts_with('#'));
-            for (const auto& [id, data]: clients_) {
-                if (hint_client_id)
+            const auto& last_word = args[args.size() - 1];
+            if (last_word.starts_with('#')) {
+                player_hints.reserve(clients_.size());
+                for (const auto& [id, _]: clients_)
                     player_hints.emplace_back('#' + std::to_string(id));
-                else
-                    player_hints.emplace_back(data.name);
+            } else {
+                for (const auto* entry: names_.find_prefix(last_word))
+                    player_hints.emplace_back(entry->name);
             }
             return player_hints;
         });
@@ -126,7 +128,7 @@ public:
 //        }
     }
 
-    EResult send(void* buffer, size_t size, int send_flags, int64* out_message_number = nullptr) {
+    EResult send(const void* buffer, size_t size, int send_flags, int64* out_message_number = nullptr) {
         return interface_->SendMessageToConnection(connection_,
                                                    buffer,
                                                    size,
@@ -178,6 +180,16 @@ public:
         return local_state_msg_;
     }
 
+    // `word` is either an id, optionally prefixed with '#', or a name,
+    // which may be shortened as long as it's unambiguous.
+    HSteamNetConnection get_player_id(const std::string& word) const {
+        if (word.starts_with('#'))
+            return HSteamNetConnection(std::atoll(word.c_str() + 1));
+        if (const auto* entry = names_.find_unique(word))
+            return entry->value;
+        return HSteamNetConnection(std::atoll(word.c_str()));
+    }
+
     std::string get_player_name(HSteamNetConnection player_id) const {
         if (player_id == k_HSteamNetConnection_Invalid) return "[Server]";
         if (auto it = clients_.find(player_id); it != clients_.end())
@@ -190,23 +202,25 @@ public:
         Printf(bmmo::color_code(bmmo::PermanentNotification), "[Bulletin] %s", permanent_notification_text_);
     }
 
+    // Players sorted by name.
+    template <typename Function>
+    void for_each_player(Function&& f) const {
+        names_.for_each([&](const auto& entry) {
+            if (auto it = clients_.find(entry.value); it != clients_.end())
+                f(it->first, it->second);
+        });
+    }
+
     void print_clients() {
-        decltype(clients_) spectators;
-        std::vector<std::pair<HSteamNetConnection, client_data>> players;
+        std::vector<std::pair<HSteamNetConnection, const client_data*>> players, spectators;
         players.reserve(clients_.size());
         auto print_client = [&](auto i) {
             Printf("%u: %s%s  %4dms",
-                    i.first, i.second.name, i.second.cheated ? " [CHEAT]" : "", i.second.ping);
+                    i.first, i.second->name, i.second->cheated ? " [CHEAT]" : "", i.second->ping);
         };
-        for (const auto& i: clients_) {
-            if (bmmo::name_validator::is_spectator(i.second.name)) {
-                spectators.insert(i);
-                continue;
-            }
-            players.emplace_back(i);
-        }
-        std::sort(players.begin(), players.end(), [](const auto& i1, const auto& i2)
-            { return bmmo::message_utils::to_lower(i1.second.name) < bmmo::message_utils::to_lower(i2.second.name); });
+        for_each_player([&](HSteamNetConnection id, const client_data& data) {
+            (bmmo::name_validator::is_spectator(data.name) ? spectators : players).emplace_back(id, &data);
+        });
         for (const auto& i: spectators) print_client(i);
         for (const auto& i: players) print_client(i);
         Printf("%d client(s) online: %d player(s), %d spectator(s).",
@@ -214,17 +228,12 @@ public:
     }
 
     void print_player_maps() {
-        std::vector<std::pair<HSteamNetConnection, client_data>> players;
-        players.reserve(clients_.size());
-        for (const auto& i: clients_)
-            players.emplace_back(i);
-        std::sort(players.begin(), players.end(), [](const auto& i1, const auto& i2)
-            { return bmmo::message_utils::to_lower(i1.second.name) < bmmo::message_utils::to_lower(i2.second.name); });
-        for (const auto& [id, data]: players)
+        for_each_player([this](HSteamNetConnection id, const client_data& data) {
             Printf("%s(#%u, %s) is at the %d%s sector of %s.",
                 data.cheated ? "[CHEAT] " : "", id, data.name,
                 data.current_sector, bmmo::string_utils::get_ordinal_suffix(data.current_sector),
                 data.current_map.get_display_name(map_names_));
+        });
     }
 
     void print_maps() {
@@ -232,31 +241,25 @@ public:
         for (const auto& [hash, name]: map_names_) map_names_inverted.emplace(name, hash);
         for (const auto& [name, hash]: map_names_inverted) {
             std::string hash_string;
-            bmmo::string_from_hex_chars(hash_string, reinterpret_cast<const uint8_t*>(hash.c_str()), sizeof(bmmo::map::md5));
+            bmmo::string_from_hex_chars(hash_string, hash.md5, sizeof(hash.md5));
             Printf("%s: %s", hash_string, name);
         }
     }
 
     void print_positions() {
-        std::vector<std::pair<HSteamNetConnection, client_data>> players;
-        players.reserve(clients_.size());
-        for (const auto& i: clients_)
-            players.emplace_back(i);
-        std::sort(players.begin(), players.end(), [](const auto& i1, const auto& i2)
-            { return bmmo::message_utils::to_lower(i1.second.name) < bmmo::message_utils::to_lower(i2.second.name); });
-        for (const auto& [id, data]: players) {
+        for_each_player([](HSteamNetConnection id, const client_data& data) {
             Printf("(%u, %s) is at %.2f, %.2f, %.2f with %s ball.",
                     id, data.name,
                     data.state.position.x, data.state.position.y, data.state.position.z,
                     data.state.get_type_name()
             );
-        }
+        });
     }
 
     void set_nickname(const std::string& name) { nickname_ = name; };
     void set_own_map(const bmmo::map& current_map, const std::string& map_name = "") {
         clients_[own_id_].current_map = current_map;
-        if (!map_name.empty()) map_names_.try_emplace(current_map.get_hash_bytes_string(), map_name);
+        if (!map_name.empty()) map_names_.try_emplace(current_map.key(), map_name);
     }
     void set_print_states(bool print_states) { print_states_ = print_states; }
     void set_own_sector(const int32_t sector) { clients_[own_id_].current_sector = sector; }
@@ -312,7 +315,7 @@ public:
             msg.player_id = player_id;
             msg.chat_content = message;
             msg.serialize();
-            send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
             Printf(bmmo::color_code(msg.code), "Whispered to (%u, %s): %s",
                     player_id, get_player_name(player_id), message);
         }
@@ -391,14 +394,22 @@ private:
             case k_ESteamNetworkingConnectionState_Connected: {
                 Printf("Connected to server OK\n");
                 //bmmo::login_request_msg msg;
+                // V3 with capability groups, so that servers which predate them still let us in
                 bmmo::login_request_v3_msg msg;
                 msg.version = bmmo::current_version;
                 msg.nickname = nickname_;
                 msg.cheated = 0;
                 memcpy(msg.uuid, uuid_, sizeof(uuid_));
+                // recordings are replayed without a server to acknowledge to, so keep them self-contained
+                if (!recorder_mode_) {
+                    msg.capability_groups.encodings = bmmo::capability::QuantizedBallState;
+                    if (options.delta_ball_states)
+                        msg.capability_groups.encodings |= bmmo::capability::DeltaBallState;
+                    msg.capabilities = msg.capability_groups.encodings;
+                }
                 // msg.version = bmmo::version_t{1, 0, 0, bmmo::Alpha, 0};
                 msg.serialize();
-                send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+                send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
                 break;
             }
             default:
@@ -421,21 +432,25 @@ private:
         }
 
         switch (raw_msg->code) {
-            case bmmo::LoginAcceptedV3: {
-                bmmo::login_accepted_v3_msg msg{};
-                msg.raw.write(reinterpret_cast<char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
+            case bmmo::LoginAcceptedV3:
+            case bmmo::LoginAcceptedV4: {
+                auto msg = (raw_msg->code == bmmo::LoginAcceptedV3)
+                        ? bmmo::login_accepted_v4_msg::from(bmmo::message_utils::deserialize<bmmo::login_accepted_v3_msg>(networking_msg))
+                        : bmmo::message_utils::deserialize<bmmo::login_accepted_v4_msg>(networking_msg);
                 clients_.clear();
+                names_.clear();
+                delta_decoder_.reset();
                 Printf(bmmo::color_code(msg.code), "%d player(s) online:", msg.online_players.size());
                 for (const auto& [id, data]: msg.online_players) {
                     if (data.name == nickname_) own_id_ = id;
                     Printf("%s (#%u)%s", data.name, id, (data.cheated ? " [CHEAT]" : ""));
                     clients_.insert({ id, { data.name, (bool) data.cheated, {}, {}, data.map, data.sector } });
+                    names_.insert_or_assign(data.name, id);
                 }
                 bmmo::plain_text_msg text_msg{};
                 text_msg.text_content = "Using Mock Client.";
                 text_msg.serialize();
-                send(text_msg.raw.str().data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
+                send(text_msg.data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
                 break;
             }
             case bmmo::PlayerConnectedV2: {
@@ -445,12 +460,14 @@ private:
                 Printf(bmmo::color_code(msg.code), "%s (#%u) logged in with cheat mode %s.",
                         msg.name.c_str(), msg.connection_id, (msg.cheated ? "on" : "off"));
                 clients_[msg.connection_id] = { msg.name, (bool) msg.cheated };
+                names_.insert_or_assign(msg.name, msg.connection_id);
                 break;
             }
             case bmmo::PlayerDisconnected: {
                 auto* msg = reinterpret_cast<bmmo::player_disconnected_msg*>(networking_msg->m_pData);
                 if (auto it = clients_.find(msg->content.connection_id); it != clients_.end()) {
                     Printf(bmmo::color_code(msg->code), "%s (#%u) disconnected.", it->second.name, it->first);
+                    names_.erase(it->second.name);
                     clients_.erase(it);
                 }
                 break;
@@ -491,18 +508,24 @@ private:
                 bmmo::owned_compressed_ball_state_msg msg;
                 msg.raw.write(reinterpret_cast<char*>(networking_msg->m_pData), networking_msg->m_cbSize);
                 msg.deserialize();
-
-                for (auto& ball : msg.balls) {
-                    if (print_states_)
-                        Printf("%u: %d, (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f, %.2f), %ld",
-                            ball.player_id,
-                            ball.state.type,
-                            ball.state.position.x, ball.state.position.y, ball.state.position.z,
-                            ball.state.rotation.x, ball.state.rotation.y, ball.state.rotation.z, ball.state.rotation.w,
-                            int64_t(ball.state.timestamp));
-                    clients_[ball.player_id].state = ball.state;
-                }
-
+                update_ball_states(msg.balls);
+                break;
+            }
+            case bmmo::OwnedQuantizedBallState: {
+                bmmo::owned_quantized_ball_state_msg msg;
+                msg.raw.write(reinterpret_cast<char*>(networking_msg->m_pData), networking_msg->m_cbSize);
+                if (msg.deserialize())
+                    update_ball_states(msg.balls);
+                break;
+            }
+            case bmmo::OwnedDeltaBallState: {
+                bmmo::owned_delta_ball_state_msg msg;
+                msg.raw.write(reinterpret_cast<char*>(networking_msg->m_pData), networking_msg->m_cbSize);
+                std::vector<bmmo::owned_timed_ball_state> balls;
+                if (!msg.deserialize() || !delta_decoder_.decode(msg, balls))
+                    break;
+                send(bmmo::ball_state_ack_msg{.content = msg.sequence}, k_nSteamNetworkingSend_UnreliableNoDelay);
+                update_ball_states(balls);
                 break;
             }
             case bmmo::OwnedCheatState: {
@@ -642,7 +665,7 @@ private:
                         {ct::Go, "Go!"}, {ct::Countdown_1, "1"}, {ct::Countdown_2, "2"}, {ct::Countdown_3, "3"}
                     }[msg->content.type]);
                 if (msg->content.type == ct::Go)
-                    local_rankings_[last_countdown_map_.get_hash_bytes_string()] = {};
+                    local_rankings_[last_countdown_map_.key()] = {};
                 break;
             }
             case bmmo::CurrentMap: {
@@ -667,7 +690,7 @@ private:
                     msg->content.map.get_display_name(map_names_),
                     msg->content.sector
                 );
-                local_rankings_[msg->content.map.get_hash_bytes_string()].second.push_back({
+                local_rankings_[msg->content.map.key()].second.push_back({
                     {(bool)msg->content.cheated, player_name}, msg->content.sector});
                 break;
             }
@@ -690,7 +713,7 @@ private:
                     msg->content.map.get_display_name(map_names_), get_level_mode_label(msg->content.mode),
                     msg->content.rank, bmmo::string_utils::get_ordinal_suffix(msg->content.rank),
                     formatted_score, msg->content.get_formatted_time());
-                local_rankings_[msg->content.map.get_hash_bytes_string()].first.push_back({
+                local_rankings_[msg->content.map.key()].first.push_back({
                     {(bool)msg->content.cheated, player_name}, msg->content.mode,
                     msg->content.rank, msg->content.timeElapsed, formatted_score});
                 break;
@@ -806,6 +829,19 @@ private:
         return msg_count;
     }
 
+    void update_ball_states(const std::vector<bmmo::owned_timed_ball_state>& balls) {
+        for (const auto& ball : balls) {
+            if (print_states_)
+                Printf("%u: %d, (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f, %.2f), %ld",
+                    ball.player_id,
+                    ball.state.type,
+                    ball.state.position.x, ball.state.position.y, ball.state.position.z,
+                    ball.state.rotation.x, ball.state.rotation.y, ball.state.rotation.z, ball.state.rotation.w,
+                    int64_t(ball.state.timestamp));
+            clients_[ball.player_id].state = ball.state;
+        }
+    }
+
     void enqueue_log_message(const ISteamNetworkingMessage* msg) {
         bmmo::record_entry entry(SteamNetworkingUtils()->GetLocalTimestamp(), msg->m_cbSize, reinterpret_cast<std::byte*>(msg->m_pData));
 
@@ -851,17 +887,19 @@ private:
     std::string nickname_;
     uint8_t uuid_[16]{};
     std::unordered_map<HSteamNetConnection, client_data> clients_;
-    std::unordered_map<std::string, std::string> map_names_;
+    bmmo::name_index<HSteamNetConnection> names_; // of `clients_`
+    bmmo::map_name_table map_names_;
     std::string permanent_notification_text_;
     bmmo::map last_countdown_map_{};
     bmmo::ranking_entry::map_rankings local_rankings_{};
     bmmo::timed_ball_state_msg local_state_msg_{};
+    bmmo::ball_delta_decoder delta_decoder_;
     std::atomic_bool print_states_ = false, recorder_mode_ = false;
 };
 
 // parse command line arguments (server/name/uuid/help/version) with getopt
 int parse_args(int argc, char** argv) {
-    enum option_values { NoSoundFiles = UINT8_MAX + 1, AutoFlush, IndividualPackets };
+    enum option_values { NoSoundFiles = UINT8_MAX + 1, AutoFlush, IndividualPackets, NoDelta };
     static struct option long_options[] = {
         {"recorder-mode", required_argument, 0, 'r'},
         {"server", required_argument, 0, 's'},
@@ -875,6 +913,7 @@ int parse_args(int argc, char** argv) {
         {"no-sound-files", no_argument, 0, NoSoundFiles},
         {"auto-flush", no_argument, 0, AutoFlush},
         {"individual-packets", no_argument, 0, IndividualPackets},
+        {"no-delta", no_argument, 0, NoDelta},
         {0, 0, 0, 0}
     };
     int opt, opt_index = 0;
@@ -904,6 +943,8 @@ int parse_args(int argc, char** argv) {
                 bmmo::set_auto_flush_log(true); break;
             case IndividualPackets:
                 options.individual_packets = true; break;
+            case NoDelta:
+                options.delta_ball_states = false; break;
             case 'h':
                 printf("Usage: %s [OPTION]...\n", argv[0]);
                 puts("Options:");
@@ -917,6 +958,7 @@ int parse_args(int argc, char** argv) {
                 puts("      --individual-packets  Record and save each packet individually. Requires --recorder-mode.");
                 puts("                            Use carefully as it may generate a large number of files.");
                 puts("      --no-sound-files\t Discard sound files sent by the server.");
+                puts("      --no-delta\t\t Don't ask for delta ball states (quantized ones are used instead).");
                 puts("  -p, --print\t\t Print player state changes.");
                 puts("  -h, --help\t\t Display this help and exit.");
                 puts("  -v, --version\t\t Display version information and exit.");
@@ -1062,14 +1104,14 @@ int main(int argc, char** argv) {
         options.print_states = !options.print_states;
         client.set_print_states(options.print_states);
     });
-    console.register_command("teleport", [&] { client.teleport_to(console.get_next_client_id()); });
+    console.register_command("teleport", [&] { client.teleport_to(client.get_player_id(console.get_next_word())); });
     console.register_command("balltype", [&] {
         auto& msg = client.get_local_state_msg();
         msg.content.type = console.get_next_int();
         client.send(msg, k_nSteamNetworkingSend_Reliable);
     });
     console.register_command("whisper", [&] {
-        HSteamNetConnection dest = console.get_next_client_id();
+        HSteamNetConnection dest = client.get_player_id(console.get_next_word());
         client.whisper_to(dest, console.get_rest_of_line());
     });
     console.register_command("getmap", [&] { client.print_player_maps(); });
@@ -1078,9 +1120,9 @@ int main(int argc, char** argv) {
         auto input_map = console.get_next_map(with_name);
         if (with_name && !input_map.name.empty()) {
             bmmo::map_names_msg name_msg{};
-            name_msg.maps.emplace(input_map.get_hash_bytes_string(), input_map.name);
+            name_msg.maps.emplace(input_map.key(), input_map.name);
             name_msg.serialize();
-            client.send(name_msg.raw.str().data(), name_msg.size(), k_nSteamNetworkingSend_Reliable);
+            client.send(name_msg.data(), name_msg.size(), k_nSteamNetworkingSend_Reliable);
         }
         return input_map;
     };
@@ -1112,7 +1154,7 @@ int main(int argc, char** argv) {
         msg.chat_content = console.get_rest_of_line();
         msg.type = (console.get_command_name() == "notice") ? in_msg::Notice : in_msg::Announcement;
         msg.serialize();
-        client.send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        client.send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
     });
     console.register_aliases("announce", {"notice"});
     console.register_command("kick", [&] {
@@ -1124,14 +1166,14 @@ int main(int argc, char** argv) {
         else msg.player_name = name;
         msg.reason = console.get_rest_of_line();
         msg.serialize();
-        client.send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        client.send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
     });
     console.register_aliases("kick", {"crash"});
     console.register_command("say", [&] {
         bmmo::chat_msg msg{};
         msg.chat_content = console.get_rest_of_line();
         msg.serialize();
-        client.send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        client.send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
     });
     console.register_aliases("say", {"s"});
     console.register_command("getpos", [&] { client.print_positions(); });
@@ -1170,7 +1212,7 @@ int main(int argc, char** argv) {
         bmmo::permanent_notification_msg msg{};
         msg.text_content = console.get_rest_of_line();
         msg.serialize();
-        client.send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        client.send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
     });
     console.register_command("getbulletin", [&] { client.print_bulletin(); });
     console.register_command("scores", [&] {
@@ -1187,20 +1229,20 @@ int main(int argc, char** argv) {
         msg.mode = (mode == "hs") ? bmmo::level_mode::Highscore : bmmo::level_mode::Speedrun;
         if (!use_local_data) {
             msg.serialize();
-            client.send(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            client.send(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
             return;
         }
         auto& rankings = client.get_local_rankings();
-        auto ranks_it = rankings.find(msg.map.get_hash_bytes_string());
+        auto ranks_it = rankings.find(msg.map.key());
         if (ranks_it == rankings.end() || (ranks_it->second.first.empty() && ranks_it->second.second.empty())) {
             Printf(bmmo::ansi::BrightRed, "Error: ranking info not found for the specified map.");
             return;
         }
         msg.serialize(ranks_it->second);
-        client.receive(msg.raw.str().data(), msg.size());
+        client.receive(msg.raw.data(), msg.size());
     });
     console.register_command("restartlevel", [&] {
-        bmmo::restart_request_msg msg{.content = {.victim = console.get_next_client_id()}};
+        bmmo::restart_request_msg msg{.content = {.victim = client.get_player_id(console.get_next_word())}};
         client.send(msg, k_nSteamNetworkingSend_Reliable);
     });
     console.register_command("flushlog", bmmo::flush_log);
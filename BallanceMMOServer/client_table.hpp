@@ -0,0 +1,210 @@
+#ifndef BALLANCEMMOSERVER_CLIENT_TABLE_HPP
+#define BALLANCEMMOSERVER_CLIENT_TABLE_HPP
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../BallanceMMOCommon/common.hpp"
+
+// Clients stored densely by index, with a lookup from their connection handles.
+// Ball states and when they last changed are kept in arrays of their own, apart from the
+// rest of the client data, so that they can be copied or scanned as a whole instead of
+// chasing hash map nodes. Removing a client moves the last one into its place.
+//
+// Iterating and the lookups work like with an `unordered_map<HSteamNetConnection, Data>`,
+// and so do references and iterators, which stay valid until their own client is erased.
+// Dense indices however change when other clients are erased, so they're only meant to be
+// kept for as long as nobody can insert or erase.
+template <typename Data, typename Room>
+class client_table {
+public:
+    using key_type = HSteamNetConnection;
+    using mapped_type = Data;
+    using value_type = std::pair<const key_type, Data>;
+    using size_type = size_t;
+    static constexpr size_t npos = size_t(-1);
+
+private:
+    struct node {
+        value_type value;
+        size_t index;
+    };
+
+    template <bool Const>
+    class basic_iterator {
+        friend class client_table;
+        using table_type = std::conditional_t<Const, const client_table, client_table>;
+
+        table_type* table_ = nullptr;
+        node* node_ = nullptr; // nullptr at the end
+
+        basic_iterator(table_type* table, node* n): table_(table), node_(n) {}
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = client_table::value_type;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        basic_iterator() = default;
+        template <bool OtherConst> requires (Const && !OtherConst)
+        basic_iterator(const basic_iterator<OtherConst>& other): table_(other.table_), node_(other.node_) {}
+
+        reference operator*() const { return node_->value; }
+        pointer operator->() const { return &node_->value; }
+
+        // Dense index of the client this points to.
+        size_t index() const { return node_->index; }
+
+        basic_iterator& operator++() {
+            const size_t next = node_->index + 1;
+            node_ = (next < table_->nodes_.size()) ? table_->nodes_[next].get() : nullptr;
+            return *this;
+        }
+        basic_iterator operator++(int) { auto it = *this; ++*this; return it; }
+
+        template <bool OtherConst>
+        bool operator==(const basic_iterator<OtherConst>& other) const { return node_ == other.node_; }
+    };
+
+public:
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    client_table() = default;
+    client_table(const client_table&) = delete;
+    client_table& operator=(const client_table&) = delete;
+
+    iterator begin() { return {this, first_node()}; }
+    iterator end() { return {this, nullptr}; }
+    const_iterator begin() const { return {this, first_node()}; }
+    const_iterator end() const { return {this, nullptr}; }
+
+    size_t size() const { return nodes_.size(); }
+    bool empty() const { return nodes_.empty(); }
+
+    // Dense index of `id`, or `npos` if it isn't here.
+    size_t index_of(key_type id) const {
+        auto it = indices_.find(id);
+        return (it == indices_.end()) ? npos : it->second;
+    }
+
+    bool contains(key_type id) const { return indices_.contains(id); }
+
+    iterator find(key_type id) {
+        const size_t index = index_of(id);
+        return {this, (index == npos) ? nullptr : nodes_[index].get()};
+    }
+    const_iterator find(key_type id) const {
+        const size_t index = index_of(id);
+        return {this, (index == npos) ? nullptr : nodes_[index].get()};
+    }
+
+    Data& at(key_type id) { return nodes_[checked_index_of(id)]->value.second; }
+    const Data& at(key_type id) const { return nodes_[checked_index_of(id)]->value.second; }
+
+    Data& operator[](key_type id) {
+        if (const size_t index = index_of(id); index != npos)
+            return nodes_[index]->value.second;
+        return insert({id, Data{}}).first->second;
+    }
+
+    // New clients start in no room with an empty ball state that hasn't changed.
+    std::pair<iterator, bool> insert(value_type&& value) {
+        if (auto it = find(value.first); it != end())
+            return {it, false};
+        const size_t index = nodes_.size();
+        auto new_node = std::make_unique<node>(node{std::move(value), index});
+        indices_.emplace(new_node->value.first, index);
+        nodes_.push_back(std::move(new_node));
+        ids_.push_back(nodes_.back()->value.first);
+        states_.emplace_back();
+        state_serials_.push_back(0);
+        timestamp_serials_.push_back(0);
+        rooms_.push_back(nullptr);
+        return {{this, nodes_.back().get()}, true};
+    }
+
+    // @returns the iterator to the client that took over the erased client's place, or `end()`.
+    iterator erase(const_iterator pos) {
+        const size_t index = pos.index();
+        const size_t last = nodes_.size() - 1;
+        indices_.erase(ids_[index]);
+        if (index != last) {
+            nodes_[index] = std::move(nodes_[last]);
+            nodes_[index]->index = index;
+            indices_[ids_[last]] = index;
+            ids_[index] = ids_[last];
+            states_[index] = states_[last];
+            state_serials_[index] = state_serials_[last];
+            timestamp_serials_[index] = timestamp_serials_[last];
+            rooms_[index] = rooms_[last];
+        }
+        nodes_.pop_back();
+        ids_.pop_back();
+        states_.pop_back();
+        state_serials_.pop_back();
+        timestamp_serials_.pop_back();
+        rooms_.pop_back();
+        return {this, (index < nodes_.size()) ? nodes_[index].get() : nullptr};
+    }
+    iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+    size_t erase(key_type id) {
+        auto it = find(id);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    // Hot data by dense index.
+    key_type id(size_t index) const { return ids_[index]; }
+    Data& data(size_t index) { return nodes_[index]->value.second; }
+    const Data& data(size_t index) const { return nodes_[index]->value.second; }
+    bmmo::timed_ball_state& state(size_t index) { return states_[index]; }
+    const bmmo::timed_ball_state& state(size_t index) const { return states_[index]; }
+    const Room* room(size_t index) const { return rooms_[index]; }
+    void set_room(size_t index, const Room* room) { rooms_[index] = room; }
+
+    // Whole arrays of hot data, by dense index.
+    const std::vector<key_type>& ids() const { return ids_; }
+    const std::vector<bmmo::timed_ball_state>& states() const { return states_; }
+    const std::vector<uint64_t>& state_serials() const { return state_serials_; }
+    const std::vector<uint64_t>& timestamp_serials() const { return timestamp_serials_; }
+
+    // Records that the ball state (`touch_state`) or only its timestamp (`touch_timestamp`)
+    // of a client has changed by giving it a new serial number. Serials only ever grow, so
+    // whoever remembers the newest one it has seen can tell what changed since.
+    void touch_state(size_t index) { state_serials_[index] = ++serial_; }
+    void touch_timestamp(size_t index) { timestamp_serials_[index] = ++serial_; }
+    // The newest serial handed out.
+    uint64_t serial() const { return serial_; }
+
+private:
+    node* first_node() const { return nodes_.empty() ? nullptr : nodes_.front().get(); }
+
+    size_t checked_index_of(key_type id) const {
+        const size_t index = index_of(id);
+        if (index == npos)
+            throw std::out_of_range("client_table::at");
+        return index;
+    }
+
+    std::vector<std::unique_ptr<node>> nodes_; // cold data; nodes never move, so references stay valid
+    std::unordered_map<key_type, size_t> indices_;
+    // hot data, by dense index
+    std::vector<key_type> ids_;
+    std::vector<bmmo::timed_ball_state> states_;
+    std::vector<uint64_t> state_serials_, timestamp_serials_;
+    std::vector<const Room*> rooms_;
+    uint64_t serial_ = 0;
+};
+
+#endif //BALLANCEMMOSERVER_CLIENT_TABLE_HPP
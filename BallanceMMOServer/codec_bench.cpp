@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "utility/ball_state_codec.hpp"
+
+// Times every ball state codec kernel the CPU supports and checks that they all
+// produce exactly what the scalar one does, as the wire format depends on it.
+// Exits with 1 if any of them doesn't, so that it can be run as a build check.
+//
+// usage: BallanceMMOCodecBench [balls]   (default: 1024)
+
+namespace codec = bmmo::ball_state_codec;
+
+int main(int argc, char** argv) {
+    size_t ball_count = 1024;
+    if (argc > 1) {
+        char* end;
+        const long value = std::strtol(argv[1], &end, 10);
+        if (*end != '\0' || value < 1 || value > 65535) {
+            std::fprintf(stderr, "Usage: %s [balls (1-65535)]\n", argv[0]);
+            return 2;
+        }
+        ball_count = size_t(value);
+    }
+
+    bool identical = true;
+    // odd sizes as well, which end with balls left over for the scalar code
+    for (size_t count: {size_t(1), size_t(7), size_t(13), size_t(300)}) {
+        for (const auto& result: codec::run_benchmark(count)) {
+            if (!result.identical) {
+                std::printf("%s output differs from scalar with %zu balls!\n", codec::get_kernel_name(result.k), count);
+                identical = false;
+            }
+        }
+    }
+
+    const auto results = codec::run_benchmark(ball_count);
+    const auto& scalar = results.back();
+    std::printf("Ball state codec benchmark (%zu balls, %s in use):\n",
+                ball_count, codec::get_kernel_name(codec::get_active_kernel()));
+    for (const auto& result: results) {
+        std::printf("  %-6s compress %6.2f ns/ball (%.1fx), decompress %6.2f ns/ball (%.1fx)%s\n",
+                    codec::get_kernel_name(result.k),
+                    result.compress_ns, scalar.compress_ns / result.compress_ns,
+                    result.decompress_ns, scalar.decompress_ns / result.decompress_ns,
+                    result.identical ? "" : " - output differs from scalar!");
+        identical &= result.identical;
+    }
+    return identical ? 0 : 1;
+}
@@ -1,10 +1,13 @@
 #include <fstream>
+#include <map>
+#include <sstream>
 
 #define PICOJSON_USE_INT64
 #include <picojson/picojson.h>
 
 #include "common.hpp"
 #include "config_manager.hpp"
+#include "profiler.hpp"
 #include "utility/misc.hpp"
 
 using bmmo::Printf, bmmo::Sprintf, bmmo::LogFileOutput, bmmo::FatalError;
@@ -17,6 +20,13 @@ namespace {
         node[key] = default_v;
         return default_v;
     }
+
+    // from the hex MD5s used as keys in the config
+    bmmo::map_key parse_map_key(std::string_view hash) {
+        bmmo::map_key key;
+        bmmo::string_utils::hex_chars_from_string(key.md5, hash.substr(0, sizeof(key.md5) * 2));
+        return key;
+    }
 }
 
 bool config_manager::load() {
@@ -40,6 +50,16 @@ bool config_manager::load() {
     log_ball_offs = yaml_load_value(config_, "log_ball_offs", log_ball_offs);
     serious_warning_as_dnf = yaml_load_value(config_, "serious_warning_as_dnf", serious_warning_as_dnf);
     ghost_mode = yaml_load_value(config_, "ghost_mode", ghost_mode);
+    align_tick_phase = yaml_load_value(config_, "align_tick_phase", align_tick_phase);
+    file_save_delay_ms = std::max(yaml_load_value(config_, "file_save_delay_ms", file_save_delay_ms), 0);
+    if (persistence_)
+        persistence_->set_delay(std::chrono::milliseconds(file_save_delay_ms));
+    metrics_file = yaml_load_value(config_, "metrics_file", metrics_file);
+    metrics_interval_s = std::max(yaml_load_value(config_, "metrics_interval_s", metrics_interval_s), 1);
+    profiling = yaml_load_value(config_, "profiling", profiling);
+    slow_tick_budget_ms = std::max(yaml_load_value(config_, "slow_tick_budget_ms", slow_tick_budget_ms), 0.0);
+    quantized_position_bits = std::clamp(yaml_load_value(config_, "quantized_position_bits", quantized_position_bits),
+            bmmo::owned_quantized_ball_state_msg::MIN_POSITION_BITS, bmmo::owned_quantized_ball_state_msg::MAX_POSITION_BITS);
 
     std::string logging_level_string = yaml_load_value(config_, "logging_level", std::string{"important"});
     if (logging_level_string == "msg")
@@ -54,18 +74,14 @@ bool config_manager::load() {
     if (config_["map_name_list"]) {
         default_map_names.clear();
         for (const auto& element: config_["map_name_list"]) {
-            std::string hash(sizeof(bmmo::map::md5), 0);
-            bmmo::string_utils::hex_chars_from_string(reinterpret_cast<uint8_t*>(hash.data()), element.first.as<std::string>());
-            default_map_names.try_emplace(hash, element.second.as<std::string>());
+            default_map_names.try_emplace(parse_map_key(element.first.as<std::string>()), element.second.as<std::string>());
         }
     } else
         config_["map_name_list"] = YAML::Node(YAML::NodeType::Map);
     if (config_["initial_life_counts"]) {
         initial_life_counts.clear();
         for (const auto& element: config_["initial_life_counts"]) {
-            std::string hash(sizeof(bmmo::map::md5), 0);
-            bmmo::string_utils::hex_chars_from_string(reinterpret_cast<uint8_t*>(hash.data()), element.first.as<std::string>());
-            initial_life_counts.try_emplace(hash, element.second.as<int>());
+            initial_life_counts.try_emplace(parse_map_key(element.first.as<std::string>()), element.second.as<int>());
         }
     } else
         config_["initial_life_counts"] = YAML::Node(YAML::NodeType::Map);
@@ -84,6 +100,18 @@ bool config_manager::load() {
             decltype(mute_list_vector){"00000001-0002-0003-0004-000000000005"});
     muted_players = std::unordered_set(mute_list_vector.begin(), mute_list_vector.end());
     bmmo::set_auto_flush_log(yaml_load_value(config_, "auto_flush_log", false));
+    bmmo::set_log_overflow_policy(yaml_load_value(config_, "log_overflow_policy", std::string{"block"}) == "drop"
+            ? bmmo::log_overflow_policy::Drop : bmmo::log_overflow_policy::Block);
+    auto log_rate_limits = yaml_load_value(config_, "log_rate_limits",
+            std::map<std::string, uint32_t>{{"important", 0}, {"warning", 0}, {"msg", 0}});
+    for (const auto& [level, lines_per_second]: log_rate_limits) {
+        if (level == "important")
+            bmmo::set_log_rate_limit(k_ESteamNetworkingSocketsDebugOutputType_Important, lines_per_second);
+        else if (level == "warning")
+            bmmo::set_log_rate_limit(k_ESteamNetworkingSocketsDebugOutputType_Warning, lines_per_second);
+        else if (level == "msg")
+            bmmo::set_log_rate_limit(k_ESteamNetworkingSocketsDebugOutputType_Msg, lines_per_second);
+    }
 
     ifile.close();
     save(false);
@@ -139,16 +167,13 @@ bool config_manager::get_forced_cheat_mode(const std::string& uuid_string, bool&
 };
 
 void config_manager::save(bool reload_values) {
+    BMMO_PROFILE_SCOPE(stage_profiler::SaveFiles);
     if (reload_values) {
         config_["op_list"] = op_players;
         config_["ban_list"] = banned_players;
         config_["mute_list"] = std::vector<std::string>(muted_players.begin(), muted_players.end());
     }
-    std::ofstream config_file("config.yml");
-    if (!config_file.is_open()) {
-        Printf("Error: failed to open config file for writing.");
-        return;
-    }
+    std::ostringstream config_file;
     auto current_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
     config_file << "# Config file for Ballance MMO Server v" << bmmo::current_version.to_string() << " - "
                     << std::put_time(std::localtime(&current_time), "%F %T") << "\n"
@@ -157,8 +182,17 @@ void config_manager::save(bool reload_values) {
                    "# - Log ball-offs: whether to write player ball-off events to the log file.\n"
                    "# - Serious warning as DNF: mark the client's status as Did-Not-Finish upon receiving a serious warning.\n"
                    "# - Ghost mode: whether to enable ghost mode, where players are invisible to each other except spectators and operators.\n"
+                   "# - Align tick phase: whether to shift server ticks to shortly after clients' ball states usually arrive.\n"
+                   "# - File save delay: milliseconds to wait for further changes before writing this file and player_status.json.\n"
+                   "# - Profiling: whether to time the stages of the server loop and room ticks; see `stats`.\n"
+                   "# - Slow tick budget: milliseconds a server loop iteration or room tick may take before its breakdown by stage is logged.\n"
+                   "# - Quantized position bits: most bits per axis for positions sent to clients supporting quantized ball states (8-21).\n"
+                   "#   Positions are a millimetre apart unless players are too far apart for that many bits.\n"
+                   "# - Metrics file: where to write server metrics in the Prometheus text format every `metrics_interval_s` seconds; empty to disable.\n"
                    "# - Options for log levels: important, warning, msg.\n"
                    "# - Auto flush log: whether to automatically flush the log file after each output.\n"
+                   "# - Log overflow policy: what to do when logging faster than lines can be written; \"block\" waits, \"drop\" discards.\n"
+                   "# - Log rate limits: maximum lines per second for each log level; 0 for no limit.\n"
                    "# - Map name list style: \"md5_hash: name\".\n"
                    "# - Life count list style: \"md5_hash: count\".\n"
                    "# - Op list / reserved names data style: \"playername: uuid\".\n"
@@ -167,42 +201,13 @@ void config_manager::save(bool reload_values) {
                 << std::endl;
     config_file << config_;
     config_file << std::endl;
-    config_file.close();
-}
-
-void config_manager::save_login_data(const SteamNetworkingIPAddr& ip, const std::string& uuid_str, const std::string& name) {
-    char ip_str[SteamNetworkingIPAddr::k_cchMaxString]{};
-    ip.ToString(ip_str, sizeof(ip_str), false);
-    YAML::Node login_data;
-    std::ifstream ifile("login_data.yml");
-    if (ifile.is_open() && ifile.peek() != std::ifstream::traits_type::eof()) {
-        try {
-            login_data = YAML::Load(ifile);
-        } catch (const std::exception& e) {
-            Printf("Error: failed to parse config: %s", e.what());
-            return;
-        }
-    }
-    ifile.close();
-    auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    std::string time_str(20, 0);
-    time_str.resize(std::strftime(&time_str[0], time_str.size(),
-        "%F %X", std::localtime(&time)));
-    if (!login_data[uuid_str])
-        login_data[uuid_str] = YAML::Node(YAML::NodeType::Map);
-    if (!login_data[uuid_str][name])
-        login_data[uuid_str][name] = YAML::Node(YAML::NodeType::Map);
-    login_data[uuid_str][name][time_str] = ip_str;
-    std::ofstream ofile("login_data.yml");
-    if (ofile.is_open()) {
-        ofile << login_data;
-        ofile.close();
-    }
+    write_file("config.yml", std::move(config_file).str());
 }
 
 void config_manager::save_player_status(const client_data_collection& clients) {
     if (!save_player_status_to_file_)
         return;
+    BMMO_PROFILE_SCOPE(stage_profiler::SaveFiles);
 
     picojson::array player_list{};
     using picojson::value;
@@ -212,8 +217,12 @@ void config_manager::save_player_status(const client_data_collection& clients) {
             {"login_time", value{data.login_time}},
         });
     }
-    std::ofstream player_status_file("player_status.json");
-    if (player_status_file.is_open()) {
-        player_status_file << value{player_list};
-    }
+    write_file("player_status.json", value{player_list}.serialize());
+}
+
+void config_manager::write_file(const std::string& path, std::string content) {
+    if (persistence_)
+        persistence_->write(path, std::move(content));
+    else
+        persistence_worker::write_file(path, content);
 }
@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include "server_data.hpp"
+#include "persistence_worker.hpp"
 
 class config_manager {
 private:
@@ -11,16 +12,29 @@ private:
     bool save_player_status_to_file_ = false;
     std::unordered_map<std::string, std::string> forced_names_, reserved_names_;
     std::unordered_map<std::string, bool> forced_cheat_modes_;
+    persistence_worker* persistence_ = nullptr; // files are written synchronously without one
+
+    void write_file(const std::string& path, std::string content);
 
 public:
-    std::unordered_map<std::string, std::string> op_players, banned_players, default_map_names;
-    std::unordered_map<std::string, int> initial_life_counts;
+    std::unordered_map<std::string, std::string> op_players, banned_players;
+    bmmo::map_name_table default_map_names;
+    bmmo::map_key_table<int> initial_life_counts;
     std::unordered_set<std::string> muted_players;
     bool op_mode = true, restart_level = true, force_restart_level = false;
     bool log_installed_mods = false, log_ball_offs = false, serious_warning_as_dnf = false;
     bool ghost_mode = false;
+    bool align_tick_phase = false;
+    int file_save_delay_ms = 1000;
+    std::string metrics_file; // not exported if empty
+    int metrics_interval_s = 15;
+    bool profiling = true;
+    double slow_tick_budget_ms = 15;
+    int quantized_position_bits = bmmo::owned_quantized_ball_state_msg::DEFAULT_POSITION_BITS;
     ESteamNetworkingSocketsDebugOutputType logging_level = k_ESteamNetworkingSocketsDebugOutputType_Important;
 
+    void set_persistence_worker(persistence_worker* persistence) { persistence_ = persistence; }
+
     bool load();
 
     void print_bans();
@@ -35,7 +49,6 @@ public:
     bool get_forced_cheat_mode(const std::string& uuid_string, bool& cheat_mode);
 
     void save(bool reload_values = true);
-    void save_login_data(const SteamNetworkingIPAddr& ip, const std::string& uuid_str, const std::string& name);
     void save_player_status(const client_data_collection& clients);
 };
 
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "common.hpp"
+#include "leaderboard_store.hpp"
+
+using bmmo::Printf;
+
+void leaderboard_store::open(const std::string& directory) {
+    close();
+    directory_ = directory;
+    maps_.clear();
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    if (ec)
+        Printf("Error: failed to create %s: %s", directory_, ec.message());
+
+    stopping_ = false;
+    worker_ = std::thread([this] { run_worker(); });
+}
+
+void leaderboard_store::close() {
+    if (!worker_.joinable())
+        return;
+    {
+        std::lock_guard lk(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+void leaderboard_store::record_run(run entry) {
+    // names are the only free-form field and must stay on their line
+    std::ranges::replace_if(entry.name, [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    {
+        std::lock_guard lk(mutex_);
+        tasks_.push_back([this, entry = std::move(entry)]() mutable {
+            append(entry);
+            // not read in yet means it's in the file by the time it is
+            if (auto it = maps_.find(entry.map); it != maps_.end())
+                add_to_index(it->second, std::move(entry));
+        });
+    }
+    cv_.notify_one();
+}
+
+void leaderboard_store::query(bmmo::map_key map, bmmo::level_mode mode, size_t count, std::string uuid,
+                              std::function<void(standings)> done) {
+    {
+        std::lock_guard lk(mutex_);
+        tasks_.push_back([=, this, done = std::move(done)] {
+            const auto& b = load(map).modes[size_t(mode) & 1];
+            standings result;
+            result.player_count = b.best.size();
+            result.run_count = b.run_count;
+            for (auto it = b.order.begin(); it != b.order.end() && result.best.size() < count; ++it)
+                result.best.push_back(b.best.at(std::get<std::string>(*it)));
+            result.recent.assign(b.recent.begin(), b.recent.end());
+            if (auto it = b.best.find(uuid); !uuid.empty() && it != b.best.end()) {
+                result.personal_best = it->second;
+                result.personal_rank = std::distance(b.order.begin(), b.order.find(key_of(it->second))) + 1;
+            }
+            done(std::move(result));
+        });
+    }
+    cv_.notify_one();
+}
+
+leaderboard_store::rank_key leaderboard_store::key_of(const run& entry) {
+    return {entry.mode == bmmo::level_mode::Highscore ? -int64_t(entry.hs_score) : 0,
+            entry.sr_time, entry.time, entry.uuid};
+}
+
+std::string leaderboard_store::format_line(const run& entry) {
+    char numbers[96];
+    std::snprintf(numbers, sizeof(numbers), "%lld\t%d\t", (long long) entry.time, int(entry.mode));
+    std::string line = numbers;
+    line += entry.uuid;
+    std::snprintf(numbers, sizeof(numbers), "\t%d\t%.9g\t%d\t", int(entry.cheated), entry.sr_time, entry.hs_score);
+    line += numbers;
+    line += entry.formatted_hs_score;
+    line += '\t';
+    line += entry.name;
+    line += '\n';
+    return line;
+}
+
+bool leaderboard_store::parse_line(std::string_view line, run& entry) {
+    std::string_view fields[7];
+    for (auto& field: fields) {
+        const auto tab = line.find('\t');
+        if (tab == std::string_view::npos)
+            return false;
+        field = line.substr(0, tab);
+        line.remove_prefix(tab + 1);
+    }
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    const auto parse = [](std::string_view field, auto& value) {
+        const auto [end, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+        return ec == std::errc{} && end == field.data() + field.size();
+    };
+    int mode = 0, cheated = 0;
+    if (!parse(fields[0], entry.time) || !parse(fields[1], mode) || (mode != 0 && mode != 1)
+            || fields[2].empty() || !parse(fields[3], cheated) || !parse(fields[4], entry.sr_time)
+            || !std::isfinite(entry.sr_time) || !parse(fields[5], entry.hs_score) || line.empty())
+        return false;
+    entry.mode = bmmo::level_mode(mode);
+    entry.uuid = fields[2];
+    entry.cheated = cheated != 0;
+    entry.formatted_hs_score = fields[6];
+    entry.name = line;
+    return true;
+}
+
+std::string leaderboard_store::path_of(const bmmo::map_key& map) const {
+    std::string hash_string;
+    bmmo::string_utils::string_from_hex_chars(hash_string, map.md5, sizeof(map.md5));
+    return (std::filesystem::path(directory_) / (hash_string + ".log")).string();
+}
+
+leaderboard_store::map_boards& leaderboard_store::load(const bmmo::map_key& map) {
+    auto [it, inserted] = maps_.try_emplace(map);
+    if (!inserted)
+        return it->second;
+    auto& boards = it->second;
+    std::ifstream ifile(path_of(map), std::ios::binary);
+    if (!ifile.is_open())
+        return boards;
+    std::stringstream content;
+    content << ifile.rdbuf();
+    const std::string text = std::move(content).str();
+    std::string_view rest = text;
+    size_t loaded = 0, damaged = 0;
+    run entry;
+    entry.map = map;
+    // only complete lines count; the last one may have been cut off by a crash
+    for (auto end = rest.find('\n'); end != std::string_view::npos; end = rest.find('\n')) {
+        if (parse_line(rest.substr(0, end), entry)) {
+            add_to_index(boards, entry);
+            ++loaded;
+        } else {
+            ++damaged;
+        }
+        rest.remove_prefix(end + 1);
+    }
+    boards.cut_off = !rest.empty();
+    if (damaged > 0 || boards.cut_off)
+        Printf("Warning: skipped %zu damaged run(s) in %s.", damaged + boards.cut_off, path_of(map));
+    return boards;
+}
+
+void leaderboard_store::add_to_index(map_boards& boards, run entry) {
+    auto& b = boards.modes[size_t(entry.mode) & 1];
+    ++b.run_count;
+    b.recent.push_front(entry);
+    if (b.recent.size() > RECENT_RUN_COUNT)
+        b.recent.pop_back();
+    if (entry.cheated)
+        return;
+    auto [it, inserted] = b.best.try_emplace(entry.uuid, entry);
+    if (!inserted) {
+        if (key_of(entry) >= key_of(it->second))
+            return;
+        b.order.erase(key_of(it->second));
+        it->second = std::move(entry);
+    }
+    b.order.insert(key_of(it->second));
+}
+
+void leaderboard_store::append(const run& entry) {
+    const auto path = path_of(entry.map);
+    std::ofstream ofile(path, std::ios::binary | std::ios::app);
+    // don't let the line get glued to one cut off by a crash
+    auto it = maps_.find(entry.map);
+    if (it != maps_.end() && it->second.cut_off) {
+        ofile << '\n';
+        it->second.cut_off = false;
+    } else if (it == maps_.end()) {
+        std::ifstream ifile(path, std::ios::binary | std::ios::ate);
+        if (ifile.is_open() && ifile.tellg() > 0) {
+            ifile.seekg(-1, std::ios::end);
+            if (ifile.get() != '\n')
+                ofile << '\n';
+        }
+    }
+    if (!(ofile << format_line(entry)) || !ofile.flush())
+        Printf("Error: failed to record a run to %s.", path);
+}
+
+void leaderboard_store::run_worker() {
+    std::unique_lock lk(mutex_);
+    while (true) {
+        cv_.wait(lk, [this] { return stopping_ || !tasks_.empty(); });
+        auto tasks = std::move(tasks_);
+        tasks_.clear();
+        const bool stopping = stopping_;
+        lk.unlock();
+        for (auto& task: tasks)
+            task();
+        if (stopping)
+            return;
+        lk.lock();
+    }
+}
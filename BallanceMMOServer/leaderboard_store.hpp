@@ -0,0 +1,106 @@
+#ifndef BALLANCEMMOSERVER_LEADERBOARD_STORE_HPP
+#define BALLANCEMMOSERVER_LEADERBOARD_STORE_HPP
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "../BallanceMMOCommon/common.hpp"
+
+// All-time rankings of every map across sessions and restarts, in an append-only text
+// file per map (named after its MD5) with one
+// "<unix time>\t<mode>\t<uuid>\t<cheated>\t<sr time>\t<score>\t<formatted score>\t<name>"
+// line per finished run. A line cut off by a crash is skipped when the file is read.
+// Maps are only read in when first asked about, so starting up doesn't depend on how
+// much history there is; after that, personal bests, the best runs and the latest runs
+// of each map and level mode are kept indexed in memory.
+// The files and indexes belong to a worker thread. Runs and queries are queued to it,
+// so neither ever blocks the caller; query results are handed to callbacks on that thread.
+class leaderboard_store {
+public:
+    struct run {
+        int64_t time = 0; // unix time
+        bmmo::map_key map;
+        bmmo::level_mode mode = bmmo::level_mode::Speedrun;
+        std::string uuid, name;
+        bool cheated = false;
+        float sr_time = 0;
+        int hs_score = 0;
+        std::string formatted_hs_score;
+    };
+
+    struct standings {
+        std::vector<run> best; // personal bests, best first
+        std::vector<run> recent; // latest first
+        size_t player_count = 0, run_count = 0;
+        std::optional<run> personal_best; // of the UUID asked about
+        size_t personal_rank = 0; // 1-based rank of `personal_best`
+    };
+
+    static constexpr const char* DEFAULT_DIRECTORY = "leaderboards";
+    static constexpr size_t RECENT_RUN_COUNT = 20; // kept per map and mode
+
+    leaderboard_store() = default;
+    leaderboard_store(const leaderboard_store&) = delete;
+    leaderboard_store& operator=(const leaderboard_store&) = delete;
+    ~leaderboard_store() { close(); }
+
+    void open(const std::string& directory = DEFAULT_DIRECTORY);
+    // Writes out everything queued so far and stops the worker thread.
+    void close();
+
+    // Cheated runs are recorded, but don't count as personal bests.
+    void record_run(run entry);
+
+    // Calls `done` on the worker thread with the best `count` players of the map in `mode`,
+    // and the personal best of `uuid` if it isn't empty.
+    void query(bmmo::map_key map, bmmo::level_mode mode, size_t count, std::string uuid,
+               std::function<void(standings)> done);
+
+private:
+    // (-score in highscore mode / 0, sr time, unix time, uuid)
+    using rank_key = std::tuple<int64_t, float, int64_t, std::string>;
+
+    struct board {
+        std::unordered_map<std::string, run> best; // by uuid
+        std::set<rank_key> order; // of `best`
+        std::deque<run> recent; // latest first
+        size_t run_count = 0;
+    };
+
+    struct map_boards {
+        std::array<board, 2> modes; // by `bmmo::level_mode`
+        bool cut_off = false; // the file doesn't end with a line break
+    };
+
+    static rank_key key_of(const run& entry);
+    static std::string format_line(const run& entry);
+    static bool parse_line(std::string_view line, run& entry);
+    std::string path_of(const bmmo::map_key& map) const;
+
+    // Worker thread only.
+    map_boards& load(const bmmo::map_key& map);
+    static void add_to_index(map_boards& boards, run entry);
+    void append(const run& entry);
+    void run_worker();
+
+    std::string directory_;
+    bmmo::map_key_table<map_boards> maps_; // worker thread only
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_; // guarded by mutex_
+    bool stopping_ = false; // guarded by mutex_
+    std::thread worker_;
+};
+
+#endif //BALLANCEMMOSERVER_LEADERBOARD_STORE_HPP
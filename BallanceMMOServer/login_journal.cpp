@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+#include <yaml-cpp/yaml.h>
+
+#include "common.hpp"
+#include "login_journal.hpp"
+#include "utility/misc.hpp"
+
+using bmmo::Printf;
+
+void login_journal::open(const std::string& path) {
+    close();
+    path_ = path;
+    records_.clear();
+    by_uuid_.clear();
+    by_ip_.clear();
+
+    // don't let the next line get glued to one cut off by a crash
+    {
+        std::ifstream ifile(path_, std::ios::binary | std::ios::ate);
+        if (ifile.is_open() && ifile.tellg() > 0) {
+            ifile.seekg(-1, std::ios::end);
+            if (ifile.get() != '\n')
+                std::ofstream(path_, std::ios::binary | std::ios::app) << '\n';
+        }
+    }
+    if (std::filesystem::exists(LEGACY_YAML_PATH)) {
+        const size_t count = import_yaml(LEGACY_YAML_PATH);
+        Printf("Imported %zu login record%s from %s.", count, count == 1 ? "" : "s", LEGACY_YAML_PATH);
+    }
+    load();
+
+    stopping_ = false;
+    writer_ = std::thread([this] { run_writer(); });
+}
+
+void login_journal::close() {
+    if (!writer_.joinable())
+        return;
+    {
+        std::lock_guard lk(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    writer_.join();
+}
+
+void login_journal::record_login(record entry) {
+    // names are the only free-form field and must stay on their line
+    std::ranges::replace_if(entry.name, [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+    std::string line = format_line(entry);
+    add_to_index(std::move(entry));
+    {
+        std::lock_guard lk(mutex_);
+        pending_ += line;
+    }
+    cv_.notify_one();
+}
+
+const std::vector<size_t>* login_journal::find_by_uuid(const std::string& uuid) const {
+    auto it = by_uuid_.find(uuid);
+    return (it == by_uuid_.end()) ? nullptr : &it->second;
+}
+
+const std::vector<size_t>* login_journal::find_by_ip(const std::string& ip) const {
+    auto it = by_ip_.find(ip);
+    return (it == by_ip_.end()) ? nullptr : &it->second;
+}
+
+void login_journal::print_history(const std::string& uuid_or_ip, size_t max_count) const {
+    const auto* indices = find_by_uuid(uuid_or_ip);
+    if (!indices)
+        indices = find_by_ip(uuid_or_ip);
+    if (!indices) {
+        Printf("No logins found for \"%s\".", uuid_or_ip);
+        return;
+    }
+    const size_t begin = (indices->size() > max_count) ? indices->size() - max_count : 0;
+    for (size_t i = begin; i < indices->size(); ++i) {
+        const auto& entry = records_[(*indices)[i]];
+        const auto time = static_cast<time_t>(entry.time);
+        std::string time_str(20, 0);
+        time_str.resize(std::strftime(&time_str[0], time_str.size(), "%F %X", std::localtime(&time)));
+        Printf("%s  %s  %-15s  %s", time_str, entry.uuid, entry.ip, entry.name);
+    }
+    Printf("%zu login%s in total%s.", indices->size(), indices->size() == 1 ? "" : "s",
+            begin > 0 ? ", only showing the latest " + std::to_string(max_count) : "");
+}
+
+std::string login_journal::format_line(const record& entry) {
+    return std::to_string(entry.time) + '\t' + entry.uuid + '\t' + entry.ip + '\t' + entry.name + '\n';
+}
+
+bool login_journal::parse_line(std::string_view line, record& entry) {
+    std::string_view fields[3];
+    for (auto& field: fields) {
+        const auto tab = line.find('\t');
+        if (tab == std::string_view::npos)
+            return false;
+        field = line.substr(0, tab);
+        line.remove_prefix(tab + 1);
+    }
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    const auto [end, ec] = std::from_chars(fields[0].data(), fields[0].data() + fields[0].size(), entry.time);
+    if (ec != std::errc{} || end != fields[0].data() + fields[0].size() || fields[1].empty() || line.empty())
+        return false;
+    entry.uuid = fields[1];
+    entry.ip = fields[2];
+    entry.name = line;
+    return true;
+}
+
+// login_data.yml of older versions: {uuid: {name: {"%F %X" local time: ip}}}
+size_t login_journal::import_yaml(const std::string& yaml_path) {
+    YAML::Node login_data;
+    try {
+        login_data = YAML::LoadFile(yaml_path);
+    } catch (const std::exception& e) {
+        Printf("Error: failed to parse %s: %s", yaml_path, e.what());
+        return 0;
+    }
+
+    std::vector<record> imported;
+    if (login_data.IsMap()) {
+        for (const auto& uuid_entry: login_data) {
+            if (!uuid_entry.second.IsMap())
+                continue;
+            for (const auto& name_entry: uuid_entry.second) {
+                if (!name_entry.second.IsMap())
+                    continue;
+                for (const auto& time_entry: name_entry.second) {
+                    std::tm tm{};
+                    std::istringstream time_stream(time_entry.first.as<std::string>());
+                    time_stream >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+                    if (time_stream.fail())
+                        continue;
+                    tm.tm_isdst = -1;
+                    imported.push_back({std::mktime(&tm), uuid_entry.first.as<std::string>(),
+                                        time_entry.second.as<std::string>(), name_entry.first.as<std::string>()});
+                }
+            }
+        }
+    }
+    std::ranges::stable_sort(imported, {}, &record::time);
+
+    std::ofstream ofile(path_, std::ios::binary | std::ios::app);
+    if (!ofile.is_open()) {
+        Printf("Error: failed to open %s for writing.", path_);
+        return 0;
+    }
+    for (const auto& entry: imported)
+        ofile << format_line(entry);
+    ofile.close();
+    if (!ofile) {
+        Printf("Error: failed to write imported login records to %s.", path_);
+        return 0;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(yaml_path, yaml_path + ".imported", ec);
+    if (ec)
+        Printf("Error: failed to rename %s after importing it: %s", yaml_path, ec.message());
+    return imported.size();
+}
+
+void login_journal::load() {
+    std::ifstream ifile(path_, std::ios::binary);
+    std::unordered_set<std::string> seen;
+    std::string line;
+    record entry;
+    while (std::getline(ifile, line)) {
+        if (parse_line(line, entry) && seen.insert(line).second)
+            add_to_index(std::move(entry));
+    }
+}
+
+void login_journal::add_to_index(record entry) {
+    const size_t index = records_.size();
+    by_uuid_[entry.uuid].push_back(index);
+    by_ip_[entry.ip].push_back(index);
+    records_.push_back(std::move(entry));
+}
+
+void login_journal::run_writer() {
+    auto next_compaction = std::chrono::steady_clock::now(); // start with one
+    std::unique_lock lk(mutex_);
+    while (true) {
+        cv_.wait_until(lk, next_compaction, [this] { return stopping_ || !pending_.empty(); });
+        std::string lines = std::move(pending_);
+        pending_.clear();
+        const bool stopping = stopping_;
+        lk.unlock();
+
+        if (!lines.empty()) {
+            std::ofstream ofile(path_, std::ios::binary | std::ios::app);
+            if (!(ofile << lines))
+                Printf("Error: failed to write login records to %s.", path_);
+        }
+        if (stopping)
+            return;
+        if (std::chrono::steady_clock::now() >= next_compaction) {
+            compact();
+            next_compaction = std::chrono::steady_clock::now() + COMPACTION_INTERVAL;
+        }
+
+        lk.lock();
+    }
+}
+
+// Only the writer thread touches the file, so it's safe to replace it here.
+void login_journal::compact() {
+    std::ifstream ifile(path_, std::ios::binary);
+    if (!ifile.is_open())
+        return;
+    std::unordered_set<std::string> seen;
+    std::string line, kept;
+    record entry;
+    size_t dropped = 0;
+    while (std::getline(ifile, line)) {
+        if (!parse_line(line, entry) || !seen.insert(line).second) {
+            ++dropped;
+            continue;
+        }
+        kept += line;
+        kept += '\n';
+    }
+    ifile.close();
+    if (dropped == 0)
+        return;
+
+    const std::string temp_path = path_ + ".tmp";
+    {
+        std::ofstream ofile(temp_path, std::ios::binary | std::ios::trunc);
+        if (!(ofile << kept)) {
+            Printf("Error: failed to compact %s.", path_);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path_, ec);
+    if (ec)
+        Printf("Error: failed to compact %s: %s", path_, ec.message());
+    else
+        Printf("Compacted %s (%zu duplicate or damaged line%s removed).", path_, dropped, dropped == 1 ? "" : "s");
+}
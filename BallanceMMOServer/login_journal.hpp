@@ -0,0 +1,72 @@
+#ifndef BALLANCEMMOSERVER_LOGIN_JOURNAL_HPP
+#define BALLANCEMMOSERVER_LOGIN_JOURNAL_HPP
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// History of all logins, kept in an append-only text file with one
+// "<unix time>\t<uuid>\t<ip>\t<name>" line per login.
+// Lines are written by a background thread, so recording a login costs a queue push;
+// the thread also compacts the file now and then, dropping duplicate and damaged lines.
+// All records are kept in memory as well, indexed by UUID and IP for console queries.
+// `record_login` and the queries must be called from the same thread.
+class login_journal {
+public:
+    struct record {
+        int64_t time = 0; // unix time
+        std::string uuid, ip, name;
+    };
+
+    static constexpr const char* DEFAULT_PATH = "login_data.log";
+    static constexpr const char* LEGACY_YAML_PATH = "login_data.yml";
+    static constexpr std::chrono::hours COMPACTION_INTERVAL{6};
+
+    login_journal() = default;
+    login_journal(const login_journal&) = delete;
+    login_journal& operator=(const login_journal&) = delete;
+    ~login_journal() { close(); }
+
+    // Imports and renames `LEGACY_YAML_PATH` if it exists, loads the history
+    // and starts the writer thread.
+    void open(const std::string& path = DEFAULT_PATH);
+    // Writes out everything recorded so far and stops the writer thread.
+    void close();
+
+    void record_login(record entry);
+
+    const std::vector<record>& records() const { return records_; }
+    // @returns indices into `records()` in the order of recording, or `nullptr` if there are none.
+    const std::vector<size_t>* find_by_uuid(const std::string& uuid) const;
+    const std::vector<size_t>* find_by_ip(const std::string& ip) const;
+
+    // Prints the latest `max_count` logins with the given UUID or IP.
+    void print_history(const std::string& uuid_or_ip, size_t max_count) const;
+
+private:
+    static std::string format_line(const record& entry);
+    static bool parse_line(std::string_view line, record& entry);
+    // @returns number of records imported
+    size_t import_yaml(const std::string& yaml_path);
+    void load();
+    void add_to_index(record entry);
+    void run_writer();
+    void compact();
+
+    std::string path_;
+    std::vector<record> records_;
+    std::unordered_map<std::string, std::vector<size_t>> by_uuid_, by_ip_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string pending_; // lines not written yet; guarded by mutex_
+    bool stopping_ = false; // guarded by mutex_
+    std::thread writer_;
+};
+
+#endif //BALLANCEMMOSERVER_LOGIN_JOURNAL_HPP
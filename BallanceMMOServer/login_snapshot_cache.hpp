@@ -0,0 +1,107 @@
+#ifndef BALLANCEMMOSERVER_LOGIN_SNAPSHOT_CACHE_HPP
+#define BALLANCEMMOSERVER_LOGIN_SNAPSHOT_CACHE_HPP
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "../BallanceMMOCommon/common.hpp"
+
+// A serialized message kept until whatever it was built from changes.
+class cached_payload {
+public:
+    // `build` returns the message to serialize if there is no valid copy yet.
+    template <typename Build>
+    std::string_view get(Build&& build) {
+        if (!valid_) {
+            auto msg = build();
+            msg.serialize();
+            data_.assign(msg.data(), msg.size());
+            valid_ = true;
+        }
+        return data_;
+    }
+
+    void invalidate() { valid_ = false; }
+
+private:
+    std::string data_;
+    bool valid_ = false;
+};
+
+// The welcome package every client gets on login, kept serialized so that a burst
+// of logins (e.g. everyone reconnecting after a restart) doesn't re-encode all of it
+// for each one of them. Roster entries are encoded one at a time whenever a player
+// changes; building a login_accepted_v3_msg / login_accepted_v4_msg only concatenates them.
+// Not thread-safe; server thread only.
+class login_snapshot_cache {
+public:
+    cached_payload map_names;  // map_names_msg
+    cached_payload extra_life; // extra_life_msg with the initial life counts
+
+    void update_player(HSteamNetConnection id, const bmmo::player_status_v3& status) {
+        scratch_.reset();
+        bmmo::schema::pod<HSteamNetConnection>::write(id, scratch_);
+        player_layout::write(status, scratch_);
+        roster_entries_[id].assign(scratch_.data(), scratch_.size());
+        invalidate_rosters();
+    }
+
+    void remove_player(HSteamNetConnection id) {
+        if (roster_entries_.erase(id) > 0)
+            invalidate_rosters();
+    }
+
+    // A serialized login_accepted_v4_msg listing every player and the given capabilities.
+    // Only valid until the next call.
+    std::string_view login_accepted(const bmmo::capability_set& capabilities) {
+        if (!roster_v4_valid_)
+            build_roster(roster_v4_, bmmo::LoginAcceptedV4);
+        scratch_.reset();
+        capability_codec::write(capabilities, scratch_);
+        std::memcpy(roster_v4_.data() + sizeof(bmmo::opcode), scratch_.data(), scratch_.size());
+        return roster_v4_;
+    }
+
+    // The same as a login_accepted_v3_msg, for clients which logged in with LoginRequestV3.
+    std::string_view login_accepted_v3(uint32_t capabilities) {
+        if (!roster_v3_valid_)
+            build_roster(roster_v3_, bmmo::LoginAcceptedV3);
+        std::memcpy(roster_v3_.data() + roster_v3_.size() - sizeof(capabilities), &capabilities, sizeof(capabilities));
+        return roster_v3_;
+    }
+
+private:
+    using player_layout = bmmo::login_accepted_v3_msg::player_layout;
+    using capability_codec = bmmo::schema::capability_set_codec;
+
+    // mirrors login_accepted_v3_msg::layout / login_accepted_v4_msg::layout;
+    // capabilities are left empty, to be patched in by `login_accepted`
+    void build_roster(std::string& roster, bmmo::opcode code) {
+        const auto count = static_cast<uint32_t>(roster_entries_.size());
+        const uint32_t v3_capabilities = bmmo::capability::None;
+        size_t size = sizeof(code) + sizeof(count) + ((code == bmmo::LoginAcceptedV4)
+                ? capability_codec::size({}) : sizeof(v3_capabilities));
+        for (const auto& [_, entry]: roster_entries_)
+            size += entry.size();
+        roster.clear();
+        roster.reserve(size);
+        roster.append(reinterpret_cast<const char*>(&code), sizeof(code));
+        if (code == bmmo::LoginAcceptedV4)
+            roster.append(capability_codec::size({}), '\0');
+        roster.append(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& [_, entry]: roster_entries_)
+            roster += entry;
+        if (code == bmmo::LoginAcceptedV3)
+            roster.append(reinterpret_cast<const char*>(&v3_capabilities), sizeof(v3_capabilities));
+        ((code == bmmo::LoginAcceptedV4) ? roster_v4_valid_ : roster_v3_valid_) = true;
+    }
+
+    void invalidate_rosters() { roster_v3_valid_ = roster_v4_valid_ = false; }
+
+    std::unordered_map<HSteamNetConnection, std::string> roster_entries_; // id + player_layout
+    std::string roster_v3_, roster_v4_;
+    bool roster_v3_valid_ = false, roster_v4_valid_ = false;
+    bmmo::byte_stream scratch_;
+};
+
+#endif //BALLANCEMMOSERVER_LOGIN_SNAPSHOT_CACHE_HPP
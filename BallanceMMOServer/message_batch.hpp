@@ -0,0 +1,126 @@
+#ifndef BALLANCEMMOSERVER_MESSAGE_BATCH_HPP
+#define BALLANCEMMOSERVER_MESSAGE_BATCH_HPP
+#include <steam/steamnetworkingsockets.h>
+#include <steam/isteamnetworkingutils.h>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "server_metrics.hpp"
+
+// A message body shared by all outgoing messages of a broadcast.
+// GNS calls `m_pfnFreeData` once per message when it's done with it, possibly
+// from its own service thread, so the reference count is atomic.
+class shared_payload {
+    std::atomic_int refs_{1};
+    size_t size_;
+
+    explicit shared_payload(size_t size): size_(size) {}
+    ~shared_payload() = default;
+
+public:
+    // Holds one reference for the caller, to be given up with `release`.
+    static shared_payload* create(size_t size) {
+        static_assert(alignof(shared_payload) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        void* block = ::operator new(sizeof(shared_payload) + size);
+        return new (block) shared_payload(size);
+    }
+
+    shared_payload(const shared_payload&) = delete;
+    shared_payload& operator=(const shared_payload&) = delete;
+
+    std::byte* data() { return reinterpret_cast<std::byte*>(this + 1); }
+    size_t size() const { return size_; }
+
+    void add_ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~shared_payload();
+            ::operator delete(this);
+        }
+    }
+
+    // Points `msg` at this payload; the message holds a reference until GNS frees it.
+    void attach(SteamNetworkingMessage_t* msg) {
+        add_ref();
+        msg->m_pData = data();
+        msg->m_cbSize = static_cast<int>(size_);
+        msg->m_nUserData = reinterpret_cast<int64>(this);
+        msg->m_pfnFreeData = [](SteamNetworkingMessage_t* msg) {
+            reinterpret_cast<shared_payload*>(msg->m_nUserData)->release();
+        };
+    }
+};
+
+// Outgoing messages collected so that they can be handed to GNS in a single
+// SendMessages call. Recipients of the same broadcast share one copy of the body.
+// Not thread-safe; each thread sending through it needs its own batch.
+class message_batch {
+public:
+    message_batch() = default;
+    message_batch(const message_batch&) = delete;
+    message_batch& operator=(const message_batch&) = delete;
+
+    ~message_batch() {
+        for (auto* msg: messages_)
+            msg->Release();
+    }
+
+    // Messages are counted into `traffic` when flushed, if set.
+    void set_traffic(const opcode_traffic* traffic) { traffic_ = traffic; }
+
+    // Queues `payload` for every connection in `recipients` except `ignored_client`.
+    template <typename Recipients>
+    void add(const Recipients& recipients, shared_payload* payload, int send_flags,
+             HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+        for (HSteamNetConnection recipient: recipients) {
+            if (recipient == ignored_client)
+                continue;
+            auto* msg = SteamNetworkingUtils()->AllocateMessage(0);
+            payload->attach(msg);
+            push(msg, recipient, send_flags);
+        }
+    }
+
+    template <typename Recipients>
+    void add(const Recipients& recipients, const void* buffer, size_t size, int send_flags,
+             HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+        auto* payload = shared_payload::create(size);
+        std::memcpy(payload->data(), buffer, size);
+        add(recipients, payload, send_flags, ignored_client);
+        payload->release();
+    }
+
+    // Sends everything queued so far. GNS takes ownership of the messages
+    // whether or not sending succeeds.
+    // @returns number of messages submitted.
+    size_t flush(ISteamNetworkingSockets* interface) {
+        if (messages_.empty())
+            return 0;
+        if (traffic_) {
+            for (const auto* msg: messages_)
+                traffic_->record(msg->m_pData, msg->m_cbSize);
+        }
+        interface->SendMessages(static_cast<int>(messages_.size()), messages_.data(), nullptr);
+        const size_t count = messages_.size();
+        messages_.clear();
+        return count;
+    }
+
+    bool empty() const { return messages_.empty(); }
+    size_t size() const { return messages_.size(); }
+
+private:
+    void push(SteamNetworkingMessage_t* msg, HSteamNetConnection recipient, int send_flags) {
+        msg->m_conn = recipient;
+        msg->m_nFlags = send_flags;
+        messages_.push_back(msg);
+    }
+
+    std::vector<SteamNetworkingMessage_t*> messages_;
+    const opcode_traffic* traffic_ = nullptr;
+};
+
+#endif //BALLANCEMMOSERVER_MESSAGE_BATCH_HPP
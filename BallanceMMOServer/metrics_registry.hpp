@@ -0,0 +1,224 @@
+#ifndef BALLANCEMMOSERVER_METRICS_REGISTRY_HPP
+#define BALLANCEMMOSERVER_METRICS_REGISTRY_HPP
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../BallanceMMOCommon/common.hpp"
+
+// A monotonically increasing count, split into cache-line-sized shards so that
+// threads incrementing it at the same time don't fight over a single cache line.
+class metric_counter {
+public:
+    void add(uint64_t n = 1) {
+        shards_[shard_index()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t sum = 0;
+        for (const auto& shard: shards_)
+            sum += shard.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    static constexpr size_t SHARD_COUNT = 8;
+
+    struct alignas(64) shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    static size_t shard_index() {
+        static std::atomic<size_t> next_index{0};
+        thread_local const size_t index = next_index.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+        return index;
+    }
+
+    shard shards_[SHARD_COUNT];
+};
+
+// A value that may go up and down, usually set right before exporting.
+class metric_gauge {
+public:
+    void set(double value) { value_.store(value, std::memory_order_relaxed); }
+    double value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value_{0};
+};
+
+// Counts of observations falling into fixed buckets, Prometheus-style:
+// bucket `i` holds observations <= `bounds[i]`, the last one everything else.
+class metric_histogram {
+public:
+    explicit metric_histogram(std::vector<double> bounds):
+            bounds_(std::move(bounds)), buckets_(new std::atomic<uint64_t>[bounds_.size() + 1]) {
+        std::ranges::sort(bounds_);
+        for (size_t i = 0; i <= bounds_.size(); ++i)
+            buckets_[i].store(0, std::memory_order_relaxed);
+    }
+
+    void observe(double value) {
+        const auto index = std::ranges::lower_bound(bounds_, value) - bounds_.begin();
+        buckets_[index].fetch_add(1, std::memory_order_relaxed);
+        double sum = sum_.load(std::memory_order_relaxed);
+        while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed));
+    }
+
+    const std::vector<double>& bounds() const { return bounds_; }
+    // Not cumulative; `bounds().size() + 1` entries.
+    uint64_t bucket(size_t index) const { return buckets_[index].load(std::memory_order_relaxed); }
+    double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    uint64_t count() const {
+        uint64_t count = 0;
+        for (size_t i = 0; i <= bounds_.size(); ++i)
+            count += bucket(i);
+        return count;
+    }
+
+    // Upper bound of the bucket the `q`-quantile falls into; infinity if it's beyond the last bound.
+    double quantile_bound(double q) const {
+        const uint64_t total = count();
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bounds_.size(); ++i) {
+            seen += bucket(i);
+            if (seen > 0 && double(seen) >= q * double(total))
+                return bounds_[i];
+        }
+        return std::numeric_limits<double>::infinity();
+    }
+
+private:
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+    std::atomic<double> sum_{0};
+};
+
+// Named metrics, exported in the Prometheus text format.
+// Metrics are meant to be registered up front; the references handed out stay valid
+// for the lifetime of the registry, and recording into them is lock-free.
+// Registering and exporting aren't thread-safe with regard to each other.
+class metrics_registry {
+public:
+    // `labels` are written as is between the braces, e.g. `opcode="Chat"`.
+    metric_counter& counter(const std::string& name, const std::string& help, const std::string& labels = {}) {
+        return add<metric_counter>(name, help, "counter", labels);
+    }
+
+    metric_gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = {}) {
+        return add<metric_gauge>(name, help, "gauge", labels);
+    }
+
+    metric_histogram& histogram(const std::string& name, const std::string& help,
+                                std::vector<double> bounds, const std::string& labels = {}) {
+        return add<metric_histogram>(name, help, "histogram", labels, std::move(bounds));
+    }
+
+    std::string to_prometheus() const {
+        std::string text;
+        for (const auto& family: families_) {
+            text += "# HELP " + family.name + ' ' + family.help + '\n';
+            text += "# TYPE " + family.name + ' ' + family.type + '\n';
+            for (const auto& entry: family.entries) {
+                if (entry.counter)
+                    append_sample(text, family.name, entry.labels, {}, double(entry.counter->value()));
+                else if (entry.gauge)
+                    append_sample(text, family.name, entry.labels, {}, entry.gauge->value());
+                else
+                    append_histogram(text, family.name, entry.labels, *entry.histogram);
+            }
+        }
+        return text;
+    }
+
+    // Human-readable version of `to_prometheus`, leaving out counters which are still 0
+    // and summarizing histograms.
+    void print_summary() const {
+        for (const auto& family: families_) {
+            for (const auto& entry: family.entries) {
+                const std::string name = entry.labels.empty() ? family.name : family.name + '{' + entry.labels + '}';
+                if (entry.counter) {
+                    if (const auto value = entry.counter->value(); value > 0)
+                        bmmo::Printf("%-56s %" PRIu64, name, value);
+                } else if (entry.gauge) {
+                    bmmo::Printf("%-56s %g", name, entry.gauge->value());
+                } else if (const auto count = entry.histogram->count(); count > 0) {
+                    bmmo::Printf("%-56s count %" PRIu64 ", avg %g, p50 <= %g, p99 <= %g", name, count,
+                                 entry.histogram->sum() / double(count),
+                                 entry.histogram->quantile_bound(0.5), entry.histogram->quantile_bound(0.99));
+                }
+            }
+        }
+    }
+
+private:
+    struct entry {
+        std::string labels;
+        std::unique_ptr<metric_counter> counter;
+        std::unique_ptr<metric_gauge> gauge;
+        std::unique_ptr<metric_histogram> histogram;
+    };
+
+    struct family {
+        std::string name, help, type;
+        std::vector<entry> entries;
+    };
+
+    template <typename T, typename... Args>
+    T& add(const std::string& name, const std::string& help, const char* type, const std::string& labels, Args&&... args) {
+        auto family_it = std::ranges::find(families_, name, &family::name);
+        if (family_it == families_.end())
+            family_it = families_.insert(families_.end(), {name, help, type, {}});
+        auto& new_entry = family_it->entries.emplace_back();
+        new_entry.labels = labels;
+        auto metric = std::make_unique<T>(std::forward<Args>(args)...);
+        T& ref = *metric;
+        if constexpr (std::is_same_v<T, metric_counter>) new_entry.counter = std::move(metric);
+        else if constexpr (std::is_same_v<T, metric_gauge>) new_entry.gauge = std::move(metric);
+        else new_entry.histogram = std::move(metric);
+        return ref;
+    }
+
+    static void append_sample(std::string& text, const std::string& name, const std::string& labels,
+                              const std::string& extra_label, double value) {
+        text += name;
+        if (!labels.empty() || !extra_label.empty()) {
+            text += '{';
+            text += labels;
+            if (!labels.empty() && !extra_label.empty())
+                text += ',';
+            text += extra_label;
+            text += '}';
+        }
+        char value_str[32];
+        std::snprintf(value_str, sizeof(value_str), " %.17g\n", value);
+        text += value_str;
+    }
+
+    static void append_histogram(std::string& text, const std::string& name, const std::string& labels,
+                                 const metric_histogram& histogram) {
+        uint64_t cumulative = 0;
+        char le[48];
+        for (size_t i = 0; i < histogram.bounds().size(); ++i) {
+            cumulative += histogram.bucket(i);
+            std::snprintf(le, sizeof(le), "le=\"%g\"", histogram.bounds()[i]);
+            append_sample(text, name + "_bucket", labels, le, double(cumulative));
+        }
+        cumulative += histogram.bucket(histogram.bounds().size());
+        append_sample(text, name + "_bucket", labels, "le=\"+Inf\"", double(cumulative));
+        append_sample(text, name + "_sum", labels, {}, histogram.sum());
+        append_sample(text, name + "_count", labels, {}, double(cumulative));
+    }
+
+    std::vector<family> families_;
+};
+
+#endif //BALLANCEMMOSERVER_METRICS_REGISTRY_HPP
@@ -0,0 +1,154 @@
+#ifndef BALLANCEMMOSERVER_PERSISTENCE_WORKER_HPP
+#define BALLANCEMMOSERVER_PERSISTENCE_WORKER_HPP
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../BallanceMMOCommon/common.hpp"
+
+// Writes files on its own thread so that saving doesn't hold up the server thread.
+// A file is written `delay` after the first change since its last write; changes
+// arriving in the meantime only replace the content waiting to be written, so a
+// burst of them costs a single write. Files are replaced atomically by writing a
+// temporary file and renaming it over the original.
+class persistence_worker {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit persistence_worker(clock::duration delay = std::chrono::seconds(1)): delay_(delay) {
+        thread_ = std::thread([this] { loop(); });
+    }
+
+    persistence_worker(const persistence_worker&) = delete;
+    persistence_worker& operator=(const persistence_worker&) = delete;
+
+    ~persistence_worker() {
+        flush();
+        {
+            std::lock_guard lk(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void set_delay(clock::duration delay) {
+        std::lock_guard lk(mutex_);
+        delay_ = delay;
+    }
+
+    // Number of files waiting to be written.
+    size_t pending_count() {
+        std::lock_guard lk(mutex_);
+        return pending_.size();
+    }
+
+    // Queues `content` to be written to `path`, replacing whatever is still waiting for it.
+    void write(const std::string& path, std::string content) {
+        {
+            std::lock_guard lk(mutex_);
+            auto [it, inserted] = pending_.try_emplace(path);
+            if (inserted)
+                it->second.deadline = clock::now() + delay_;
+            it->second.content = std::move(content);
+        }
+        cv_.notify_all();
+    }
+
+    // Writes everything waiting right away on the calling thread and returns once it's on disk.
+    void flush() {
+        std::unique_lock lk(mutex_);
+        idle_cv_.wait(lk, [this] { return !writing_; });
+        auto due = take_due(clock::time_point::max());
+        if (due.empty())
+            return;
+        writing_ = true;
+        lk.unlock();
+        for (const auto& [path, content]: due)
+            write_file(path, content);
+        lk.lock();
+        writing_ = false;
+        idle_cv_.notify_all();
+    }
+
+    // Replaces `path` with `content` right away.
+    static bool write_file(const std::string& path, const std::string& content) {
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!(file << content) || !file.flush()) {
+                bmmo::Printf("Error: failed to write %s.", temp_path);
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            bmmo::Printf("Error: failed to replace %s: %s", path, ec.message());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct pending_write {
+        clock::time_point deadline;
+        std::string content;
+    };
+
+    // Caller must hold `mutex_`.
+    std::vector<std::pair<std::string, std::string>> take_due(clock::time_point now) {
+        std::vector<std::pair<std::string, std::string>> due;
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (it->second.deadline <= now) {
+                due.emplace_back(it->first, std::move(it->second.content));
+                it = pending_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return due;
+    }
+
+    void loop() {
+        std::unique_lock lk(mutex_);
+        while (!stopping_) {
+            if (pending_.empty()) {
+                cv_.wait(lk, [this] { return stopping_ || !pending_.empty(); });
+                continue;
+            }
+            auto next_deadline = clock::time_point::max();
+            for (const auto& [_, write]: pending_)
+                next_deadline = std::min(next_deadline, write.deadline);
+            if (clock::now() < next_deadline) {
+                cv_.wait_until(lk, next_deadline);
+                continue;
+            }
+            idle_cv_.wait(lk, [this] { return !writing_; });
+            auto due = take_due(clock::now());
+            writing_ = true;
+            lk.unlock();
+            for (const auto& [path, content]: due)
+                write_file(path, content);
+            lk.lock();
+            writing_ = false;
+            idle_cv_.notify_all();
+        }
+    }
+
+    clock::duration delay_;
+    std::unordered_map<std::string, pending_write> pending_;
+    bool writing_ = false; // a batch is being written outside the lock
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_, idle_cv_;
+    std::thread thread_;
+};
+
+#endif //BALLANCEMMOSERVER_PERSISTENCE_WORKER_HPP
@@ -0,0 +1,201 @@
+#ifndef BALLANCEMMOSERVER_PROFILER_HPP
+#define BALLANCEMMOSERVER_PROFILER_HPP
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "metrics_registry.hpp"
+
+// Times stages of the server thread's loop and of room ticks.
+// Every stage has a histogram (`bmmo_stage_duration_seconds{stage="..."}`).
+// The stages of a frame (a loop iteration or a tick) are also added up per thread;
+// when a frame takes longer than the budget, their breakdown is written to the log.
+// Times are inclusive, so e.g. `update` contains `poll_messages` and the messages handled in there.
+class stage_profiler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum stage : uint16_t {
+        ServerLoop,
+        Update,
+        PollMessages,
+        ConnectionChanges,
+        PostedTasks,
+        Timers,
+        Tick,
+        PullBallStates,
+        Serialize,
+        SendOutgoing,
+        SaveFiles,
+        FirstMessage, // FirstMessage + opcode: handling a message of that opcode
+    };
+
+    static constexpr size_t STAGE_COUNT = size_t(FirstMessage) + bmmo::LoginAcceptedV4 + 1;
+
+    // The one used by `profile_scope` and `profile_frame`.
+    static inline stage_profiler* instance = nullptr;
+
+    explicit stage_profiler(metrics_registry& registry) {
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            histograms_[i] = &registry.histogram("bmmo_stage_duration_seconds", "Time taken by each stage of the server.",
+                    {0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.5},
+                    "stage=\"" + stage_name(stage(i)) + '"');
+        }
+        instance = this;
+    }
+
+    stage_profiler(const stage_profiler&) = delete;
+    stage_profiler& operator=(const stage_profiler&) = delete;
+
+    ~stage_profiler() {
+        if (instance == this)
+            instance = nullptr;
+    }
+
+    static stage message_stage(bmmo::opcode code) {
+        return stage(FirstMessage + ((code <= bmmo::LoginAcceptedV4) ? size_t(code) : 0));
+    }
+
+    static std::string stage_name(stage s) {
+        static constexpr const char* names[] = {
+            "server_loop", "update", "poll_messages", "connection_changes", "posted_tasks", "timers",
+            "tick", "pull_ball_states", "serialize", "send_outgoing", "save_files",
+        };
+        static_assert(std::size(names) == FirstMessage);
+        if (s < FirstMessage)
+            return names[s];
+        return std::string("on_message/") + bmmo::opcode_name(bmmo::opcode(s - FirstMessage));
+    }
+
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void set_budget(clock::duration budget) { budget_.store(budget.count(), std::memory_order_relaxed); }
+    clock::duration get_budget() const { return clock::duration(budget_.load(std::memory_order_relaxed)); }
+
+    void record(stage s, clock::duration elapsed) {
+        histograms_[s]->observe(std::chrono::duration<double>(elapsed).count());
+        auto& frame = current_frame();
+        frame.time[s] += elapsed;
+        ++frame.calls[s];
+    }
+
+    // Ends the current frame of this thread; it's reported if it went over the budget.
+    void end_frame(stage s, clock::duration elapsed) {
+        record(s, elapsed);
+        auto& frame = current_frame();
+        if (elapsed > get_budget()) {
+            const auto now = clock::now();
+            if (now >= frame.next_report) {
+                report(s, elapsed, frame);
+                frame.next_report = now + MIN_REPORT_INTERVAL;
+                frame.unreported = 0;
+            } else {
+                ++frame.unreported;
+            }
+        }
+        frame.time.fill({});
+        frame.calls.fill(0);
+    }
+
+private:
+    // keeps a server which is slow all the time from flooding the log
+    static constexpr std::chrono::seconds MIN_REPORT_INTERVAL{5};
+
+    struct frame_data {
+        std::array<clock::duration, STAGE_COUNT> time{};
+        std::array<uint32_t, STAGE_COUNT> calls{};
+        clock::time_point next_report{};
+        uint32_t unreported = 0; // slow frames since the last report
+    };
+
+    // Stages of the current frame of the calling thread.
+    static frame_data& current_frame() {
+        thread_local frame_data frame;
+        return frame;
+    }
+
+    void report(stage s, clock::duration elapsed, const frame_data& frame) {
+        using ms = std::chrono::duration<double, std::milli>;
+        bmmo::Printf(bmmo::ansi::BrightYellow, "Warning: %s took %.2f ms (budget %.2f ms)%s:",
+                stage_name(s), ms(elapsed).count(), ms(get_budget()).count(),
+                frame.unreported > 0 ? "; " + std::to_string(frame.unreported) + " more slow one(s) since the last report" : "");
+        std::vector<size_t> stages;
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            if (i != s && frame.calls[i] > 0)
+                stages.push_back(i);
+        }
+        std::ranges::sort(stages, std::greater{}, [&frame](size_t i) { return frame.time[i]; });
+        for (size_t i: stages) {
+            bmmo::Printf("  %-36s %9.3f ms (%u call%s)", stage_name(stage(i)), ms(frame.time[i]).count(),
+                    frame.calls[i], frame.calls[i] == 1 ? "" : "s");
+        }
+    }
+
+    std::array<metric_histogram*, STAGE_COUNT> histograms_{};
+    std::atomic_bool enabled_ = true;
+    std::atomic<clock::rep> budget_ = std::chrono::duration_cast<clock::duration>(bmmo::SERVER_TICK_INTERVAL).count();
+};
+
+// Records the time until it goes out of scope, if profiling is enabled.
+class profile_scope {
+public:
+    explicit profile_scope(stage_profiler::stage s): stage_(s) {
+        if (stage_profiler::instance && stage_profiler::instance->enabled()) {
+            active_ = true;
+            start_ = stage_profiler::clock::now();
+        }
+    }
+
+    profile_scope(const profile_scope&) = delete;
+    profile_scope& operator=(const profile_scope&) = delete;
+
+    ~profile_scope() {
+        if (active_ && stage_profiler::instance)
+            stage_profiler::instance->record(stage_, stage_profiler::clock::now() - start_);
+    }
+
+private:
+    stage_profiler::stage stage_;
+    bool active_ = false;
+    stage_profiler::clock::time_point start_;
+};
+
+// Like `profile_scope`, but also ends the frame of the current thread.
+class profile_frame {
+public:
+    explicit profile_frame(stage_profiler::stage s): stage_(s) {
+        if (stage_profiler::instance && stage_profiler::instance->enabled()) {
+            active_ = true;
+            start_ = stage_profiler::clock::now();
+        }
+    }
+
+    profile_frame(const profile_frame&) = delete;
+    profile_frame& operator=(const profile_frame&) = delete;
+
+    ~profile_frame() {
+        if (active_ && stage_profiler::instance)
+            stage_profiler::instance->end_frame(stage_, stage_profiler::clock::now() - start_);
+    }
+
+private:
+    stage_profiler::stage stage_;
+    bool active_ = false;
+    stage_profiler::clock::time_point start_;
+};
+
+// The timers can be compiled out entirely with BMMO_ENABLE_PROFILER undefined.
+#ifdef BMMO_ENABLE_PROFILER
+# define BMMO_PROFILE_CONCAT_INNER(a, b) a##b
+# define BMMO_PROFILE_CONCAT(a, b) BMMO_PROFILE_CONCAT_INNER(a, b)
+# define BMMO_PROFILE_SCOPE(stage) profile_scope BMMO_PROFILE_CONCAT(profile_scope_, __LINE__){stage}
+# define BMMO_PROFILE_FRAME(stage) profile_frame BMMO_PROFILE_CONCAT(profile_frame_, __LINE__){stage}
+#else
+# define BMMO_PROFILE_SCOPE(stage) ((void)0)
+# define BMMO_PROFILE_FRAME(stage) ((void)0)
+#endif
+
+#endif //BALLANCEMMOSERVER_PROFILER_HPP
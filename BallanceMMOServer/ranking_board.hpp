@@ -0,0 +1,216 @@
+#ifndef BALLANCEMMOSERVER_RANKING_BOARD_HPP
+#define BALLANCEMMOSERVER_RANKING_BOARD_HPP
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../BallanceMMOCommon/common.hpp"
+
+// Order statistic tree (a treap with subtree sizes) for finding how many keys come
+// before a key, or the first k of them, in O(log n). Equal keys stay in the order
+// they were inserted in. Nothing is ever removed; rankings only grow until they're reset.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class ranked_set {
+public:
+    static constexpr size_t npos = size_t(-1);
+
+    size_t size() const { return nodes_.size(); }
+    bool empty() const { return nodes_.empty(); }
+
+    void insert(const Key& key, Value value) {
+        const auto index = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back({key, std::move(value), next_priority()});
+        auto [before, after] = split(root_, key);
+        root_ = merge(merge(before, index), after);
+    }
+
+    // How many keys are ordered before `key` (not counting equal ones).
+    size_t count_before(const Key& key) const {
+        size_t count = 0;
+        for (uint32_t n = root_; n != NIL;) {
+            if (compare_(nodes_[n].key, key)) {
+                count += size_of(nodes_[n].left) + 1;
+                n = nodes_[n].right;
+            } else {
+                n = nodes_[n].left;
+            }
+        }
+        return count;
+    }
+
+    // Calls `f(key, value)` in order, on the first `limit` ones.
+    template <typename Function>
+    void for_each(Function&& f, size_t limit = npos) const {
+        std::vector<uint32_t> path;
+        uint32_t n = root_;
+        while (limit > 0 && (n != NIL || !path.empty())) {
+            for (; n != NIL; n = nodes_[n].left)
+                path.push_back(n);
+            n = path.back();
+            path.pop_back();
+            f(nodes_[n].key, nodes_[n].value);
+            --limit;
+            n = nodes_[n].right;
+        }
+    }
+
+private:
+    static constexpr uint32_t NIL = uint32_t(-1);
+
+    struct node {
+        Key key;
+        Value value;
+        uint32_t priority;
+        uint32_t size = 1;
+        uint32_t left = NIL, right = NIL;
+    };
+
+    uint32_t next_priority() { // xorshift32
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        return seed_;
+    }
+
+    size_t size_of(uint32_t n) const { return (n == NIL) ? 0 : nodes_[n].size; }
+
+    void update_size(uint32_t n) {
+        nodes_[n].size = static_cast<uint32_t>(size_of(nodes_[n].left) + size_of(nodes_[n].right) + 1);
+    }
+
+    // Into the keys ordered before or equal to `key` and the ones after it.
+    std::pair<uint32_t, uint32_t> split(uint32_t n, const Key& key) {
+        if (n == NIL)
+            return {NIL, NIL};
+        if (compare_(key, nodes_[n].key)) {
+            auto [before, after] = split(nodes_[n].left, key);
+            nodes_[n].left = after;
+            update_size(n);
+            return {before, n};
+        }
+        auto [before, after] = split(nodes_[n].right, key);
+        nodes_[n].right = before;
+        update_size(n);
+        return {n, after};
+    }
+
+    // Every key in `a` is ordered before or equal to every key in `b`.
+    uint32_t merge(uint32_t a, uint32_t b) {
+        if (a == NIL)
+            return b;
+        if (b == NIL)
+            return a;
+        if (nodes_[a].priority > nodes_[b].priority) {
+            nodes_[a].right = merge(nodes_[a].right, b);
+            update_size(a);
+            return a;
+        }
+        nodes_[b].left = merge(a, nodes_[b].left);
+        update_size(b);
+        return b;
+    }
+
+    std::vector<node> nodes_;
+    uint32_t root_ = NIL;
+    uint32_t seed_ = 2463534242u;
+    [[no_unique_address]] Compare compare_{};
+};
+
+// Rankings of a map in speedrun and highscore order at once, kept sorted as finishes
+// and DNFs come in instead of being sorted again on every query. The entries themselves
+// are kept in the order they came in, which is also how ScoreList messages send them;
+// that part of the message is only serialized again after something has changed.
+class ranking_board {
+public:
+    using finish_entry = bmmo::ranking_entry::finish_entry;
+    using dnf_entry = bmmo::ranking_entry::dnf_entry;
+
+    static constexpr size_t ALL = size_t(-1);
+
+    // `entry.hs_score` has to be filled in.
+    void add_finish(finish_entry entry) {
+        const size_t index = entries_.first.size();
+        sr_order_.insert(entry.sr_ranking, index);
+        hs_order_.insert({-int64_t(entry.hs_score), entry.sr_ranking}, index);
+        finishes_by_name_[entry.name].push_back(index);
+        entries_.first.push_back(std::move(entry));
+        serialized_valid_ = false;
+    }
+
+    void add_dnf(dnf_entry entry) {
+        const size_t index = entries_.second.size();
+        dnf_order_.insert({-int64_t(entry.dnf_sector), index}, index);
+        entries_.second.push_back(std::move(entry));
+        serialized_valid_ = false;
+    }
+
+    bool empty() const { return entries_.first.empty() && entries_.second.empty(); }
+    size_t finish_count() const { return entries_.first.size(); }
+    size_t dnf_count() const { return entries_.second.size(); }
+
+    // Rank of the best finish of `name` as displayed (players with equal highscores share
+    // their rank), or 0 if they haven't finished.
+    int rank_of(const std::string& name, bool hs_mode) const {
+        auto it = finishes_by_name_.find(name);
+        if (it == finishes_by_name_.end())
+            return 0;
+        size_t best = ALL;
+        for (const size_t index: it->second) {
+            const auto& entry = entries_.first[index];
+            best = std::min(best, hs_mode
+                    ? hs_order_.count_before({-int64_t(entry.hs_score), INT_MIN})
+                    : sr_order_.count_before(entry.sr_ranking));
+        }
+        return static_cast<int>(best + 1);
+    }
+
+    // The first `count` finishes in the order of the given mode.
+    std::vector<const finish_entry*> top_finishes(bool hs_mode, size_t count = ALL) const {
+        std::vector<const finish_entry*> finishes;
+        finishes.reserve(std::min(count, entries_.first.size()));
+        const auto collect = [&](const auto&, size_t index) { finishes.push_back(&entries_.first[index]); };
+        if (hs_mode)
+            hs_order_.for_each(collect, count);
+        else
+            sr_order_.for_each(collect, count);
+        return finishes;
+    }
+
+    // The first `count` DNFs, furthest sectors first.
+    std::vector<const dnf_entry*> top_dnfs(size_t count = ALL) const {
+        std::vector<const dnf_entry*> dnfs;
+        dnfs.reserve(std::min(count, entries_.second.size()));
+        dnf_order_.for_each([&](const auto&, size_t index) { dnfs.push_back(&entries_.second[index]); }, count);
+        return dnfs;
+    }
+
+    // The rankings as `score_list_msg::rankings_layout`.
+    std::string_view serialized() {
+        if (!serialized_valid_) {
+            using layout = bmmo::score_list_msg::rankings_layout;
+            bmmo::byte_stream stream;
+            stream.reserve(layout::size(entries_));
+            layout::write(entries_, stream);
+            serialized_.assign(stream.data(), stream.size());
+            serialized_valid_ = true;
+        }
+        return serialized_;
+    }
+
+private:
+    bmmo::ranking_entry::player_rankings entries_; // in the order they came in
+    ranked_set<int, size_t> sr_order_; // by sr_ranking
+    ranked_set<std::pair<int64_t, int>, size_t> hs_order_; // by highscore descending, then sr_ranking
+    ranked_set<std::pair<int64_t, size_t>, size_t> dnf_order_; // by sector descending, then arrival
+    std::unordered_map<std::string, std::vector<size_t>> finishes_by_name_;
+    std::string serialized_;
+    bool serialized_valid_ = false;
+};
+
+#endif //BALLANCEMMOSERVER_RANKING_BOARD_HPP
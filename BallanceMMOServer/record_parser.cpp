@@ -42,7 +42,7 @@ public:
         set_logging_level(k_ESteamNetworkingSocketsDebugOutputType_Important);
     }
 
-    EResult send(const HSteamNetConnection destination, void* buffer, size_t size, int send_flags, int64* out_message_number = nullptr) {
+    EResult send(const HSteamNetConnection destination, const void* buffer, size_t size, int send_flags, int64* out_message_number = nullptr) {
         return interface_->SendMessageToConnection(destination,
                                                    buffer,
                                                    size,
@@ -61,7 +61,7 @@ public:
                     out_message_number);
     }
 
-    void broadcast_message(void* buffer, size_t size, int send_flags, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+    void broadcast_message(const void* buffer, size_t size, int send_flags, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
         for (auto& i: clients_)
             if (ignored_client != i.first)
                 send(i.first, buffer, size,
@@ -151,8 +151,9 @@ public:
             record_stream_.read(reinterpret_cast<char*>(entry.data), size);
             auto* raw_msg = reinterpret_cast<bmmo::general_message*>(entry.data);
             switch (raw_msg->code) {
-                case bmmo::LoginAcceptedV3: {
-                    auto msg = bmmo::message_utils::deserialize<bmmo::login_accepted_v3_msg>(entry.data, entry.size);
+                case bmmo::LoginAcceptedV3:
+                case bmmo::LoginAcceptedV4: {
+                    auto msg = deserialize_login_accepted(entry);
                     for (const auto& [id, data]: msg.online_players) {
                         player_state_t state = {
                             static_cast<player_mode_t>(Online | ((data.cheated) ? Cheating : None)),
@@ -421,7 +422,7 @@ public:
         bmmo::login_accepted_v3_msg msg;
         msg.online_players = record_clients_;
         msg.serialize();
-        broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        broadcast_message(msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
 
         if (!permanent_notification_timeline_.empty()) {
             record_permanent_notification_ =
@@ -429,7 +430,7 @@ public:
             bmmo::permanent_notification_msg bulletin_msg{};
             std::tie(bulletin_msg.title, bulletin_msg.text_content) = record_permanent_notification_;
             bulletin_msg.serialize();
-            broadcast_message(bulletin_msg.raw.str().data(), bulletin_msg.size(), k_nSteamNetworkingSend_Reliable);
+            broadcast_message(bulletin_msg.data(), bulletin_msg.size(), k_nSteamNetworkingSend_Reliable);
         }
 
         seeking_ = false;
@@ -725,8 +726,7 @@ private:
         msg.content.connection_id = client;
         broadcast_message(msg, k_nSteamNetworkingSend_Reliable, client);
         std::string name = itClient->second.name;
-        if (auto itName = username_.find(name); itName != username_.end())
-            username_.erase(itName);
+        username_.erase(name);
         if (itClient != clients_.end())
             clients_.erase(itClient);
         Printf(bmmo::color_code(msg.code), "%s (#%u) disconnected.", name, client);
@@ -735,7 +735,7 @@ private:
         text_msg.text_content.resize(128);
         Sprintf(text_msg.text_content, "[Reality] %s disconnected.", name);
         text_msg.serialize();
-        broadcast_message(text_msg.raw.str().data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
+        broadcast_message(text_msg.data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
     }
 
     void on_message(ISteamNetworkingMessage* networking_msg) override {
@@ -747,14 +747,19 @@ private:
                     networking_msg->m_cbSize, networking_msg->m_conn);
             return;
         }
-        if (!(client_it != clients_.end() || raw_msg->code == bmmo::LoginRequest || raw_msg->code == bmmo::LoginRequestV2 || raw_msg->code == bmmo::LoginRequestV3)) { // ignore limbo clients message
+        if (!(client_it != clients_.end() || raw_msg->code == bmmo::LoginRequest || raw_msg->code == bmmo::LoginRequestV2 || raw_msg->code == bmmo::LoginRequestV3
+                || raw_msg->code == bmmo::LoginRequestV4)) { // ignore limbo clients message
             interface_->CloseConnection(networking_msg->m_conn, k_ESteamNetConnectionEnd_AppException_Min, "Invalid client", true);
             return;
         }
 
         switch (raw_msg->code) {
-            case bmmo::LoginRequestV3: {
-                auto msg = bmmo::message_utils::deserialize<bmmo::login_request_v3_msg>(networking_msg);
+            case bmmo::LoginRequestV3:
+            case bmmo::LoginRequestV4: {
+                // nothing is negotiated with replays; everyone gets the recorded messages as they are
+                auto msg = (raw_msg->code == bmmo::LoginRequestV3)
+                        ? bmmo::login_request_v4_msg::from(bmmo::message_utils::deserialize<bmmo::login_request_v3_msg>(networking_msg))
+                        : bmmo::message_utils::deserialize<bmmo::login_request_v4_msg>(networking_msg);
 
                 interface_->SetConnectionName(networking_msg->m_conn, msg.nickname.c_str());
                 if (msg.version < record_version_) {
@@ -771,11 +776,11 @@ private:
                             (msg.version.minor == record_version_.minor ? "subminor" : "minor"),
                             record_version_.to_string(), msg.version.to_string());
                     warning_msg.serialize();
-                    send(networking_msg->m_conn, warning_msg.raw.str().data(), warning_msg.size(), k_nSteamNetworkingSend_Reliable);
+                    send(networking_msg->m_conn, warning_msg.data(), warning_msg.size(), k_nSteamNetworkingSend_Reliable);
                     warning_msg.text_content = "Proceed at your own risk.";
                     warning_msg.clear();
                     warning_msg.serialize();
-                    send(networking_msg->m_conn, warning_msg.raw.str().data(), warning_msg.size(), k_nSteamNetworkingSend_Reliable);
+                    send(networking_msg->m_conn, warning_msg.data(), warning_msg.size(), k_nSteamNetworkingSend_Reliable);
                 }
                 if (seeking_) {
                     interface_->CloseConnection(networking_msg->m_conn, k_ESteamNetConnectionEnd_App_Min + 150 + 2,
@@ -785,7 +790,7 @@ private:
 
                 clients_[networking_msg->m_conn] = {msg.nickname, {}};  // add the client here
                 memcpy(clients_[networking_msg->m_conn].uuid, msg.uuid, sizeof(msg.uuid));
-                username_[msg.nickname] = networking_msg->m_conn;
+                username_.insert_or_assign(msg.nickname, networking_msg->m_conn);
                 Printf(bmmo::color_code(bmmo::LoginAcceptedV3), "%s (v%s) logged in!\n",
                         msg.nickname,
                         msg.version.to_string());
@@ -793,25 +798,25 @@ private:
                 bmmo::map_names_msg names_msg;
                 names_msg.maps = record_map_names_;
                 names_msg.serialize();
-                send(networking_msg->m_conn, names_msg.raw.str().data(), names_msg.size(), k_nSteamNetworkingSend_Reliable);
+                send(networking_msg->m_conn, names_msg.data(), names_msg.size(), k_nSteamNetworkingSend_Reliable);
 
                 bmmo::login_accepted_v3_msg accepted_msg{};
                 accepted_msg.online_players = record_clients_;
                 accepted_msg.serialize();
-                send(networking_msg->m_conn, accepted_msg.raw.str().data(), accepted_msg.size(), k_nSteamNetworkingSend_Reliable);
+                send(networking_msg->m_conn, accepted_msg.data(), accepted_msg.size(), k_nSteamNetworkingSend_Reliable);
 
                 if (!record_permanent_notification_.second.empty()) {
                     bmmo::permanent_notification_msg bulletin_msg{};
                     std::tie(bulletin_msg.title, bulletin_msg.text_content) = record_permanent_notification_;
                     bulletin_msg.serialize();
-                    send(networking_msg->m_conn, bulletin_msg.raw.str().data(), bulletin_msg.size(), k_nSteamNetworkingSend_Reliable);
+                    send(networking_msg->m_conn, bulletin_msg.data(), bulletin_msg.size(), k_nSteamNetworkingSend_Reliable);
                 }
 
                 bmmo::plain_text_msg text_msg;
                 text_msg.text_content.resize(128);
                 Sprintf(text_msg.text_content, "[Reality] %s joined the game.", msg.nickname);
                 text_msg.serialize();
-                broadcast_message(text_msg.raw.str().data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
+                broadcast_message(text_msg.data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
                 break;
             }
             case bmmo::Chat: {
@@ -821,7 +826,7 @@ private:
                 text_msg.text_content.resize(2048);
                 Sprintf(text_msg.text_content, "[Reality] %s: %s", client_it->second.name, msg.chat_content);
                 text_msg.serialize();
-                broadcast_message(text_msg.raw.str().data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
+                broadcast_message(text_msg.data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
                 break;
             }
             default:
@@ -829,6 +834,15 @@ private:
         }
     }
 
+    // recordings have either, depending on what the recording client asked for
+    static bmmo::login_accepted_v4_msg deserialize_login_accepted(bmmo::record_entry& entry) {
+        auto* raw_msg = reinterpret_cast<bmmo::general_message*>(entry.data);
+        if (raw_msg->code == bmmo::LoginAcceptedV3)
+            return bmmo::login_accepted_v4_msg::from(
+                    bmmo::message_utils::deserialize<bmmo::login_accepted_v3_msg>(entry.data, entry.size));
+        return bmmo::message_utils::deserialize<bmmo::login_accepted_v4_msg>(entry.data, entry.size);
+    }
+
     message_action_t parse_message(bmmo::record_entry& entry /*, SteamNetworkingMicroseconds time*/) {
         auto* raw_msg = reinterpret_cast<bmmo::general_message*>(entry.data);
         if (entry.size < static_cast<decltype(entry.size)>(sizeof(bmmo::opcode)))
@@ -836,8 +850,9 @@ private:
         // std::unique_lock<std::mutex> lk(record_data_mutex_);
         // Printf("Time: %7.2lf | Code: %2u | Size: %4d\n", time / 1e6, raw_msg->code, entry.size);
         switch (raw_msg->code) {
-            case bmmo::LoginAcceptedV3: {
-                auto msg = bmmo::message_utils::deserialize<bmmo::login_accepted_v3_msg>(entry.data, entry.size);
+            case bmmo::LoginAcceptedV3:
+            case bmmo::LoginAcceptedV4: {
+                auto msg = deserialize_login_accepted(entry);
                 record_clients_ = msg.online_players;
                 // printf("Code: LoginAcceptedV2\n");
                 // bmmo::login_accepted_v2_msg msg{};
@@ -911,13 +926,13 @@ private:
 
     SteamNetworkingMicroseconds current_record_time_{};
     std::unordered_map<HSteamNetConnection, bmmo::player_status_v3> record_clients_;
-    std::unordered_map<std::string, std::string> record_map_names_;
+    bmmo::map_name_table record_map_names_;
 
     HSteamListenSocket listen_socket_ = k_HSteamListenSocket_Invalid;
     HSteamNetPollGroup poll_group_ = k_HSteamNetPollGroup_Invalid;
 
     std::unordered_map<HSteamNetConnection, client_data> clients_;
-    std::unordered_map<std::string, HSteamNetConnection> username_;
+    bmmo::name_index<HSteamNetConnection> username_;
 };
 
 // parse arguments (optional port and help/version) with getopt
@@ -1040,7 +1055,7 @@ int main(int argc, char** argv) {
         auto text = console.get_rest_of_line();
         text_msg.text_content = "[Reality] [Server]: " + text;
         text_msg.serialize();
-        replayer.broadcast_message(text_msg.raw.str().data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
+        replayer.broadcast_message(text_msg.data(), text_msg.size(), k_nSteamNetworkingSend_Reliable);
         Printf("[Server]: %s", text);
     });
     console.register_command("load", [&]() {
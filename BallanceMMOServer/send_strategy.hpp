@@ -0,0 +1,29 @@
+#ifndef BALLANCEMMOSERVER_SEND_STRATEGY_HPP
+#define BALLANCEMMOSERVER_SEND_STRATEGY_HPP
+#include <cstdint>
+#include "../BallanceMMOCommon/common.hpp"
+
+// How broadcasts are sent to a connection, chosen once at login from the
+// capabilities enabled for it. Clients which didn't list any get what
+// every client got before capabilities existed.
+struct send_strategy {
+    enum class ball_encoding: uint8_t {
+        Compressed, // OwnedCompressedBallState
+        Quantized,  // OwnedQuantizedBallState
+        Delta,      // OwnedDeltaBallState; needs a `ball_delta_encoder` for the connection
+    };
+
+    ball_encoding balls = ball_encoding::Compressed;
+
+    // Picks the smallest of the enabled formats.
+    static send_strategy choose(const bmmo::capability_set& enabled) {
+        send_strategy strategy;
+        if (enabled.encodings & bmmo::capability::DeltaBallState)
+            strategy.balls = ball_encoding::Delta;
+        else if (enabled.encodings & bmmo::capability::QuantizedBallState)
+            strategy.balls = ball_encoding::Quantized;
+        return strategy;
+    }
+};
+
+#endif //BALLANCEMMOSERVER_SEND_STRATEGY_HPP
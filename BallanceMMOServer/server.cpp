@@ -8,11 +8,14 @@
 #include <vector>
 #include <unordered_set>
 #include <condition_variable>
+#include <future>
+#include <thread>
+#include <cassert>
 #include "../BallanceMMOCommon/common.hpp"
 
 // #include <iomanip>
 #include <mutex>
-// #include <shared_mutex>
+#include <ranges>
 #include <fstream>
 #include <filesystem>
 
@@ -23,6 +26,13 @@
 #include <picojson/picojson.h>
 #include "server_data.hpp"
 #include "config_manager.hpp"
+#include "login_journal.hpp"
+#include "leaderboard_store.hpp"
+#include "tick_scheduler.hpp"
+#include "message_batch.hpp"
+#include "server_metrics.hpp"
+#include "profiler.hpp"
+#include "world_snapshot.hpp"
 
 using bmmo::Printf, bmmo::Sprintf, bmmo::LogFileOutput, bmmo::FatalError;
 
@@ -30,24 +40,94 @@ class server: public role {
 public:
     explicit server(uint16_t port) {
         port_ = port;
+        config_.set_persistence_worker(&persistence_);
+        broadcast_batch_.set_traffic(&metrics_.sent);
+        create_room(DEFAULT_ROOM);
+        register_message_handlers();
+        schedule_metrics_export();
     }
 
     void run() override {
+        server_thread_id_ = std::this_thread::get_id();
+        auto next_phase_alignment = std::chrono::steady_clock::now();
         while (running_) {
-            auto update_begin = std::chrono::steady_clock::now();
-            update();
-            if (ticking_) {
-                std::this_thread::sleep_until(update_begin + bmmo::SERVER_TICK_DELAY);
-                tick();
+            bool received, ran_tasks;
+            std::chrono::steady_clock::time_point now;
+            {
+                BMMO_PROFILE_FRAME(stage_profiler::ServerLoop);
+                received = update();
+                ran_tasks = run_posted_tasks();
+                now = std::chrono::steady_clock::now();
+                run_due_timers(now);
+                if (now >= next_phase_alignment) {
+                    align_tick_phase();
+                    next_phase_alignment = now + PHASE_ALIGNMENT_INTERVAL;
+                }
+                publish_world();
+            }
+            // there may be more messages waiting if we've just received a full batch
+            if (!received && !ran_tasks) {
+                auto deadline = std::min(next_phase_alignment, now + bmmo::SERVER_IDLE_WAIT_INTERVAL);
+                if (!timers_.empty())
+                    deadline = std::min(deadline, timers_.begin()->first);
+                if (publish_pending_)
+                    deadline = std::min(deadline, now + POSTED_TASK_LATENCY);
+                wait_for_events(deadline);
             }
-            std::this_thread::sleep_until(update_begin + bmmo::SERVER_RECEIVE_INTERVAL);
         }
+        // callers of `call` stop waiting once this is set, so nothing may run after it;
+        // throwing tasks away wakes up those waiting on them right away
+        tasks_discarded_ = true;
+        while (posted_tasks_.pop()) {}
+        // we may be restarted right after exiting; don't leave anything unsaved
+        persistence_.flush();
 
 //        while (running_) {
 //            poll_local_state_changes();
 //        }
     }
 
+    // Queues `task` to be run on the server thread between polls.
+    // This is the only way other threads (i.e. the console) may touch server state.
+    // The server thread notices it within POSTED_TASK_LATENCY even when idle.
+    void post(std::function<void()> task) {
+        posted_tasks_.push(std::move(task));
+        tasks_posted_.store(true, std::memory_order_release);
+    }
+
+    // Runs `task` on the server thread and waits for it to finish. Not for the server thread itself.
+    // Returns without running it if the server stops in the meantime; `task` is never run after that,
+    // so it may refer to the caller's locals.
+    void call(std::function<void()> task) {
+        assert(std::this_thread::get_id() != server_thread_id_.load() && "call() would wait for itself");
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        auto result = packaged->get_future();
+        post([packaged] { (*packaged)(); });
+        packaged.reset(); // the queue holds the only reference, so discarding the task breaks the promise
+        while (result.wait_for(bmmo::SERVER_IDLE_WAIT_INTERVAL) != std::future_status::ready) {
+            if (tasks_discarded_)
+                return;
+        }
+        try {
+            result.get();
+        } catch (const std::future_error& e) {
+            if (e.code() != std::future_errc::broken_promise)
+                throw;
+        }
+    }
+
+    // Runs `task` on the server thread after `delay`. Server thread only.
+    void schedule(std::chrono::steady_clock::duration delay, std::function<void()> task) {
+        timers_.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+    }
+
+    bool shutting_down() const noexcept { return shutting_down_; }
+
+    bool update() override {
+        BMMO_PROFILE_SCOPE(stage_profiler::Update);
+        return role::update();
+    }
+
     void poll_local_state_changes() override {
         std::string cmd;
         std::cin >> cmd;
@@ -57,6 +137,7 @@ public:
     }
 
     EResult send(const HSteamNetConnection destination, const void* buffer, size_t size, int send_flags = k_nSteamNetworkingSend_Reliable, int64* out_message_number = nullptr) const {
+        metrics_.sent.record(buffer, size);
         return interface_->SendMessageToConnection(destination,
                                                    buffer,
                                                    size,
@@ -75,12 +156,18 @@ public:
                     out_message_number);
     }
 
+    // Broadcasts go out in a single SendMessages call, with all recipients sharing one copy of the message.
+    // They're flushed right away rather than once per loop, to keep their order relative to `send`.
     void broadcast_message(const void* buffer, size_t size, int send_flags = k_nSteamNetworkingSend_Reliable, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
-        for (auto& i: clients_)
-            if (ignored_client != i.first)
-                send(i.first, buffer, size,
-                                                    send_flags,
-                                                    nullptr);
+        broadcast_batch_.add(clients_ | std::views::keys, buffer, size, send_flags, ignored_client);
+        broadcast_batch_.flush(interface_);
+    }
+
+    void broadcast_message(bmmo::serializable_message& msg, int send_flags = k_nSteamNetworkingSend_Reliable, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+        auto* payload = make_payload(msg);
+        broadcast_batch_.add(clients_ | std::views::keys, payload, send_flags, ignored_client);
+        payload->release();
+        broadcast_batch_.flush(interface_);
     }
 
     template<bmmo::trivially_copyable_msg T>
@@ -90,6 +177,31 @@ public:
         broadcast_message(&msg, sizeof(msg), send_flags, ignored_client);
     }
 
+    void broadcast_to_room(const room_data& room, const void* buffer, size_t size, int send_flags = k_nSteamNetworkingSend_Reliable, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+        broadcast_batch_.add(room.members, buffer, size, send_flags, ignored_client);
+        broadcast_batch_.flush(interface_);
+    }
+
+    void broadcast_to_room(const room_data& room, bmmo::serializable_message& msg, int send_flags = k_nSteamNetworkingSend_Reliable, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+        auto* payload = make_payload(msg);
+        broadcast_batch_.add(room.members, payload, send_flags, ignored_client);
+        payload->release();
+        broadcast_batch_.flush(interface_);
+    }
+
+    static shared_payload* make_payload(const bmmo::serializable_message& msg) {
+        auto* payload = shared_payload::create(msg.size());
+        std::memcpy(payload->data(), msg.data(), msg.size());
+        return payload;
+    }
+
+    template<bmmo::trivially_copyable_msg T>
+    void broadcast_to_room(const room_data& room, const T& msg, int send_flags = k_nSteamNetworkingSend_Reliable, const HSteamNetConnection ignored_client = k_HSteamNetConnection_Invalid) {
+        static_assert(std::is_trivially_copyable<T>());
+
+        broadcast_to_room(room, &msg, sizeof(msg), send_flags, ignored_client);
+    }
+
     void receive(void* data, size_t size, HSteamNetConnection client = k_HSteamNetConnection_Invalid) {
         if (get_client_count() == 0) { Printf("Error: no online players found."); return; }
         auto* networking_msg = SteamNetworkingUtils()->AllocateMessage(0);
@@ -102,28 +214,27 @@ public:
         networking_msg->Release();
     }
 
-    auto& get_bulletin() { return permanent_notification_; }
+    // The room console commands like `bulletin` and `scores` operate on.
+    room_data& get_console_room() { return rooms_.at(console_room_); }
 
+    // Accepts unique prefixes of names; a full name wins over longer names starting with it.
     HSteamNetConnection get_client_id(const std::string& username, bool suppress_error = false) const {
         if (username.empty()) return k_HSteamNetConnection_Invalid;
-        const std::string begin_name(bmmo::message_utils::to_lower(username));
-        std::string end_name(begin_name);
-        ++end_name[end_name.length() - 1];
-        auto username_it = username_.lower_bound(begin_name);
-        const auto username_it_end = username_.lower_bound(end_name);
-        if (username_it == username_it_end) {
-            if (!suppress_error)
-                Printf("Error: client \"%s\" not found.", username);
+        if (const auto* entry = username_.find_unique(username))
+            return entry->value;
+        if (suppress_error)
             return k_HSteamNetConnection_Invalid;
-        }
-        else if (std::next(username_it) == username_it_end || username_it->first == username) {
-            return username_it->second;
-        }
         std::string names;
-        for (; username_it != username_it_end; ++username_it)
-            names += ", " + username_it->first;
-        if (!suppress_error)
+        if (const auto matches = username_.find_prefix(username); !matches.empty()) {
+            for (const auto* match: matches)
+                names += ", " + match->name;
             Printf("Error: multiple possible players: %s.", names.erase(0, 2));
+            return k_HSteamNetConnection_Invalid;
+        }
+        for (const auto& [_, match]: username_.find_fuzzy(username, MAX_NAME_SUGGESTION_DISTANCE))
+            names += ", " + match->name;
+        Printf("Error: client \"%s\" not found%s.", username,
+                names.empty() ? "" : "; did you mean " + names.erase(0, 2) + "?");
         return k_HSteamNetConnection_Invalid;
     }
 
@@ -138,15 +249,177 @@ public:
     inline int get_client_count() const noexcept { return clients_.size(); }
 
     inline config_manager get_config() { return config_; }
-    inline const bmmo::map& get_last_countdown_map() const { return last_countdown_map_; }
-
-    const bmmo::ranking_entry::player_rankings* get_map_rankings(const bmmo::map& map) {
-        auto map_it = maps_.find(map.get_hash_bytes_string());
-        if (map_it == maps_.end() || (map_it->second.rankings.first.empty() && map_it->second.rankings.second.empty()))
+    ranking_board* get_map_rankings(const bmmo::map& map, room_data& room) {
+        auto map_it = room.maps.find(map.key());
+        if (map_it == room.maps.end() || map_it->second.rankings.empty())
             return nullptr;
         return &(map_it->second.rankings);
     }
 
+    room_data& get_room(HSteamNetConnection client) { return rooms_.at(clients_.at(client).room); }
+
+    room_data* find_room(const std::string& name) {
+        auto room_it = rooms_.find(name);
+        return room_it == rooms_.end() ? nullptr : &room_it->second;
+    }
+
+    bool create_room(const std::string& name) {
+        if (rooms_.contains(name)) {
+            Printf("Error: room \"%s\" already exists.", name);
+            return false;
+        }
+        auto& room = rooms_[name];
+        room.name = name;
+        room.ghost_mode = config_.ghost_mode;
+        room.ticker = std::make_unique<tick_scheduler>(bmmo::SERVER_TICK_INTERVAL, [this, &room] { tick(room); });
+        room.outgoing.set_traffic(&metrics_.sent);
+        roster_changed_ = true;
+        return true;
+    }
+
+    // Moves everyone in the room back to the default room before removing it.
+    bool remove_room(const std::string& name) {
+        auto room_it = rooms_.find(name);
+        if (room_it == rooms_.end()) {
+            Printf("Error: room \"%s\" not found.", name);
+            return false;
+        }
+        if (name == DEFAULT_ROOM) {
+            Printf("Error: the default room cannot be removed.");
+            return false;
+        }
+        for (auto client: std::vector(room_it->second.members.begin(), room_it->second.members.end()))
+            move_client(client, DEFAULT_ROOM);
+        room_it->second.ticker->stop();
+        rooms_.erase(room_it);
+        if (console_room_ == name)
+            console_room_ = DEFAULT_ROOM;
+        // nothing may compare against the room's address anymore, a new room might get it
+        roster_changed_ = true;
+        publish_world();
+        return true;
+    }
+
+    bool select_console_room(const std::string& name) {
+        if (!rooms_.contains(name)) {
+            Printf("Error: room \"%s\" not found.", name);
+            return false;
+        }
+        console_room_ = name;
+        return true;
+    }
+
+    bool move_client(HSteamNetConnection client, const std::string& room_name) {
+        if (!client_exists(client))
+            return false;
+        auto to_it = rooms_.find(room_name);
+        if (to_it == rooms_.end()) {
+            Printf("Error: room \"%s\" not found.", room_name);
+            return false;
+        }
+        auto& data = clients_[client];
+        auto& from = rooms_.at(data.room);
+        auto& to = to_it->second;
+        if (&from == &to) {
+            Printf("Error: (#%u, %s) is already in room \"%s\".", client, data.name, room_name);
+            return false;
+        }
+
+        std::vector<bmmo::owned_timed_ball_state> own_ball, from_balls, to_balls;
+        from.members.erase(client);
+        to.members.insert(client);
+        data.room = room_name;
+        // the old room's tick thread may still be encoding for us with its last snapshot
+        if (data.delta_encoder)
+            data.delta_encoder = data.delta_encoder->successor();
+        const size_t index = clients_.index_of(client);
+        clients_.set_room(index, &to);
+        clients_.touch_state(index); // so that the new room gets our ball on its next tick
+        const auto own_state = clients_.state(index);
+        roster_changed_ = true;
+        pull_ball_states(from, from_balls);
+        pull_ball_states(to, to_balls);
+
+        // neither side should keep seeing the other's balls where they last were
+        if (!own_state.timestamp.is_zero()) {
+            own_ball.emplace_back(own_state, client);
+            send_hidden_ball_states(own_ball, from);
+        }
+        if (!from_balls.empty()) {
+            bmmo::owned_compressed_ball_state_msg ball_msg{};
+            ball_msg.balls = std::move(from_balls);
+            hide_ball_states(ball_msg.balls);
+            ball_msg.serialize();
+            send(client, ball_msg.data(), ball_msg.size());
+        }
+        if (!to.ghost_mode || ghost_spectator_clients_.contains(client)) {
+            bmmo::owned_compressed_ball_state_msg ball_msg{};
+            ball_msg.balls = std::move(to_balls);
+            ball_msg.serialize();
+            send(client, ball_msg.data(), ball_msg.size(), k_nSteamNetworkingSend_ReliableNoNagle);
+        }
+
+        const auto bulletin = get_bulletin_payload(to);
+        send(client, bulletin.data(), bulletin.size(), k_nSteamNetworkingSend_Reliable);
+
+        bmmo::chat_msg notice_msg{};
+        notice_msg.chat_content = "You are now in room \"" + room_name + "\".";
+        notice_msg.serialize();
+        send(client, notice_msg.data(), notice_msg.size(), k_nSteamNetworkingSend_Reliable);
+
+        Printf("(#%u, %s) moved from room \"%s\" to \"%s\".", client, data.name, from.name, to.name);
+        on_room_left(from);
+        update_room_ticking(from);
+        update_room_ticking(to);
+        return true;
+    }
+
+    // Ball states are only relayed within the same map, so players entering a map
+    // need to know where everyone already there is, even if they haven't moved since.
+    void send_map_snapshot(HSteamNetConnection client) {
+        auto& room = get_room(client);
+        if (room.ghost_mode && !ghost_spectator_clients_.contains(client))
+            return;
+        bmmo::owned_compressed_ball_state_msg ball_msg{};
+        pull_ball_states(room, ball_msg.balls, &clients_[client].current_map);
+        std::erase_if(ball_msg.balls, [client](const auto& ball) { return ball.player_id == client; });
+        if (ball_msg.balls.empty())
+            return;
+        ball_msg.serialize();
+        send(client, ball_msg.data(), ball_msg.size(), k_nSteamNetworkingSend_ReliableNoNagle);
+    }
+
+    void set_room_ghost_mode(room_data& room, bool ghost_mode) {
+        if (room.ghost_mode == ghost_mode)
+            return;
+        room.ghost_mode = ghost_mode;
+        roster_changed_ = true;
+        bmmo::owned_compressed_ball_state_msg ball_msg{};
+        pull_ball_states(room, ball_msg.balls);
+        // send everyone except ghost spectators a message that sets parts of
+        // other players' positions to infinity, effectively hiding them
+        if (ghost_mode)
+            hide_ball_states(ball_msg.balls);
+        ball_msg.serialize();
+        for (const auto& client: room.members) {
+            if (!ghost_spectator_clients_.contains(client))
+                send(client, ball_msg.data(), ball_msg.size());
+        }
+        Printf("Ghost mode %s in room \"%s\".", ghost_mode ? "enabled" : "disabled", room.name);
+    }
+
+    void print_rooms() {
+        for (const auto& [name, room]: rooms_) {
+            std::string members;
+            for (const auto& client: room.members)
+                members += ", " + clients_[client].name;
+            Printf("%s%s (%d player%s%s)%s%s", name, name == console_room_ ? " [Selected]" : "",
+                    room.members.size(), room.members.size() == 1 ? "" : "s",
+                    room.ghost_mode ? ", ghost mode" : "",
+                    members.empty() ? "" : ": ", members.empty() ? "" : members.erase(0, 2));
+        }
+    }
+
     bool kick_client(HSteamNetConnection client, std::string reason = "",
             HSteamNetConnection executor = k_HSteamNetConnection_Invalid,
             bmmo::connection_end::code type = bmmo::connection_end::Kicked) {
@@ -186,7 +459,7 @@ public:
 
         interface_->CloseConnection(client, type, kick_notice.c_str(), true);
         msg.serialize();
-        broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
 
         return true;
     }
@@ -195,47 +468,37 @@ public:
         const bool prev_ghost_mode = config_.ghost_mode;
         if (!config_.load())
             return false;
+        profiler_.set_enabled(config_.profiling);
+        profiler_.set_budget(std::chrono::microseconds(int64_t(config_.slow_tick_budget_ms * 1000)));
+        quantized_position_bits_.store(config_.quantized_position_bits, std::memory_order_relaxed);
         if (get_client_count() < 1) map_names_.clear();
         map_names_.insert(config_.default_map_names.begin(), config_.default_map_names.end());
+        login_cache_.map_names.invalidate();
+        login_cache_.extra_life.invalidate();
         if (get_client_count() > 0) {
             if (!map_names_.empty()) {
-                bmmo::map_names_msg name_msg;
-                name_msg.maps = map_names_;
-                name_msg.serialize();
-                broadcast_message(name_msg.raw.str().data(), name_msg.size());
-            }
-            bmmo::extra_life_msg life_msg;
-            life_msg.life_count_goals = config_.initial_life_counts;
-            life_msg.serialize();
-            broadcast_message(life_msg.raw.str().data(), life_msg.size());
-            if (config_.ghost_mode != prev_ghost_mode) {
-                // send everyone except ghost spectators a message that sets parts of
-                // other players' positions to infinity, effectively hiding them
-                bmmo::owned_compressed_ball_state_msg ball_msg{};
-                pull_ball_states(ball_msg.balls);
-                if (config_.ghost_mode) {
-                    for (auto& state: ball_msg.balls) {
-                        state.state.position.y = std::numeric_limits<float>::infinity();
-                        state.state.timestamp += bmmo::CLIENT_MINIMUM_UPDATE_INTERVAL_MS;
-                    }
-                }
-                ball_msg.serialize();
-                for (const auto& [client, _]: clients_) {
-                    if (!ghost_spectator_clients_.contains(client))
-                        send(client, ball_msg.raw.str().data(), ball_msg.size());
-                }
+                const auto map_names = get_map_names_payload();
+                broadcast_message(map_names.data(), map_names.size());
             }
+            const auto extra_life = get_extra_life_payload();
+            broadcast_message(extra_life.data(), extra_life.size());
+        }
+        // the config value is the default of all rooms; room-specific overrides last until it changes
+        if (config_.ghost_mode != prev_ghost_mode) {
+            for (auto& [_, room]: rooms_)
+                set_room_ghost_mode(room, config_.ghost_mode);
         }
         return true;
     }
 
     void print_clients(bool print_uuid = false) {
-        decltype(username_) spectators;
-        const auto max_name_length = (int) std::min(bmmo::name_validator::max_length + 1,
-            std::ranges::max_element(
-                username_,
-                [](const auto& p1, decltype(p1) p2) { return p1.first.length() < p2.first.length(); }
-            )->first.length());
+        std::vector<HSteamNetConnection> players, spectators;
+        size_t longest_name = 0;
+        username_.for_each([&](const auto& entry) {
+            (bmmo::name_validator::is_spectator(entry.name) ? spectators : players).push_back(entry.value);
+            longest_name = std::max(longest_name, entry.name.length());
+        });
+        const auto max_name_length = (int) std::min(bmmo::name_validator::max_length + 1, longest_name);
         static const auto print_client = [&](auto id, auto data) {
             SteamNetConnectionRealTimeStatus_t status{};
             interface_->GetConnectionRealTimeStatus(id, &status, 0, nullptr);
@@ -249,16 +512,12 @@ public:
                     data.cheated ? " [CHEAT]" : "", is_op(id) ? " [OP]" : "",
                     is_muted(data.uuid) ? " [Muted]" : "");
         };
-        for (const auto& i: username_) {
-            if (bmmo::name_validator::is_spectator(i.first))
-                spectators.insert(i);
-            else
-                print_client(i.second, clients_[i.second]);
-        }
-        for (const auto& i: spectators)
-            print_client(i.second, clients_[i.second]);
+        for (auto id: players)
+            print_client(id, clients_[id]);
+        for (auto id: spectators)
+            print_client(id, clients_[id]);
         Printf("%d client(s) online: %d player(s), %d spectator(s).",
-            clients_.size(), clients_.size() - spectators.size(), spectators.size());
+            clients_.size(), players.size(), spectators.size());
     }
 
     void print_maps() const {
@@ -266,42 +525,182 @@ public:
         for (const auto& [hash, name]: map_names_) map_names_inverted.emplace(name, hash);
         for (const auto& [name, hash]: map_names_inverted) {
             std::string hash_string;
-            bmmo::string_from_hex_chars(hash_string, reinterpret_cast<const uint8_t*>(hash.c_str()), sizeof(bmmo::map::md5));
+            bmmo::string_from_hex_chars(hash_string, hash.md5, sizeof(hash.md5));
             Printf("%s: %s", hash_string, name);
         }
     }
 
     void print_player_maps() {
-        for (const auto& [_, id]: username_) {
+        username_.for_each([this](const auto& entry) {
+            const auto id = entry.value;
             const auto& data = clients_[id];
             Printf("%s(#%u, %s) is at the %d%s sector of %s.",
                 data.cheated ? "[CHEAT] " : "", id, data.name,
                 data.current_sector, bmmo::string_utils::get_ordinal_suffix(data.current_sector),
                 data.current_map.get_display_name(map_names_));
-        }
+        });
     }
 
     void print_positions() {
-        for (const auto& [_, id]: username_) {
-            const auto& data = clients_[id];
+        username_.for_each([this](const auto& entry) {
+            const auto id = entry.value;
+            const size_t index = clients_.index_of(id);
+            const auto& state = clients_.state(index);
             Printf("(%u, %s) is at %.2f, %.2f, %.2f with %s ball.",
-                    id, data.name,
-                    data.state.position.x, data.state.position.y, data.state.position.z,
-                    data.state.get_type_name()
+                    id, clients_.data(index).name,
+                    state.position.x, state.position.y, state.position.z,
+                    state.get_type_name()
             );
+        });
+    }
+
+    // Per-opcode numbers of received messages, busiest handlers first.
+    void print_opstats() {
+        using stats_type = decltype(dispatcher_)::opcode_stats;
+        std::vector<std::pair<bmmo::opcode, stats_type>> entries;
+        dispatcher_.for_each_stats([&](bmmo::opcode code, const stats_type& stats) {
+            if (stats.calls > 0)
+                entries.emplace_back(code, stats);
+        });
+        if (entries.empty()) {
+            Printf("No messages received yet.");
+            return;
+        }
+        std::ranges::sort(entries, std::greater{}, [](const auto& entry) { return entry.second.time; });
+        Printf("%-26s %10s %8s %12s %11s %9s", "Opcode", "Calls", "Rejected", "Bytes", "Total (ms)", "Avg (us)");
+        for (const auto& [code, stats]: entries) {
+            using namespace std::chrono;
+            const double total_us = duration<double, std::micro>(stats.time).count();
+            Printf("%-26s %10llu %8llu %12llu %11.2f %9.2f",
+                    bmmo::opcode_name(code), stats.calls, stats.rejected, stats.bytes,
+                    total_us / 1000, total_us / stats.calls);
+        }
+    }
+
+    void reset_opstats() {
+        dispatcher_.reset_stats();
+    }
+
+    void set_profiling(bool enabled) {
+        profiler_.set_enabled(enabled);
+        Printf("Profiling is now %s.", enabled ? "on" : "off");
+    }
+
+    void print_profiling_status() const {
+#ifdef BMMO_ENABLE_PROFILER
+        Printf("Profiling is %s; frames over %.2f ms are reported.", profiler_.enabled() ? "on" : "off",
+                std::chrono::duration<double, std::milli>(profiler_.get_budget()).count());
+#else
+        Printf("Profiling was not compiled in (BMMO_ENABLE_PROFILER).");
+#endif
+    }
+
+    void print_stats() {
+        update_metrics();
+        metrics_.registry.print_summary();
+    }
+
+    // @param key - a UUID, an IP address or an online player's name or #id.
+    void print_login_history(std::string key, size_t max_count) {
+        if (!login_history_.find_by_uuid(key) && !login_history_.find_by_ip(key)) {
+            HSteamNetConnection client = (key[0] == '#') ? std::atoll(key.substr(1).c_str()) : get_client_id(key, true);
+            if (client_exists(client, true))
+                key = bmmo::string_utils::get_uuid_string(clients_[client].uuid);
+        }
+        login_history_.print_history(key, max_count);
+    }
+
+    // All-time standings, read in by the leaderboard's own thread and printed from there.
+    void print_leaderboard(bool hs_mode, bmmo::map map) {
+        const auto mode = hs_mode ? bmmo::level_mode::Highscore : bmmo::level_mode::Speedrun;
+        leaderboard_.query(map.key(), mode, LEADERBOARD_PRINT_COUNT, {},
+                [hs_mode, map_name = map.get_display_name(map_names_)](leaderboard_store::standings standings) {
+            if (standings.run_count == 0) {
+                Printf(bmmo::ansi::BrightRed, "Error: no runs of %s [%s] recorded yet.", map_name, hs_mode ? "HS" : "SR");
+                return;
+            }
+            Printf("All-time rankings for %s [%s]:", map_name, hs_mode ? "HS" : "SR");
+            for (size_t i = 0; i < standings.best.size(); ++i) {
+                const auto& run = standings.best[i];
+                const auto time = static_cast<time_t>(run.time);
+                std::string date(12, 0);
+                date.resize(std::strftime(date.data(), date.size(), "%F", std::localtime(&time)));
+                Printf(bmmo::color_code(bmmo::LevelFinishV2), "<%zu> %s: %s | %s (%s)", i + 1, run.name,
+                        run.formatted_hs_score, bmmo::get_formatted_time(run.sr_time), date);
+            }
+            Printf("%zu player(s), %zu run(s) in total.", standings.player_count, standings.run_count);
+        });
+    }
+
+    // For when nobody has finished `map` in the room yet: sends the all-time standings
+    // instead, once the leaderboard's thread has them.
+    void send_leaderboard_scores(HSteamNetConnection client, bmmo::map map, bmmo::level_mode mode) {
+        leaderboard_.query(map.key(), mode, LEADERBOARD_SCORE_LIST_COUNT, {},
+                [this, client, map, mode](leaderboard_store::standings standings) {
+            post([this, client, map, mode, standings = std::move(standings)] {
+                if (!clients_.contains(client))
+                    return;
+                if (standings.best.empty()) {
+                    send(client, bmmo::action_denied_msg{.content = {bmmo::deny_reason::TargetNotFound}},
+                            k_nSteamNetworkingSend_Reliable);
+                    return;
+                }
+                bmmo::score_list_msg msg{};
+                msg.map = map;
+                msg.mode = mode;
+                for (const auto& run: standings.best) {
+                    msg.rankings.first.push_back({{run.cheated, run.name}, run.mode,
+                            int(msg.rankings.first.size() + 1), run.sr_time, run.formatted_hs_score, run.hs_score});
+                }
+                msg.serialize();
+                send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            });
+        });
+    }
+
+    // Adds a finish to the leaderboard and announces it in the log if it's a new personal best.
+    void record_run(client_data& client, const bmmo::level_finish_v2& finish, const std::string& formatted_score) {
+        // the time may be the client's own; NaN can't be ranked
+        if (!std::isfinite(finish.timeElapsed)) {
+            Printf("Warning: not recording a run of %s with an invalid time.", client.name);
+            return;
+        }
+        leaderboard_store::run run{
+            .time = std::time(nullptr),
+            .map = finish.map.key(),
+            .mode = finish.mode,
+            .uuid = bmmo::string_utils::get_uuid_string(client.uuid),
+            .name = client.name,
+            .cheated = finish.cheated,
+            .sr_time = finish.timeElapsed,
+            .hs_score = finish.get_score(),
+            .formatted_hs_score = formatted_score,
+        };
+        if (run.cheated) {
+            leaderboard_.record_run(std::move(run));
+            return;
         }
+        auto uuid = run.uuid;
+        leaderboard_.record_run(run);
+        leaderboard_.query(run.map, finish.mode, 0, std::move(uuid),
+                [run, map_name = finish.map.get_display_name(map_names_)](leaderboard_store::standings standings) {
+            if (!standings.personal_best || standings.personal_best->time != run.time
+                    || standings.personal_best->sr_time != run.sr_time || standings.personal_best->hs_score != run.hs_score)
+                return;
+            Printf(bmmo::color_code(bmmo::LevelFinishV2), "New personal best of %s on %s%s: %zu%s of %zu all-time.",
+                    run.name, map_name, get_level_mode_label(run.mode), standings.personal_rank,
+                    bmmo::string_utils::get_ordinal_suffix(standings.personal_rank), standings.player_count);
+        });
     }
 
-    void print_scores(bool hs_mode, bmmo::map map) {
-        auto map_it = maps_.find(map.get_hash_bytes_string());
-        if (map_it == maps_.end() || (map_it->second.rankings.first.empty() && map_it->second.rankings.second.empty())) {
+    void print_scores(bool hs_mode, bmmo::map map, room_data& room) {
+        const auto* ranks = get_map_rankings(map, room);
+        if (!ranks) {
             Printf(bmmo::ansi::BrightRed, "Error: ranking info not found for the specified map.");
             return;
         }
-        auto& ranks = map_it->second.rankings;
-        bmmo::ranking_entry::sort_rankings(ranks, hs_mode);
         auto formatted_texts = bmmo::ranking_entry::get_formatted_rankings(
-                ranks, map.get_display_name(map_names_), hs_mode);
+                ranks->top_finishes(hs_mode), ranks->top_dnfs(), map.get_display_name(map_names_), hs_mode);
         for (const auto& [line, color]: formatted_texts)
             Printf(color, line.c_str());
     }
@@ -316,31 +715,118 @@ public:
             "%F %T", std::localtime(&init_time_t_)));
         Printf("Server uptime: %.2f seconds since %s.",
                         uptime * 1e-6, time_str);
+        Printf("Ball state codec: %s.", bmmo::ball_state_codec::get_kernel_name(bmmo::ball_state_codec::get_active_kernel()));
     }
 
-    inline void pull_ball_states(std::vector<bmmo::owned_timed_ball_state>& balls) {
-        for (auto& i: clients_) {
-            std::unique_lock<std::mutex> lock(client_data_mutex_);
-            if (i.second.state.timestamp.is_zero())
+    // @param map - only pull balls of players on this map if not `nullptr`.
+    inline void pull_ball_states(const room_data& room, std::vector<bmmo::owned_timed_ball_state>& balls, const bmmo::map* map = nullptr) {
+        for (size_t i = 0; i < clients_.size(); ++i) {
+            if (clients_.room(i) != &room)
+                continue;
+            const auto& state = clients_.state(i);
+            if (state.timestamp.is_zero() || (map && clients_.data(i).current_map != *map))
                 continue;
-            balls.emplace_back(i.second.state, i.first);
+            balls.emplace_back(state, clients_.id(i));
         }
     }
 
-    inline void pull_unupdated_ball_states(std::vector<bmmo::owned_timed_ball_state>& balls, std::vector<bmmo::owned_timestamp>& unchanged_balls) {
-        for (auto& i: clients_) {
-            std::unique_lock<std::mutex> lock(client_data_mutex_);
-            if (!i.second.state_updated) {
-                balls.emplace_back(i.second.state, i.first);
-                i.second.state_updated = true;
+    // Makes what the server thread has done so far visible to the tick threads and the console.
+    // Cheap when nothing but ball states changed, as the roster is only rebuilt when it did.
+    void publish_world() {
+        // every insert and erase changes the roster, but a missed one mustn't misalign states
+        roster_changed_ |= (roster_->clients.size() != clients_.size());
+        if (!roster_changed_ && !publish_pending_ && published_serial_ == clients_.serial())
+            return;
+        if (roster_changed_) {
+            auto roster = std::make_shared<world_roster>();
+            roster->clients.reserve(clients_.size());
+            for (size_t i = 0; i < clients_.size(); ++i) {
+                const auto id = clients_.id(i);
+                const auto& data = clients_.data(i);
+                const auto* room = clients_.room(i);
+                roster->clients.push_back({id, data.name, room, data.current_map.key(),
+                        !room->ghost_mode || ghost_spectator_clients_.contains(id), data.strategy, data.delta_encoder});
             }
-            if (!i.second.timestamp_updated) {
-                unchanged_balls.emplace_back(i.second.state.timestamp, i.first);
-                i.second.timestamp_updated = true;
+            for (const auto& client: roster->clients)
+                roster->names.insert_or_assign(client.name, client.id);
+            for (const auto& [name, _]: rooms_)
+                roster->room_names.push_back(name);
+            roster_ = std::move(roster);
+            roster_changed_ = false;
+        }
+        auto* world = world_.prepare();
+        // readers are slow; retry on the next loop iteration, which mustn't wait long then:
+        // the last snapshot may still refer to rooms that are gone
+        publish_pending_ = (world == nullptr);
+        if (!world)
+            return;
+        world->roster = roster_;
+        world->states = clients_.states();
+        world->state_serials = clients_.state_serials();
+        world->timestamp_serials = clients_.timestamp_serials();
+        world->serial = published_serial_ = clients_.serial();
+        world_.publish();
+    }
+
+    // Sorts the room's ball states changed since its last tick and their recipients into groups
+    // by current map. Runs on the room's tick thread, so it only reads the published `world`.
+    inline void pull_interest_groups(room_data& room, const world_snapshot& world) {
+        BMMO_PROFILE_SCOPE(stage_profiler::PullBallStates);
+        auto& groups = room.interest_groups;
+        std::erase_if(groups, [](const auto& group) { return !group.second.has_recipients(); });
+        for (auto& [_, group]: groups)
+            group.clear();
+        room.tick_members.clear();
+        const auto& clients = world.roster->clients;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            const auto& client = clients[i];
+            if (client.room != &room)
+                continue;
+            room.tick_members.push_back(client.id);
+            auto& group = groups[client.map];
+            if (client.sees_balls) {
+                switch (client.strategy.balls) {
+                    using ball_encoding = send_strategy::ball_encoding;
+                    case ball_encoding::Delta:
+                        group.delta_recipients.emplace_back(client.id, client.delta_encoder.get());
+                        break;
+                    case ball_encoding::Quantized:
+                        group.quantized_recipients.push_back(client.id);
+                        break;
+                    case ball_encoding::Compressed:
+                        group.recipients.push_back(client.id);
+                        break;
+                }
             }
+            const auto& state = world.states[i];
+            if (!state.timestamp.is_zero())
+                group.snapshot.push_back({client.id, bmmo::quantized_ball_state::from(state)});
+            if (world.state_serials[i] > room.relayed_serial)
+                group.balls.emplace_back(state, client.id);
+            if (world.timestamp_serials[i] > room.relayed_serial)
+                group.unchanged_balls.emplace_back(state.timestamp, client.id);
+        }
+        room.relayed_serial = world.serial;
+        for (auto& [_, group]: groups)
+            std::ranges::sort(group.snapshot, {}, &bmmo::snapshot_ball::player_id);
+    }
+
+    // Moves balls to infinity with a newer timestamp, which hides them on the client side.
+    static void hide_ball_states(std::vector<bmmo::owned_timed_ball_state>& balls) {
+        for (auto& state: balls) {
+            state.state.position.y = std::numeric_limits<float>::infinity();
+            state.state.timestamp += bmmo::CLIENT_MINIMUM_UPDATE_INTERVAL_MS;
         }
     }
 
+    void send_hidden_ball_states(std::vector<bmmo::owned_timed_ball_state> balls, const room_data& room) {
+        bmmo::owned_compressed_ball_state_msg ball_msg{};
+        ball_msg.balls = std::move(balls);
+        hide_ball_states(ball_msg.balls);
+        ball_msg.serialize();
+        broadcast_to_room(room, ball_msg);
+    }
+
     void set_ban(HSteamNetConnection client, const std::string& reason) {
         if (!client_exists(client))
             return;
@@ -383,11 +869,13 @@ public:
             }
             config_.op_players[name] = bmmo::string_utils::get_uuid_string(clients_[client].uuid);
             ghost_spectator_clients_.insert(client);
+            roster_changed_ = true;
             Printf(bmmo::color_code(bmmo::OpState), "%s is now an operator.", name);
         } else {
             if (!config_.op_players.erase(name))
                 return;
             ghost_spectator_clients_.erase(client);
+            roster_changed_ = true;
             Printf(bmmo::color_code(bmmo::OpState), "%s is no longer an operator.", name);
         }
         config_.save();
@@ -395,7 +883,7 @@ public:
         msg.content.op = action;
         send(client, msg, k_nSteamNetworkingSend_Reliable);
         // just kick them and let them autoreconnect
-        if (config_.ghost_mode) {
+        if (get_room(client).ghost_mode) {
             interface_->CloseConnection(client, bmmo::connection_end::AutoReconnection_Min, "Operator status changed", true);
         }
     }
@@ -418,16 +906,19 @@ public:
         Printf(bmmo::color_code(bmmo::CheatToggle), "Toggled cheat [%s] globally.", cheat ? "on" : "off");
     }
 
+    // Server thread only.
     void shutdown(int reconnection_delay = 0) {
+        if (shutting_down_.exchange(true))
+            return;
         Printf("Shutting down...");
         int nReason = reconnection_delay == 0 ? 0 : bmmo::connection_end::AutoReconnection_Min + reconnection_delay;
         for (auto& i: clients_) {
             interface_->CloseConnection(i.first, nReason, "Server closed", true);
         }
-        if (ticking_)
-            stop_ticking();
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        running_ = false;
+        for (auto& [_, room]: rooms_)
+            room.ticker->stop();
+        // keep polling for a bit so the connections can be closed gracefully
+        schedule(std::chrono::milliseconds(500), [this] { running_ = false; });
 //        if (server_thread_.joinable())
 //            server_thread_.join();
     }
@@ -445,6 +936,8 @@ public:
             Printf("Error: failed to load config. Please try fixing or emptying it first.");
             return false;
         }
+        login_history_.open();
+        leaderboard_.open();
 
         SteamNetworkingIPAddr local_address{};
         local_address.Clear();
@@ -467,16 +960,30 @@ public:
             }
             if (args[0] == "playstream" || (args.size() > 2 && args[0] == "playstream#"))
                 return bmmo::string_utils::get_file_matches(args[args.size() - 1]);
-            else {
-                std::lock_guard lk(client_data_mutex_);
+            else if (args[0] == "opstats")
+                return {"reset"};
+            else if (args[0] == "profiler")
+                return {"on", "off"};
+            else if (args[0] == "room") {
+                if (args.size() == 2)
+                    return {"create", "remove", "list", "select", "move", "ghost"};
+                if ((args.size() == 4 && args[1] == "move") || (args.size() == 3 && args[1] != "move"))
+                    return world_.load()->roster->room_names;
+                if (args[1] != "move")
+                    return {};
+            }
+            {
+                // we're on the console thread; the live client data is the server thread's
+                const auto roster = world_.load()->roster;
                 std::vector<std::string> player_hints;
-                player_hints.reserve(clients_.size());
-                bool hint_client_id = args[args.size() - 1].starts_with('#');
-                for (const auto& [id, data]: clients_) {
-                    if (hint_client_id)
-                        player_hints.emplace_back('#' + std::to_string(id));
-                    else
-                        player_hints.emplace_back(data.name);
+                const auto& last_word = args[args.size() - 1];
+                if (last_word.starts_with('#')) {
+                    player_hints.reserve(roster->clients.size());
+                    for (const auto& client: roster->clients)
+                        player_hints.emplace_back('#' + std::to_string(client.id));
+                } else {
+                    for (const auto* entry: roster->names.find_prefix(last_word))
+                        player_hints.emplace_back(entry->name);
                 }
                 return player_hints;
             }
@@ -497,8 +1004,44 @@ protected:
     void save_login_data(HSteamNetConnection client) {
         SteamNetConnectionInfo_t pInfo;
         interface_->GetConnectionInfo(client, &pInfo);
-        config_.save_login_data(pInfo.m_addrRemote, bmmo::string_utils::get_uuid_string(clients_[client].uuid),
-                                clients_[client].name);
+        char ip_str[SteamNetworkingIPAddr::k_cchMaxString]{};
+        pInfo.m_addrRemote.ToString(ip_str, sizeof(ip_str), false);
+        login_history_.record_login({
+            .time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()),
+            .uuid = bmmo::string_utils::get_uuid_string(clients_[client].uuid),
+            .ip = ip_str,
+            .name = clients_[client].name,
+        });
+    }
+
+    // Re-encodes what new clients get to know about this player at login.
+    void update_roster(const std::pair<const HSteamNetConnection, client_data>& client) {
+        const auto& data = client.second;
+        login_cache_.update_player(client.first, {data.name, data.cheated, data.current_map, data.current_sector});
+    }
+
+    std::string_view get_map_names_payload() {
+        return login_cache_.map_names.get([this] {
+            bmmo::map_names_msg msg;
+            msg.maps = map_names_;
+            return msg;
+        });
+    }
+
+    std::string_view get_extra_life_payload() {
+        return login_cache_.extra_life.get([this] {
+            bmmo::extra_life_msg msg;
+            msg.life_count_goals = config_.initial_life_counts;
+            return msg;
+        });
+    }
+
+    static std::string_view get_bulletin_payload(room_data& room) {
+        return room.bulletin_payload.get([&room] {
+            bmmo::permanent_notification_msg msg;
+            std::tie(msg.title, msg.text_content) = room.bulletin;
+            return msg;
+        });
     }
 
     // Fail silently if the client doesn't exist.
@@ -515,27 +1058,22 @@ protected:
         msg.content.connection_id = client;
         broadcast_message(msg, k_nSteamNetworkingSend_Reliable, client);
         std::string name = itClient->second.name;
-        {
-            std::lock_guard lk(client_data_mutex_);
-            username_.erase(bmmo::message_utils::to_lower(name));
-            clients_.erase(itClient);
-            ghost_spectator_clients_.erase(client);
-        }
+        auto& room = rooms_.at(itClient->second.room);
+        room.members.erase(client);
+        username_.erase(name);
+        clients_.erase(itClient);
+        ghost_spectator_clients_.erase(client);
+        roster_changed_ = true;
+        login_cache_.remove_player(client);
+        metrics_.disconnections.add();
         Printf(bmmo::color_code(msg.code), "%s (#%u) disconnected.", name, client);
 
-        switch (get_client_count()) {
-            case 0:
-                maps_.clear();
-                map_names_ = config_.default_map_names;
-                permanent_notification_ = {};
-                [[fallthrough]];
-            case 1:
-                if (ticking_)
-                    stop_ticking();
-                break;
-            default:
-                break;
+        on_room_left(room);
+        if (get_client_count() == 0) {
+            map_names_ = config_.default_map_names;
+            login_cache_.map_names.invalidate();
         }
+        update_room_ticking(room);
         config_.save_player_status(clients_);
     }
 
@@ -592,7 +1130,101 @@ protected:
         return true;
     }
 
-    bool validate_client(HSteamNetConnection client, bmmo::login_request_v3_msg& msg) {
+    // Admits a client that asked to log in if it's allowed to, and sends it everything it
+    // needs to know. `reply` is the LoginAccepted version the client understands.
+    void log_in(ISteamNetworkingMessage* networking_msg, bmmo::login_request_v4_msg& msg, bmmo::opcode reply) {
+        interface_->SetConnectionName(networking_msg->m_conn, msg.nickname.c_str());
+
+        if (!validate_client(networking_msg->m_conn, msg))
+            return;
+
+        std::string uuid_string = bmmo::string_utils::get_uuid_string(msg.uuid);
+        if (config_.has_forced_name(uuid_string)) {
+            std::string new_name = config_.get_forced_name(uuid_string);
+            bmmo::name_update_msg nu_msg;
+            nu_msg.text_content = new_name;
+            nu_msg.serialize();
+            send(networking_msg->m_conn, nu_msg.data(), nu_msg.size(), k_nSteamNetworkingSend_Reliable);
+            if (bmmo::name_validator::is_spectator(msg.nickname))
+                new_name = bmmo::name_validator::get_spectator_nickname(new_name);
+            Printf(R"(Forced name change - #%u: "%s" -> "%s")",
+                    networking_msg->m_conn, msg.nickname, new_name);
+            interface_->SetConnectionName(networking_msg->m_conn, new_name.c_str());
+            msg.nickname = new_name;
+        }
+
+        // accepting client and adding it to the client list
+        auto& room = rooms_.at(DEFAULT_ROOM);
+        client_data data;
+        data.name = msg.nickname;
+        data.cheated = msg.cheated;
+        auto client_it = clients_.insert({networking_msg->m_conn, std::move(data)}).first;
+        memcpy(client_it->second.uuid, msg.uuid, sizeof(msg.uuid));
+        client_it->second.login_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        client_it->second.room = room.name;
+        clients_.set_room(client_it.index(), &room);
+        client_it->second.capabilities = msg.capabilities & SUPPORTED_CAPABILITIES;
+        client_it->second.strategy = send_strategy::choose(client_it->second.capabilities);
+        if (client_it->second.strategy.balls == send_strategy::ball_encoding::Delta)
+            client_it->second.delta_encoder = std::make_shared<bmmo::ball_delta_encoder>();
+        room.members.insert(networking_msg->m_conn);
+        username_.insert_or_assign(msg.nickname, networking_msg->m_conn);
+        const bool is_ghost_spectator = bmmo::name_validator::is_spectator(msg.nickname) || is_op(networking_msg->m_conn);
+        if (is_ghost_spectator)
+            ghost_spectator_clients_.insert(networking_msg->m_conn);
+        roster_changed_ = true;
+        Printf(bmmo::color_code(bmmo::LoginAcceptedV3),
+                "%s (%s; v%s) logged in with cheat mode %s!\n",
+                msg.nickname,
+                uuid_string.substr(0, 8),
+                msg.version.to_string(),
+                msg.cheated ? "on" : "off");
+
+        if (!map_names_.empty()) { // do this before login_accepted_msg since the latter contains map info
+            const auto map_names = get_map_names_payload();
+            send(networking_msg->m_conn, map_names.data(), map_names.size(), k_nSteamNetworkingSend_Reliable);
+        }
+
+        // notify this client of other online players (including itself)
+        update_roster(*client_it);
+        const auto accepted = (reply == bmmo::LoginAcceptedV4)
+                ? login_cache_.login_accepted(client_it->second.capabilities)
+                : login_cache_.login_accepted_v3(client_it->second.capabilities.encodings);
+        send(networking_msg->m_conn, accepted.data(), accepted.size(), k_nSteamNetworkingSend_Reliable);
+
+        save_login_data(networking_msg->m_conn);
+        metrics_.logins.add();
+
+        // notify other client of the fact that this client goes online
+        bmmo::player_connected_v2_msg connected_msg;
+        connected_msg.connection_id = networking_msg->m_conn;
+        connected_msg.name = msg.nickname;
+        connected_msg.cheated = msg.cheated;
+        if (process_forced_cheat_mode(*client_it, msg.cheated))
+            connected_msg.cheated = !msg.cheated;
+        connected_msg.serialize();
+        broadcast_message(connected_msg, k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
+
+        if (!room.ghost_mode || is_ghost_spectator) {
+            bmmo::owned_compressed_ball_state_msg state_msg{};
+            pull_ball_states(room, state_msg.balls);
+            state_msg.serialize();
+            send(networking_msg->m_conn, state_msg.data(), state_msg.size(), k_nSteamNetworkingSend_ReliableNoNagle);
+        }
+
+        if (!room.bulletin.second.empty()) {
+            const auto bulletin = get_bulletin_payload(room);
+            send(networking_msg->m_conn, bulletin.data(), bulletin.size(), k_nSteamNetworkingSend_Reliable);
+        }
+
+        const auto extra_life = get_extra_life_payload();
+        send(networking_msg->m_conn, extra_life.data(), extra_life.size());
+
+        update_room_ticking(room);
+        config_.save_player_status(clients_);
+    }
+
+    bool validate_client(HSteamNetConnection client, bmmo::login_request_v4_msg& msg) {
         int nReason = k_ESteamNetConnectionEnd_Invalid;
         std::stringstream reason;
         const std::string real_nickname = bmmo::name_validator::get_real_nickname(msg.nickname);
@@ -612,7 +1244,7 @@ protected:
             nReason = bmmo::connection_end::OutdatedClient;
         }
         // check if name exists
-        else if (username_.contains(bmmo::string_utils::to_lower(msg.nickname))) {
+        else if (username_.contains(msg.nickname)) {
             reason << "A player with the same username \"" << msg.nickname << "\" already exists on this server.";
             nReason = bmmo::connection_end::ExistingName;
         }
@@ -750,695 +1382,558 @@ protected:
     }
 
     void on_message(ISteamNetworkingMessage* networking_msg) override {
+        metrics_.received.record(networking_msg->m_pData, networking_msg->m_cbSize);
         auto client_it = clients_.find(networking_msg->m_conn);
-        auto* raw_msg = reinterpret_cast<bmmo::general_message*>(networking_msg->m_pData);
 
         if (networking_msg->m_cbSize < static_cast<decltype(networking_msg->m_cbSize)>(sizeof(bmmo::opcode))) {
             Printf("Error: invalid message with size %d received from #%u.",
                     networking_msg->m_cbSize, networking_msg->m_conn);
             return;
         }
-        if (!(client_it != clients_.end() || raw_msg->code == bmmo::LoginRequest || raw_msg->code == bmmo::LoginRequestV2 || raw_msg->code == bmmo::LoginRequestV3)) { // ignore limbo clients message
+        const auto code = *static_cast<const bmmo::opcode*>(networking_msg->m_pData);
+        if (!(client_it != clients_.end() || code == bmmo::LoginRequest || code == bmmo::LoginRequestV2 || code == bmmo::LoginRequestV3
+                || code == bmmo::LoginRequestV4)) { // ignore limbo clients message
             interface_->CloseConnection(networking_msg->m_conn, k_ESteamNetConnectionEnd_AppException_Min, "Invalid client", true);
             return;
         }
 
-        switch (raw_msg->code) {
-            case bmmo::LoginRequest: {
-                bmmo::simple_action_msg msg{.content = bmmo::simple_action::LoginDenied};
-                send(networking_msg->m_conn, msg, k_nSteamNetworkingSend_Reliable);
-                interface_->CloseConnection(networking_msg->m_conn, bmmo::connection_end::OutdatedClient, "Outdated client", true);
+        BMMO_PROFILE_SCOPE(stage_profiler::message_stage(code));
+        switch (dispatcher_.dispatch(networking_msg, client_it)) {
+            using result = decltype(dispatcher_)::result;
+            case result::Handled:
                 break;
-            }
-            case bmmo::LoginRequestV2: {
-                bmmo::login_request_v2_msg msg;
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                interface_->SetConnectionName(networking_msg->m_conn, msg.nickname.c_str());
-
-                std::string reason = "Outdated client (client: " + msg.version.to_string()
-                        + "; minimum: " + bmmo::minimum_client_version.to_string() + ")";
-                bmmo::simple_action_msg new_msg{.content = bmmo::simple_action::LoginDenied};
-                send(networking_msg->m_conn, new_msg, k_nSteamNetworkingSend_Reliable);
-                interface_->CloseConnection(networking_msg->m_conn, bmmo::connection_end::OutdatedClient, reason.c_str(), true);
+            case result::Rejected:
+                Printf("Error: malformed %s message with size %d received from #%u.",
+                        bmmo::opcode_name(code), networking_msg->m_cbSize, networking_msg->m_conn);
+                if (client_it == clients_.end())
+                    interface_->CloseConnection(networking_msg->m_conn, k_ESteamNetConnectionEnd_AppException_Min, "Invalid login request", true);
                 break;
-            }
-            case bmmo::LoginRequestV3: {
-                bmmo::login_request_v3_msg msg;
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                interface_->SetConnectionName(networking_msg->m_conn, msg.nickname.c_str());
-
-                if (!validate_client(networking_msg->m_conn, msg))
-                    break;
+            case result::Unknown:
+                Printf("Error: invalid message with opcode %d received from #%u.",
+                        code, networking_msg->m_conn);
+                break;
+        }
+    }
 
-                std::string uuid_string = bmmo::string_utils::get_uuid_string(msg.uuid);
-                if (config_.has_forced_name(uuid_string)) {
-                    std::string new_name = config_.get_forced_name(uuid_string);
-                    bmmo::name_update_msg nu_msg;
-                    nu_msg.text_content = new_name;
-                    nu_msg.serialize();
-                    send(networking_msg->m_conn, nu_msg.raw.str().data(), nu_msg.size(), k_nSteamNetworkingSend_Reliable);
-                    if (bmmo::name_validator::is_spectator(msg.nickname))
-                        new_name = bmmo::name_validator::get_spectator_nickname(new_name);
-                    Printf(R"(Forced name change - #%u: "%s" -> "%s")",
-                            networking_msg->m_conn, msg.nickname, new_name);
-                    interface_->SetConnectionName(networking_msg->m_conn, new_name.c_str());
-                    msg.nickname = new_name;
-                }
+    // Everything a client may send us. Only login requests can arrive from clients
+    // which aren't logged in yet; for all other messages `client_it` is valid.
+    void register_message_handlers() {
+        using client_iterator = client_data_collection::iterator;
+        auto& d = dispatcher_;
 
-                // accepting client and adding it to the client list
-                bool is_ghost_spectator = false;
-                {
-                    std::lock_guard lk(client_data_mutex_);
-                    client_it = clients_.insert({networking_msg->m_conn, {msg.nickname, (bool)msg.cheated}}).first;
-                    memcpy(client_it->second.uuid, msg.uuid, sizeof(msg.uuid));
-                    client_it->second.login_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-                    username_[bmmo::message_utils::to_lower(msg.nickname)] = networking_msg->m_conn;
-                    is_ghost_spectator = bmmo::name_validator::is_spectator(msg.nickname) || is_op(networking_msg->m_conn);
-                    if (is_ghost_spectator)
-                        ghost_spectator_clients_.insert(networking_msg->m_conn);
-                }
-                Printf(bmmo::color_code(bmmo::LoginAcceptedV3),
-                        "%s (%s; v%s) logged in with cheat mode %s!\n",
-                        msg.nickname,
-                        uuid_string.substr(0, 8),
-                        msg.version.to_string(),
-                        msg.cheated ? "on" : "off");
-
-                if (!map_names_.empty()) { // do this before login_accepted_msg since the latter contains map info
-                    bmmo::map_names_msg name_msg;
-                    name_msg.maps = map_names_;
-                    name_msg.serialize();
-                    send(networking_msg->m_conn, name_msg.raw.str().data(), name_msg.size(), k_nSteamNetworkingSend_Reliable);
-                }
+        d.on(bmmo::LoginRequest, [this](ISteamNetworkingMessage* networking_msg, client_iterator) {
+            bmmo::simple_action_msg msg{.content = bmmo::simple_action::LoginDenied};
+            send(networking_msg->m_conn, msg, k_nSteamNetworkingSend_Reliable);
+            interface_->CloseConnection(networking_msg->m_conn, bmmo::connection_end::OutdatedClient, "Outdated client", true);
+        });
+        d.on<bmmo::login_request_v2_msg>([this](bmmo::login_request_v2_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator) {
+            interface_->SetConnectionName(networking_msg->m_conn, msg.nickname.c_str());
 
-                // notify this client of other online players
-                bmmo::login_accepted_v3_msg accepted_msg;
-                accepted_msg.online_players.reserve(clients_.size());
-                for (const auto& [id, data]: clients_) {
-                    //if (client_it != it)
-                    accepted_msg.online_players.insert({id, {data.name, data.cheated, data.current_map, data.current_sector}});
-                }
-                accepted_msg.serialize();
-                send(networking_msg->m_conn, accepted_msg.raw.str().data(), accepted_msg.size(), k_nSteamNetworkingSend_Reliable);
-
-                save_login_data(networking_msg->m_conn);
-
-                // notify other client of the fact that this client goes online
-                bmmo::player_connected_v2_msg connected_msg;
-                connected_msg.connection_id = networking_msg->m_conn;
-                connected_msg.name = msg.nickname;
-                connected_msg.cheated = msg.cheated;
-                if (process_forced_cheat_mode(*client_it, msg.cheated))
-                    connected_msg.cheated = !msg.cheated;
-                connected_msg.serialize();
-                broadcast_message(connected_msg.raw.str().data(), connected_msg.size(), k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
-
-                if (!config_.ghost_mode || is_ghost_spectator) {
-                    bmmo::owned_compressed_ball_state_msg state_msg{};
-                    pull_ball_states(state_msg.balls);
-                    state_msg.serialize();
-                    send(networking_msg->m_conn, state_msg.raw.str().data(), state_msg.size(), k_nSteamNetworkingSend_ReliableNoNagle);
-                }
+            std::string reason = "Outdated client (client: " + msg.version.to_string()
+                    + "; minimum: " + bmmo::minimum_client_version.to_string() + ")";
+            bmmo::simple_action_msg new_msg{.content = bmmo::simple_action::LoginDenied};
+            send(networking_msg->m_conn, new_msg, k_nSteamNetworkingSend_Reliable);
+            interface_->CloseConnection(networking_msg->m_conn, bmmo::connection_end::OutdatedClient, reason.c_str(), true);
+        });
+        d.on<bmmo::login_request_v3_msg>([this](bmmo::login_request_v3_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator) {
+            // clients which know LoginAcceptedV4 say so by listing capability groups
+            const auto reply = (msg.capability_groups == bmmo::capability_set{})
+                    ? bmmo::LoginAcceptedV3 : bmmo::LoginAcceptedV4;
+            auto upgraded = bmmo::login_request_v4_msg::from(std::move(msg));
+            log_in(networking_msg, upgraded, reply);
+        });
+        d.on<bmmo::login_request_v4_msg>([this](bmmo::login_request_v4_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator) {
+            log_in(networking_msg, msg, bmmo::LoginAcceptedV4);
+        });
 
-                if (!permanent_notification_.second.empty()) {
-                    bmmo::permanent_notification_msg bulletin_msg{};
-                    std::tie(bulletin_msg.title, bulletin_msg.text_content) = permanent_notification_;
-                    bulletin_msg.serialize();
-                    send(networking_msg->m_conn, bulletin_msg.raw.str().data(), bulletin_msg.size(), k_nSteamNetworkingSend_Reliable);
-                }
+        d.on<bmmo::ball_state_msg>([this](bmmo::ball_state_msg& state_msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            clients_.state(client_it.index()) = {state_msg.content, networking_msg->m_usecTimeReceived};
+            clients_.touch_state(client_it.index());
+            add_phase_sample(client_it->second, networking_msg->m_usecTimeReceived);
+        });
+        d.on<bmmo::timed_ball_state_msg>([this](bmmo::timed_ball_state_msg& state_msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            auto& state = clients_.state(client_it.index());
+            if (state_msg.content.timestamp < state.timestamp)
+                return;
+            state = state_msg.content;
+            clients_.touch_state(client_it.index());
+            add_phase_sample(client_it->second, networking_msg->m_usecTimeReceived);
+        });
+        d.on<bmmo::ball_state_ack_msg>([](bmmo::ball_state_ack_msg& ack_msg, ISteamNetworkingMessage*, client_iterator client_it) {
+            if (client_it->second.delta_encoder)
+                client_it->second.delta_encoder->acknowledge(ack_msg.content);
+        });
+        d.on<bmmo::timestamp_msg>([this](bmmo::timestamp_msg& timestamp_msg, ISteamNetworkingMessage*, client_iterator client_it) {
+            auto& state = clients_.state(client_it.index());
+            if (timestamp_msg.content < state.timestamp)
+                return;
+            state.timestamp = timestamp_msg.content;
+            clients_.touch_timestamp(client_it.index());
+        });
 
-                bmmo::extra_life_msg life_msg{};
-                life_msg.life_count_goals = config_.initial_life_counts;
-                life_msg.serialize();
-                send(networking_msg->m_conn, life_msg.raw.str().data(), life_msg.size());
+        d.on<bmmo::chat_msg>([this](bmmo::chat_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            bmmo::string_utils::sanitize_string(msg.chat_content);
+            const bool muted = is_muted(client_it->second.uuid);
 
-                if (!ticking_ && get_client_count() > 1)
-                    start_ticking();
-                config_.save_player_status(clients_);
+            // Print chat message to console
+            const std::string& current_player_name = client_it->second.name;
+            const HSteamNetConnection current_player_id  = networking_msg->m_conn;
+            Printf(muted ? bmmo::ansi::Strikethrough : bmmo::ansi::Reset, "%s(%u, %s): %s",
+                    muted ? "[Muted] " : "", current_player_id, current_player_name, msg.chat_content);
 
-                break;
+            if (muted) {
+                bmmo::action_denied_msg msg{.content = {bmmo::deny_reason::PlayerMuted}};
+                send(networking_msg->m_conn, msg, k_nSteamNetworkingSend_Reliable);
+                return;
             }
-            case bmmo::LoginAccepted:
-            case bmmo::PlayerDisconnected:
-            case bmmo::PlayerConnected:
-            case bmmo::Ping:
-                break;
-            case bmmo::BallState: {
-                auto* state_msg = reinterpret_cast<bmmo::ball_state_msg*>(networking_msg->m_pData);
-
-                std::unique_lock<std::mutex> lock(client_data_mutex_);
-                client_it->second.state = {state_msg->content, networking_msg->m_usecTimeReceived};
-                client_it->second.state_updated = false;
-
-                // Printf("%u: %d, (%f, %f, %f), (%f, %f, %f, %f)",
-                //        networking_msg->m_conn,
-                //        state_msg->content.type,
-                //        state_msg->content.position.x,
-                //        state_msg->content.position.y,
-                //        state_msg->content.position.z,
-                //        state_msg->content.rotation.x,
-                //        state_msg->content.rotation.y,
-                //        state_msg->content.rotation.z,
-                //        state_msg->content.rotation.w);
-//                std::cout << "(" <<
-//                          state_msg->state.position.x << ", " <<
-//                          state_msg->state.position.y << ", " <<
-//                          state_msg->state.position.z << "), (" <<
-//                          state_msg->state.quaternion.x << ", " <<
-//                          state_msg->state.quaternion.y << ", " <<
-//                          state_msg->state.quaternion.z << ", " <<
-//                          state_msg->state.quaternion.w << ")" << std::endl;
-
-//                 bmmo::owned_ball_state_msg new_msg;
-//                 new_msg.content.state = state_msg->content;
-// //                std::memcpy(&(new_msg.content), &(state_msg->content), sizeof(state_msg->content));
-//                 new_msg.content.player_id = networking_msg->m_conn;
-//                 broadcast_message(&new_msg, sizeof(new_msg), k_nSteamNetworkingSend_UnreliableNoDelay, &networking_msg->m_conn);
 
-                break;
-            }
-            case bmmo::TimedBallState: {
-                auto* state_msg = reinterpret_cast<bmmo::timed_ball_state_msg*>(networking_msg->m_pData);
-                std::unique_lock<std::mutex> lock(client_data_mutex_);
-                if (state_msg->content.timestamp < client_it->second.state.timestamp)
-                    break;
-                client_it->second.state = state_msg->content;
-                client_it->second.state_updated = false;
-                break;
-            }
-            case bmmo::Timestamp: {
-                auto* timestamp_msg = reinterpret_cast<bmmo::timestamp_msg*>(networking_msg->m_pData);
-                std::unique_lock<std::mutex> lock(client_data_mutex_);
-                if (timestamp_msg->content < client_it->second.state.timestamp)
-                    break;
-                client_it->second.state.timestamp = timestamp_msg->content;
-                client_it->second.timestamp_updated = false;
-                break;
-            }
-            case bmmo::Chat: {
-                bmmo::chat_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                bmmo::string_utils::sanitize_string(msg.chat_content);
-                const bool muted = is_muted(client_it->second.uuid);
-
-                // Print chat message to console
-                const std::string& current_player_name = client_it->second.name;
-                const HSteamNetConnection current_player_id  = networking_msg->m_conn;
-                Printf(muted ? bmmo::ansi::Strikethrough : bmmo::ansi::Reset, "%s(%u, %s): %s",
-                        muted ? "[Muted] " : "", current_player_id, current_player_name, msg.chat_content);
-
-                if (muted) {
-                    bmmo::action_denied_msg msg{.content = {bmmo::deny_reason::PlayerMuted}};
-                    send(networking_msg->m_conn, msg, k_nSteamNetworkingSend_Reliable);
-                    break;
-                }
+            // Broatcast chat message to other player
+            msg.player_id = current_player_id;
+            msg.clear();
+            msg.serialize();
 
-                // Broatcast chat message to other player
-                msg.player_id = current_player_id;
+            // No need to ignore the sender, 'cause we will send the message back
+            broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::private_chat_msg>([this](bmmo::private_chat_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            bmmo::string_utils::sanitize_string(msg.chat_content);
+            const HSteamNetConnection receiver = msg.player_id;
+            msg.player_id = networking_msg->m_conn;
+
+            if (client_exists(receiver, true)) {
+                Printf(bmmo::color_code(msg.code), "(%u, %s) -> (%u, %s): %s",
+                    msg.player_id, client_it->second.name, receiver, clients_[receiver].name, msg.chat_content);
                 msg.clear();
                 msg.serialize();
+                send(receiver, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            } else {
+                Printf(bmmo::color_code(msg.code), "(%u, %s) -> (%u, %s): %s",
+                    msg.player_id, client_it->second.name, receiver, "[Server]", msg.chat_content);
+                if (receiver != k_HSteamNetConnection_Invalid) {
+                    bmmo::action_denied_msg denied_msg{.content = {bmmo::deny_reason::TargetNotFound}};
+                    send(msg.player_id, denied_msg, k_nSteamNetworkingSend_Reliable);
+                }
+            };
+        });
+        d.on<bmmo::important_notification_msg>([this](bmmo::important_notification_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            if (deny_action(networking_msg->m_conn))
+                return;
+            bmmo::string_utils::sanitize_string(msg.chat_content);
+            msg.player_id = networking_msg->m_conn;
+            const bool muted = is_muted(client_it->second.uuid);
+
+            Printf(msg.get_ansi_color() | (muted ? bmmo::ansi::Strikethrough : bmmo::ansi::Reset),
+                "%s[%s] (%u, %s): %s", muted ? "[Muted] " : "",
+                msg.get_type_name(), msg.player_id, client_it->second.name, msg.chat_content);
+            if (muted) return;
+            msg.clear();
+            msg.serialize();
+            broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
+        });
 
-                // No need to ignore the sender, 'cause we will send the message back
-                broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        d.on<bmmo::player_ready_msg>([this](bmmo::player_ready_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            msg.content.player_id = networking_msg->m_conn;
+            client_it->second.ready = msg.content.ready;
+            auto& room = rooms_.at(client_it->second.room);
+            msg.content.count = std::ranges::count_if(room.members,
+                                                      [this](auto id) { return clients_[id].ready; });
+            Printf("(#%u, %s) is%s ready to start (%u player%s ready).",
+                networking_msg->m_conn, client_it->second.name,
+                msg.content.ready ? "" : " not",
+                msg.content.count, msg.content.count == 1 ? "" : "s");
+            broadcast_to_room(room, msg, k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::countdown_msg>([this](bmmo::countdown_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            if (deny_action(networking_msg->m_conn))
+                return;
 
-                break;
-            }
-            case bmmo::PrivateChat: {
-                bmmo::private_chat_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                bmmo::string_utils::sanitize_string(msg.chat_content);
-                const HSteamNetConnection receiver = msg.player_id;
-                msg.player_id = networking_msg->m_conn;
-
-                if (client_exists(receiver, true)) {
-                    Printf(bmmo::color_code(msg.code), "(%u, %s) -> (%u, %s): %s",
-                        msg.player_id, client_it->second.name, receiver, clients_[receiver].name, msg.chat_content);
-                    msg.clear();
-                    msg.serialize();
-                    send(receiver, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
-                } else {
-                    Printf(bmmo::color_code(msg.code), "(%u, %s) -> (%u, %s): %s",
-                        msg.player_id, client_it->second.name, receiver, "[Server]", msg.chat_content);
-                    if (receiver != k_HSteamNetConnection_Invalid) {
-                        bmmo::action_denied_msg denied_msg{.content = {bmmo::deny_reason::TargetNotFound}};
-                        send(msg.player_id, denied_msg, k_nSteamNetworkingSend_Reliable);
+            std::string map_name = msg.content.map.get_display_name(map_names_);
+            auto& room = rooms_.at(client_it->second.room);
+            room.last_countdown_map = msg.content.map;
+            switch (msg.content.type) {
+                using ct = bmmo::countdown_type;
+                case ct::Go: {
+                    Printf(bmmo::color_code(msg.code), "[%u, %s]: %s%s - Go!%s",
+                        networking_msg->m_conn, client_it->second.name, map_name,
+                        msg.content.get_level_mode_label(),
+                        msg.content.force_restart ? " (rank reset)" : "");
+                    if (config_.force_restart_level || msg.content.force_restart) {
+                        room.maps.clear();
+                        for (const auto& map: map_names_)
+                            room.maps[map.first] = {0, networking_msg->m_usecTimeReceived, msg.content.mode, {}};
+                    } else {
+                        room.maps[msg.content.map.key()] = {0, networking_msg->m_usecTimeReceived, msg.content.mode, {}};
                     }
-                };
-                break;
-            }
-            case bmmo::ImportantNotification: {
-                if (deny_action(networking_msg->m_conn))
-                    break;
-                bmmo::important_notification_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                bmmo::string_utils::sanitize_string(msg.chat_content);
-                msg.player_id = networking_msg->m_conn;
-                const bool muted = is_muted(client_it->second.uuid);
-
-                Printf(msg.get_ansi_color() | (muted ? bmmo::ansi::Strikethrough : bmmo::ansi::Reset),
-                    "%s[%s] (%u, %s): %s", muted ? "[Muted] " : "",
-                    msg.get_type_name(), msg.player_id, client_it->second.name, msg.chat_content);
-                if (muted) break;
-                msg.clear();
-                msg.serialize();
-                broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
-                break;
-            }
-            case bmmo::PlayerReady: {
-                auto* msg = reinterpret_cast<bmmo::player_ready_msg*>(networking_msg->m_pData);
-                msg->content.player_id = networking_msg->m_conn;
-                client_it->second.ready = msg->content.ready;
-                msg->content.count = std::ranges::count_if(clients_,
-                                                           [](const auto& i) { return i.second.ready; });
-                Printf("(#%u, %s) is%s ready to start (%u player%s ready).",
-                    networking_msg->m_conn, client_it->second.name,
-                    msg->content.ready ? "" : " not",
-                    msg->content.count, msg->content.count == 1 ? "" : "s");
-                broadcast_message(*msg, k_nSteamNetworkingSend_Reliable);
-                break;
-            }
-            case bmmo::Countdown: {
-                if (deny_action(networking_msg->m_conn))
-                    break;
-                auto* msg = reinterpret_cast<bmmo::countdown_msg*>(networking_msg->m_pData);
-
-                std::string map_name = msg->content.map.get_display_name(map_names_);
-                last_countdown_map_ = msg->content.map;
-                switch (msg->content.type) {
-                    using ct = bmmo::countdown_type;
-                    case ct::Go: {
-                        Printf(bmmo::color_code(msg->code), "[%u, %s]: %s%s - Go!%s",
-                            networking_msg->m_conn, client_it->second.name, map_name,
-                            msg->content.get_level_mode_label(),
-                            msg->content.force_restart ? " (rank reset)" : "");
-                        if (config_.force_restart_level || msg->content.force_restart) {
-                            maps_.clear();
-                            for (const auto& map: map_names_)
-                                maps_[map.first] = {0, networking_msg->m_usecTimeReceived, msg->content.mode, {}};
-                        } else {
-                            maps_[msg->content.map.get_hash_bytes_string()] = {0, networking_msg->m_usecTimeReceived, msg->content.mode, {}};
-                        }
-                        msg->content.restart_level = config_.restart_level;
-                        msg->content.force_restart = config_.force_restart_level;
-                        for (auto& i: clients_) {
-                            i.second.ready = i.second.dnf = false;
-                        }
-                        break;
+                    msg.content.restart_level = config_.restart_level;
+                    msg.content.force_restart = config_.force_restart_level;
+                    for (auto id: room.members) {
+                        auto& data = clients_[id];
+                        data.ready = data.dnf = false;
                     }
-                    case ct::Countdown_1:
-                    case ct::Countdown_2:
-                    case ct::Countdown_3:
-                    case ct::Ready:
-                    case ct::ConfirmReady:
-                        Printf("[%u, %s]: %s%s - %s",
-                            networking_msg->m_conn, client_it->second.name, map_name,
-                            msg->content.get_level_mode_label(),
-                            std::map<ct, std::string>{
-                                {ct::Countdown_1, "1"}, {ct::Countdown_2, "2"}, {ct::Countdown_3, "3"},
-                                {ct::Ready, "Get ready"},
-                                {ct::ConfirmReady, "Please use \"/mmo ready\" to confirm if you are ready"},
-                            }[msg->content.type]);
-                        maps_[msg->content.map.get_hash_bytes_string()].mode = msg->content.mode;
-                        break;
-                    case ct::Unknown:
-                    default:
-                        return;
+                    break;
                 }
-
-                msg->content.sender = networking_msg->m_conn;
-                broadcast_message(*msg, k_nSteamNetworkingSend_Reliable);
-                break;
-            }
-            case bmmo::DidNotFinish: {
-                auto* msg = reinterpret_cast<bmmo::did_not_finish_msg*>(networking_msg->m_pData);
-                msg->content.player_id = networking_msg->m_conn;
-                std::string& player_name = client_it->second.name;
-                Printf(
-                    bmmo::color_code(msg->code),
-                    "%s(#%u, %s) did not finish %s (furthest reach: sector %d).",
-                    msg->content.cheated ? "[CHEAT] " : "",
-                    msg->content.player_id, player_name,
-                    msg->content.map.get_display_name(map_names_),
-                    msg->content.sector
-                );
-                client_it->second.dnf = true;
-                broadcast_message(*msg, k_nSteamNetworkingSend_Reliable);
-                maps_[msg->content.map.get_hash_bytes_string()].rankings.second.push_back({
-                    {(bool)msg->content.cheated, player_name}, msg->content.sector});
-                break;
+                case ct::Countdown_1:
+                case ct::Countdown_2:
+                case ct::Countdown_3:
+                case ct::Ready:
+                case ct::ConfirmReady:
+                    Printf("[%u, %s]: %s%s - %s",
+                        networking_msg->m_conn, client_it->second.name, map_name,
+                        msg.content.get_level_mode_label(),
+                        std::map<ct, std::string>{
+                            {ct::Countdown_1, "1"}, {ct::Countdown_2, "2"}, {ct::Countdown_3, "3"},
+                            {ct::Ready, "Get ready"},
+                            {ct::ConfirmReady, "Please use \"/mmo ready\" to confirm if you are ready"},
+                        }[msg.content.type]);
+                    room.maps[msg.content.map.key()].mode = msg.content.mode;
+                    break;
+                case ct::Unknown:
+                default:
+                    return;
             }
-            case bmmo::LevelFinish:
-                break;
-            case bmmo::LevelFinishV2: {
-                auto* msg = reinterpret_cast<bmmo::level_finish_v2_msg*>(networking_msg->m_pData);
-                msg->content.player_id = networking_msg->m_conn;
 
-                // Cheat check
-                if (msg->content.map.level * 100 != msg->content.levelBonus || msg->content.lifeBonus != 200) {
-                    msg->content.cheated = true;
-                }
-
-                // Prepare data...
-                std::string md5_str = msg->content.map.get_hash_bytes_string(),
-                    & player_name = client_it->second.name,
-                    formatted_score = msg->content.get_formatted_score();
-                auto& current_map = maps_[md5_str];
-
-                // Use server-side timing if available and under 2.5 hours
-                auto local_time_elapsed = networking_msg->m_usecTimeReceived - current_map.start_time;
-                if (current_map.start_time != 0 && local_time_elapsed < int64_t(2.5 * 3600 * 1e6))
-                    msg->content.timeElapsed = local_time_elapsed / 1e6f;
-
-                // Prepare message
-                msg->content.rank = ++current_map.rank;
-                Printf(bmmo::color_code(msg->code),
-                    "%s(#%u, %s) finished %s%s in %d%s place (score: %s; real time: %s).",
-                    msg->content.cheated ? "[CHEAT] " : "",
-                    msg->content.player_id, player_name,
-                    msg->content.map.get_display_name(map_names_), get_level_mode_label(msg->content.mode),
-                    current_map.rank, bmmo::string_utils::get_ordinal_suffix(current_map.rank),
-                    formatted_score, msg->content.get_formatted_time());
-
-                broadcast_message(*msg, k_nSteamNetworkingSend_Reliable);
-
-                current_map.rankings.first.push_back({
-                    {(bool)msg->content.cheated, player_name}, msg->content.mode,
-                    current_map.rank, msg->content.timeElapsed, formatted_score});
+            msg.content.sender = networking_msg->m_conn;
+            broadcast_to_room(room, msg, k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::did_not_finish_msg>([this](bmmo::did_not_finish_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            msg.content.player_id = networking_msg->m_conn;
+            std::string& player_name = client_it->second.name;
+            Printf(
+                bmmo::color_code(msg.code),
+                "%s(#%u, %s) did not finish %s (furthest reach: sector %d).",
+                msg.content.cheated ? "[CHEAT] " : "",
+                msg.content.player_id, player_name,
+                msg.content.map.get_display_name(map_names_),
+                msg.content.sector
+            );
+            client_it->second.dnf = true;
+            auto& room = rooms_.at(client_it->second.room);
+            broadcast_to_room(room, msg, k_nSteamNetworkingSend_Reliable);
+            room.maps[msg.content.map.key()].rankings.add_dnf({
+                {(bool)msg.content.cheated, player_name}, msg.content.sector});
+        });
+        d.on<bmmo::level_finish_v2_msg>([this](bmmo::level_finish_v2_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            msg.content.player_id = networking_msg->m_conn;
 
-                break;
+            // Cheat check
+            if (msg.content.map.level * 100 != msg.content.levelBonus || msg.content.lifeBonus != 200) {
+                msg.content.cheated = true;
             }
-            case bmmo::MapNames: {
-                bmmo::map_names_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                map_names_.insert(msg.maps.begin(), msg.maps.end());
 
-                msg.clear();
-                msg.serialize();
-                broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
-                break;
-            }
-            case bmmo::CheatState: {
-                auto* state_msg = reinterpret_cast<bmmo::cheat_state_msg*>(networking_msg->m_pData);
-                if (process_forced_cheat_mode(*client_it, state_msg->content.cheated))
-                    return;
+            // Prepare data...
+            std::string& player_name = client_it->second.name,
+                formatted_score = msg.content.get_formatted_score();
+            auto& room = rooms_.at(client_it->second.room);
+            auto& current_map = room.maps[msg.content.map.key()];
+
+            // Use server-side timing if available and under 2.5 hours
+            auto local_time_elapsed = networking_msg->m_usecTimeReceived - current_map.start_time;
+            if (current_map.start_time != 0 && local_time_elapsed < int64_t(2.5 * 3600 * 1e6))
+                msg.content.timeElapsed = local_time_elapsed / 1e6f;
+
+            // Prepare message
+            msg.content.rank = ++current_map.rank;
+            current_map.rankings.add_finish({
+                {(bool)msg.content.cheated, player_name}, msg.content.mode,
+                current_map.rank, msg.content.timeElapsed, formatted_score, msg.content.get_score()});
+            const int hs_rank = current_map.rankings.rank_of(player_name, true);
+            Printf(bmmo::color_code(msg.code),
+                "%s(#%u, %s) finished %s%s in %d%s place (score: %s, %d%s highest; real time: %s).",
+                msg.content.cheated ? "[CHEAT] " : "",
+                msg.content.player_id, player_name,
+                msg.content.map.get_display_name(map_names_), get_level_mode_label(msg.content.mode),
+                current_map.rank, bmmo::string_utils::get_ordinal_suffix(current_map.rank),
+                formatted_score, hs_rank, bmmo::string_utils::get_ordinal_suffix(hs_rank),
+                msg.content.get_formatted_time());
+
+            broadcast_to_room(room, msg, k_nSteamNetworkingSend_Reliable);
+            record_run(client_it->second, msg.content, formatted_score);
+        });
+        d.on<bmmo::map_names_msg>([this](bmmo::map_names_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator) {
+            map_names_.insert(msg.maps.begin(), msg.maps.end());
+            login_cache_.map_names.invalidate();
 
-                client_it->second.cheated = state_msg->content.cheated;
-                Printf("(#%u, %s) turned cheat [%s]!",
-                    networking_msg->m_conn, client_it->second.name, state_msg->content.cheated ? "on" : "off");
-                bmmo::owned_cheat_state_msg new_msg{};
-                new_msg.content.player_id = networking_msg->m_conn;
-                new_msg.content.state.cheated = state_msg->content.cheated;
-                new_msg.content.state.notify = state_msg->content.notify;
-                broadcast_message(&new_msg, sizeof(new_msg), k_nSteamNetworkingSend_Reliable);
+            msg.clear();
+            msg.serialize();
+            broadcast_message(msg, k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
+        });
 
-                break;
-            }
-            case bmmo::CheatToggle: {
-                if (deny_action(networking_msg->m_conn))
-                    break;
-                auto* state_msg = reinterpret_cast<bmmo::cheat_toggle_msg*>(networking_msg->m_pData);
-                Printf(bmmo::color_code(state_msg->code), "(#%u, %s) toggled cheat [%s] globally!",
-                    networking_msg->m_conn, client_it->second.name, state_msg->content.cheated ? "on" : "off");
-                bmmo::owned_cheat_toggle_msg new_msg{};
-                new_msg.content.player_id = client_it->first;
-                new_msg.content.state.cheated = state_msg->content.cheated;
-                broadcast_message(&new_msg, sizeof(new_msg), k_nSteamNetworkingSend_Reliable);
+        d.on<bmmo::cheat_state_msg>([this](bmmo::cheat_state_msg& state_msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            if (process_forced_cheat_mode(*client_it, state_msg.content.cheated))
+                return;
 
-                break;
+            client_it->second.cheated = state_msg.content.cheated;
+            update_roster(*client_it);
+            Printf("(#%u, %s) turned cheat [%s]!",
+                networking_msg->m_conn, client_it->second.name, state_msg.content.cheated ? "on" : "off");
+            bmmo::owned_cheat_state_msg new_msg{};
+            new_msg.content.player_id = networking_msg->m_conn;
+            new_msg.content.state.cheated = state_msg.content.cheated;
+            new_msg.content.state.notify = state_msg.content.notify;
+            broadcast_message(&new_msg, sizeof(new_msg), k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::cheat_toggle_msg>([this](bmmo::cheat_toggle_msg& state_msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            if (deny_action(networking_msg->m_conn))
+                return;
+            Printf(bmmo::color_code(state_msg.code), "(#%u, %s) toggled cheat [%s] globally!",
+                networking_msg->m_conn, client_it->second.name, state_msg.content.cheated ? "on" : "off");
+            bmmo::owned_cheat_toggle_msg new_msg{};
+            new_msg.content.player_id = client_it->first;
+            new_msg.content.state.cheated = state_msg.content.cheated;
+            broadcast_message(&new_msg, sizeof(new_msg), k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::kick_request_msg>([this](bmmo::kick_request_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            HSteamNetConnection player_id = msg.player_id;
+            if (!msg.player_name.empty()) {
+                Printf(bmmo::color_code(msg.code), "%s requested to kick player \"%s\"!",
+                        client_it->second.name, msg.player_name);
+                player_id = get_client_id(msg.player_name);
+            } else {
+                Printf(bmmo::color_code(msg.code), "%s requested to kick player #%u!",
+                        client_it->second.name, msg.player_id);
             }
-            case bmmo::KickRequest: {
-                bmmo::kick_request_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                HSteamNetConnection player_id = msg.player_id;
-                if (!msg.player_name.empty()) {
-                    Printf(bmmo::color_code(msg.code), "%s requested to kick player \"%s\"!",
-                            client_it->second.name, msg.player_name);
-                    player_id = get_client_id(msg.player_name);
-                } else {
-                    Printf(bmmo::color_code(msg.code), "%s requested to kick player #%u!",
-                            client_it->second.name, msg.player_id);
-                }
-                if (deny_action(networking_msg->m_conn))
-                    break;
+            if (deny_action(networking_msg->m_conn))
+                return;
 
-                bmmo::string_utils::sanitize_string(msg.reason);
+            bmmo::string_utils::sanitize_string(msg.reason);
 
-                if (!kick_client(player_id, msg.reason, client_it->first,
-                        msg.crash ? bmmo::connection_end::Crash : bmmo::connection_end::Kicked)) {
-                    bmmo::action_denied_msg new_msg{};
-                    new_msg.content.reason = bmmo::deny_reason::TargetNotFound;
-                    send(networking_msg->m_conn, new_msg, k_nSteamNetworkingSend_Reliable);
-                };
+            if (!kick_client(player_id, msg.reason, client_it->first,
+                    msg.crash ? bmmo::connection_end::Crash : bmmo::connection_end::Kicked)) {
+                bmmo::action_denied_msg new_msg{};
+                new_msg.content.reason = bmmo::deny_reason::TargetNotFound;
+                send(networking_msg->m_conn, new_msg, k_nSteamNetworkingSend_Reliable);
+            };
+        });
 
-                break;
-            }
-            case bmmo::CurrentMap: {
-                auto* msg = reinterpret_cast<bmmo::current_map_msg*>(networking_msg->m_pData);
-                msg->content.player_id = networking_msg->m_conn;
-                switch (msg->content.type) {
-                    case bmmo::current_map_state::Announcement: {
-                        broadcast_message(*msg, k_nSteamNetworkingSend_Reliable);
-                        Printf(bmmo::color_code(msg->code), "%s(#%u, %s) is at the %d%s sector of %s.",
-                            client_it->second.cheated ? "[CHEAT] " : "",
-                            networking_msg->m_conn, client_it->second.name,
-                            msg->content.sector, bmmo::string_utils::get_ordinal_suffix(msg->content.sector),
-                            msg->content.map.get_display_name(map_names_));
-                        break;
-                    }
-                    case bmmo::current_map_state::EnteringMap: {
-                        auto client_map_it = maps_.find(msg->content.map.get_hash_bytes_string());
-                        if (client_map_it != maps_.end() && client_map_it->second.mode == bmmo::level_mode::Highscore) {
-                            bmmo::highscore_timer_calibration_msg hs_msg{.content = {
-                                .map = msg->content.map,
-                                .time_diff_microseconds = SteamNetworkingUtils()->GetLocalTimestamp() - client_map_it->second.start_time,
-                            }};
-                            send(networking_msg->m_conn, hs_msg, k_nSteamNetworkingSend_Reliable);
-                        }
-                        [[fallthrough]];
-                    }
-                    case bmmo::current_map_state::NameChange: {
-                        client_it->second.current_map = msg->content.map;
-                        client_it->second.current_sector = msg->content.sector;
-                        broadcast_message(*msg, k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
-                        break;
-                    }
-                    default: break;
+        d.on<bmmo::current_map_msg>([this](bmmo::current_map_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            msg.content.player_id = networking_msg->m_conn;
+            switch (msg.content.type) {
+                case bmmo::current_map_state::Announcement: {
+                    broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
+                    Printf(bmmo::color_code(msg.code), "%s(#%u, %s) is at the %d%s sector of %s.",
+                        client_it->second.cheated ? "[CHEAT] " : "",
+                        networking_msg->m_conn, client_it->second.name,
+                        msg.content.sector, bmmo::string_utils::get_ordinal_suffix(msg.content.sector),
+                        msg.content.map.get_display_name(map_names_));
+                    break;
                 }
-                break;
-            }
-            case bmmo::CurrentSector: {
-                auto* msg = reinterpret_cast<bmmo::current_sector_msg*>(networking_msg->m_pData);
-                msg->content.player_id = networking_msg->m_conn;
-                client_it->second.current_sector = msg->content.sector;
-                broadcast_message(*msg, k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
-                break;
-            }
-            case bmmo::SimpleAction: {
-                auto* msg = reinterpret_cast<bmmo::simple_action_msg*>(networking_msg->m_pData);
-                switch (msg->content) {
-                    using sa = bmmo::simple_action;
-                    case sa::CurrentMapQuery: {
-                        break;
+                case bmmo::current_map_state::EnteringMap: {
+                    auto& room_maps = rooms_.at(client_it->second.room).maps;
+                    auto client_map_it = room_maps.find(msg.content.map.key());
+                    if (client_map_it != room_maps.end() && client_map_it->second.mode == bmmo::level_mode::Highscore) {
+                        bmmo::highscore_timer_calibration_msg hs_msg{.content = {
+                            .map = msg.content.map,
+                            .time_diff_microseconds = SteamNetworkingUtils()->GetLocalTimestamp() - client_map_it->second.start_time,
+                        }};
+                        send(networking_msg->m_conn, hs_msg, k_nSteamNetworkingSend_Reliable);
                     }
-                    case sa::FatalError: {
-                        Printf("(#%u, %s) has encountered a fatal error!",
-                            networking_msg->m_conn, client_it->second.name);
-                        // they already got their own fatal error, so we don't need to induce one here.
-                        kick_client(networking_msg->m_conn, "fatal error", k_HSteamNetConnection_Invalid, bmmo::connection_end::SelfTriggeredFatalError);
-                        break;
-                    }
-                    case sa::BallOff: {
-                        if (!config_.log_ball_offs)
-                            break;
-                        char text[256];
-                        std::snprintf(text, sizeof(text), "(#%u, %s) just fell at sector %d of %s.",
-                                networking_msg->m_conn, client_it->second.name.c_str(),
-                                client_it->second.current_sector,
-                                client_it->second.current_map.get_display_name(map_names_).c_str());
-                        LogFileOutput(text);
-                        break;
-                    }
-                    default:
-                        break;
+                    [[fallthrough]];
                 }
-                break;
-            }
-            case bmmo::OwnedSimpleAction: {
-                auto* msg = reinterpret_cast<bmmo::owned_simple_action_msg*>(networking_msg->m_pData);
-                switch (msg->content.type) {
-                    using osa = bmmo::owned_simple_action_type;
-                    case osa::RestartRequestFailed: {
-                        Printf(bmmo::ansi::Italic, "(#%u, %s)'s restart request failed.",
-                            msg->content.player_id, get_client_name(msg->content.player_id));
-                        if (!client_exists(msg->content.player_id, true)
-                                && msg->content.player_id != k_HSteamNetConnection_Invalid)
-                            break;
-                        broadcast_message(*msg);
-                        break;
+                case bmmo::current_map_state::NameChange: {
+                    const bool map_changed = client_it->second.current_map != msg.content.map;
+                    client_it->second.current_map = msg.content.map;
+                    client_it->second.current_sector = msg.content.sector;
+                    if (map_changed) { // players on the new map haven't got our ball yet
+                        clients_.touch_state(client_it.index());
+                        roster_changed_ = true;
                     }
-                    default:
-                        break;
+                    update_roster(*client_it);
+                    broadcast_message(msg, k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
+                    if (map_changed)
+                        send_map_snapshot(networking_msg->m_conn);
+                    break;
                 }
-                break;
+                default: break;
             }
-            case bmmo::PermanentNotification: {
-                if (deny_action(networking_msg->m_conn))
+        });
+        d.on<bmmo::current_sector_msg>([this](bmmo::current_sector_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            msg.content.player_id = networking_msg->m_conn;
+            client_it->second.current_sector = msg.content.sector;
+            update_roster(*client_it);
+            broadcast_message(msg, k_nSteamNetworkingSend_Reliable, networking_msg->m_conn);
+        });
+        d.on<bmmo::simple_action_msg>([this](bmmo::simple_action_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            switch (msg.content) {
+                using sa = bmmo::simple_action;
+                case sa::CurrentMapQuery: {
                     break;
-                auto msg = bmmo::message_utils::deserialize<bmmo::permanent_notification_msg>(networking_msg);
-                bmmo::string_utils::sanitize_string(msg.text_content);
-                const bool muted = is_muted(client_it->second.uuid);
-
-                Printf(bmmo::color_code(msg.code) | (muted ? bmmo::ansi::Strikethrough : bmmo::ansi::Reset),
-                        "%s[Bulletin] %s%s", muted ? "[Muted] " : "", client_it->second.name,
-                        msg.text_content.empty() ? " - Content cleared" : ": " + msg.text_content);
-                if (muted) break;
-                msg.title = client_it->second.name;
-                permanent_notification_ = {msg.title, msg.text_content};
-                msg.clear();
-                msg.serialize();
-                broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
-                break;
-            }
-            case bmmo::PlainText: {
-                bmmo::plain_text_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-                Printf("[Plain] (%u, %s): %s", networking_msg->m_conn, client_it->second.name, msg.text_content);
-                break;
-            }
-            case bmmo::PublicNotification: {
-                auto msg = bmmo::message_utils::deserialize<bmmo::public_notification_msg>(networking_msg);
-                Printf(msg.get_ansi_color_code(), "[%s] (%u, %s): %s",
-                        msg.get_type_name(), networking_msg->m_conn, client_it->second.name, msg.text_content);
-                broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
-                if (msg.type == bmmo::public_notification_type::SeriousWarning
-                        && config_.serious_warning_as_dnf && !client_it->second.dnf) {
-                    auto client_map_it = maps_.find(client_it->second.current_map.get_hash_bytes_string());
-                    if (client_map_it == maps_.end() || SteamNetworkingUtils()->GetLocalTimestamp()
-                            - maps_[client_it->second.current_map.get_hash_bytes_string()].start_time > 20ll * 60 * 1000000)
-                        break;
-                    bmmo::did_not_finish_msg dnf_msg{.content = {
-                        .cheated = client_it->second.cheated,
-                        .map = client_it->second.current_map,
-                        .sector = client_it->second.current_sector,
-                    }};
-                    receive(&dnf_msg, sizeof(dnf_msg), networking_msg->m_conn);
                 }
-                break;
-            }
-            case bmmo::RestartRequest: {
-                if (deny_action(networking_msg->m_conn))
+                case sa::FatalError: {
+                    Printf("(#%u, %s) has encountered a fatal error!",
+                        networking_msg->m_conn, client_it->second.name);
+                    // they already got their own fatal error, so we don't need to induce one here.
+                    kick_client(networking_msg->m_conn, "fatal error", k_HSteamNetConnection_Invalid, bmmo::connection_end::SelfTriggeredFatalError);
                     break;
-                auto msg = bmmo::message_utils::deserialize<bmmo::restart_request_msg>(networking_msg);
-                if (!client_exists(msg.content.victim, true)) {
-                    Printf(bmmo::ansi::Italic, "(#%u, %s) requested to restart #%u's (not found) current level!",
-                        networking_msg->m_conn, client_it->second.name,
-                        msg.content.victim);
-                    send(networking_msg->m_conn, bmmo::action_denied_msg{.content = {bmmo::deny_reason::TargetNotFound}});
+                }
+                case sa::BallOff: {
+                    if (!config_.log_ball_offs)
+                        break;
+                    char text[256];
+                    std::snprintf(text, sizeof(text), "(#%u, %s) just fell at sector %d of %s.",
+                            networking_msg->m_conn, client_it->second.name.c_str(),
+                            client_it->second.current_sector,
+                            client_it->second.current_map.get_display_name(map_names_).c_str());
+                    LogFileOutput(text);
                     break;
                 }
-                Printf(bmmo::ansi::Italic, "(#%u, %s) requested to restart (#%u, %s)'s current level!",
-                    networking_msg->m_conn, client_it->second.name,
-                    msg.content.victim, clients_[msg.content.victim].name);
-                msg.content.requester = networking_msg->m_conn;
-                broadcast_message(msg);
-                break;
+                default:
+                    break;
             }
-            case bmmo::ScoreList: {
-                auto msg = bmmo::message_utils::deserialize<bmmo::score_list_msg>(networking_msg);
-                auto* rankings = get_map_rankings(msg.map);
-                Printf(bmmo::color_code(msg.code), "(%u, %s) queried the score list of %s%s.",
-                        networking_msg->m_conn, client_it->second.name,
-                        msg.map.get_display_name(map_names_),
-                        rankings ? "" : " [Not found]");
-                msg.clear();
-                if (!rankings) {
-                    send(networking_msg->m_conn, bmmo::action_denied_msg{.content = {bmmo::deny_reason::TargetNotFound}},
-                            k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::owned_simple_action_msg>([this](bmmo::owned_simple_action_msg& msg, ISteamNetworkingMessage*, client_iterator) {
+            switch (msg.content.type) {
+                using osa = bmmo::owned_simple_action_type;
+                case osa::RestartRequestFailed: {
+                    Printf(bmmo::ansi::Italic, "(#%u, %s)'s restart request failed.",
+                        msg.content.player_id, get_client_name(msg.content.player_id));
+                    if (!client_exists(msg.content.player_id, true)
+                            && msg.content.player_id != k_HSteamNetConnection_Invalid)
+                        break;
+                    broadcast_message(msg);
                     break;
                 }
-                msg.serialize(*rankings);
-                send(networking_msg->m_conn, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
-                break;
+                default:
+                    break;
             }
-            case bmmo::HashData: {
-                bmmo::hash_data_msg msg{};
-                msg.raw.write(static_cast<const char*>(networking_msg->m_pData), networking_msg->m_cbSize);
-                msg.deserialize();
-
-                for (const auto* file_data: bmmo::HASHES_TO_CHECK) {
-                    if (!msg.data.contains(file_data[0]) || msg.is_same_data(file_data[0], file_data[1]))
-                        continue;
-                    bmmo::public_notification_msg new_msg{};
-                    new_msg.type = bmmo::public_notification_type::Warning;
-                    std::string file_name{file_data[0]}, md5_string;
-                    const auto& md5 = msg.data[file_name];
-                    bmmo::string_from_hex_chars(md5_string, md5.data(), md5.size());
-                    if (auto slash_pos = file_name.rfind('\\'); slash_pos != std::string::npos)
-                        file_name.erase(0, slash_pos + 1);
-                    new_msg.text_content = client_it->second.name + " has a modified " + file_name + " (MD5 " + md5_string.substr(0, 12) + "..)! This could be problematic.";
-                    Printf("[%s] %s", new_msg.get_type_name(), new_msg.text_content);
-                    new_msg.serialize();
-                    broadcast_message(new_msg.raw.str().data(), new_msg.size(), k_nSteamNetworkingSend_Reliable);
-                }
-                break;
+        });
+
+        d.on<bmmo::permanent_notification_msg>([this](bmmo::permanent_notification_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            if (deny_action(networking_msg->m_conn))
+                return;
+            bmmo::string_utils::sanitize_string(msg.text_content);
+            const bool muted = is_muted(client_it->second.uuid);
+
+            Printf(bmmo::color_code(msg.code) | (muted ? bmmo::ansi::Strikethrough : bmmo::ansi::Reset),
+                    "%s[Bulletin] %s%s", muted ? "[Muted] " : "", client_it->second.name,
+                    msg.text_content.empty() ? " - Content cleared" : ": " + msg.text_content);
+            if (muted) return;
+            msg.title = client_it->second.name;
+            auto& room = rooms_.at(client_it->second.room);
+            room.bulletin = {msg.title, msg.text_content};
+            room.bulletin_payload.invalidate();
+            msg.clear();
+            msg.serialize();
+            broadcast_to_room(room, msg, k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::plain_text_msg>([](bmmo::plain_text_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            Printf("[Plain] (%u, %s): %s", networking_msg->m_conn, client_it->second.name, msg.text_content);
+        });
+        d.on<bmmo::public_notification_msg>([this](bmmo::public_notification_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            Printf(msg.get_ansi_color_code(), "[%s] (%u, %s): %s",
+                    msg.get_type_name(), networking_msg->m_conn, client_it->second.name, msg.text_content);
+            broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
+            if (msg.type == bmmo::public_notification_type::SeriousWarning
+                    && config_.serious_warning_as_dnf && !client_it->second.dnf) {
+                auto& room_maps = rooms_.at(client_it->second.room).maps;
+                auto client_map_it = room_maps.find(client_it->second.current_map.key());
+                if (client_map_it == room_maps.end() || SteamNetworkingUtils()->GetLocalTimestamp()
+                        - client_map_it->second.start_time > 20ll * 60 * 1000000)
+                    return;
+                bmmo::did_not_finish_msg dnf_msg{.content = {
+                    .cheated = client_it->second.cheated,
+                    .map = client_it->second.current_map,
+                    .sector = client_it->second.current_sector,
+                }};
+                receive(&dnf_msg, sizeof(dnf_msg), networking_msg->m_conn);
             }
-            case bmmo::ModList: { // TODO: configurable mod blacklist/whitelist handling
-                auto msg = bmmo::message_utils::deserialize<bmmo::mod_list_msg>(networking_msg);
-                if (config_.log_installed_mods)
-                    config_.log_mod_list(msg.mods);
-                break;
+        });
+        d.on<bmmo::restart_request_msg>([this](bmmo::restart_request_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            if (deny_action(networking_msg->m_conn))
+                return;
+            if (!client_exists(msg.content.victim, true)) {
+                Printf(bmmo::ansi::Italic, "(#%u, %s) requested to restart #%u's (not found) current level!",
+                    networking_msg->m_conn, client_it->second.name,
+                    msg.content.victim);
+                send(networking_msg->m_conn, bmmo::action_denied_msg{.content = {bmmo::deny_reason::TargetNotFound}});
+                return;
             }
-            case bmmo::SoundData:
-            case bmmo::SoundStream:
-            case bmmo::OwnedBallState:
-            case bmmo::OwnedBallStateV2:
-            case bmmo::OwnedTimedBallState:
-            case bmmo::OwnedCompressedBallState:
-            case bmmo::LatencyData:
-            case bmmo::LoginAcceptedV2:
-            case bmmo::LoginAcceptedV3:
-            case bmmo::PlayerConnectedV2:
-            case bmmo::HighscoreTimerCalibration:
-            case bmmo::NameUpdate:
-            case bmmo::OwnedCheatState:
-            case bmmo::OwnedCheatToggle:
-            case bmmo::PlayerKicked:
-            case bmmo::ActionDenied:
-            case bmmo::ExtraLife:
-            case bmmo::OpState:
-            case bmmo::KeyboardInput:
-                break;
-            default:
-                Printf("Error: invalid message with opcode %d received from #%u.",
-                        raw_msg->code, networking_msg->m_conn);
+            Printf(bmmo::ansi::Italic, "(#%u, %s) requested to restart (#%u, %s)'s current level!",
+                networking_msg->m_conn, client_it->second.name,
+                msg.content.victim, clients_[msg.content.victim].name);
+            msg.content.requester = networking_msg->m_conn;
+            broadcast_message(msg);
+        });
+
+        d.on<bmmo::score_list_msg>([this](bmmo::score_list_msg& msg, ISteamNetworkingMessage* networking_msg, client_iterator client_it) {
+            auto* rankings = get_map_rankings(msg.map, rooms_.at(client_it->second.room));
+            Printf(bmmo::color_code(msg.code), "(%u, %s) queried the score list of %s%s.",
+                    networking_msg->m_conn, client_it->second.name,
+                    msg.map.get_display_name(map_names_),
+                    rankings ? "" : " [All-time]");
+            msg.clear();
+            if (!rankings) {
+                send_leaderboard_scores(networking_msg->m_conn, msg.map, msg.mode);
+                return;
+            }
+            msg.serialize(rankings->serialized());
+            send(networking_msg->m_conn, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        });
+        d.on<bmmo::hash_data_msg>([this](bmmo::hash_data_msg& msg, ISteamNetworkingMessage*, client_iterator client_it) {
+            for (const auto* file_data: bmmo::HASHES_TO_CHECK) {
+                if (!msg.data.contains(file_data[0]) || msg.is_same_data(file_data[0], file_data[1]))
+                    continue;
+                bmmo::public_notification_msg new_msg{};
+                new_msg.type = bmmo::public_notification_type::Warning;
+                std::string file_name{file_data[0]}, md5_string;
+                const auto& md5 = msg.data[file_name];
+                bmmo::string_from_hex_chars(md5_string, md5.data(), md5.size());
+                if (auto slash_pos = file_name.rfind('\\'); slash_pos != std::string::npos)
+                    file_name.erase(0, slash_pos + 1);
+                new_msg.text_content = client_it->second.name + " has a modified " + file_name + " (MD5 " + md5_string.substr(0, 12) + "..)! This could be problematic.";
+                Printf("[%s] %s", new_msg.get_type_name(), new_msg.text_content);
+                new_msg.serialize();
+                broadcast_message(new_msg, k_nSteamNetworkingSend_Reliable);
+            }
+        });
+        d.on<bmmo::mod_list_msg>([this](bmmo::mod_list_msg& msg, ISteamNetworkingMessage*, client_iterator) {
+            // TODO: configurable mod blacklist/whitelist handling
+            if (config_.log_installed_mods)
+                config_.log_mod_list(msg.mods);
+        });
+
+        d.ignore({
+            bmmo::LoginAccepted, bmmo::PlayerDisconnected, bmmo::PlayerConnected, bmmo::Ping,
+            bmmo::LevelFinish,
+            bmmo::SoundData, bmmo::SoundStream,
+            bmmo::OwnedBallState, bmmo::OwnedBallStateV2, bmmo::OwnedTimedBallState,
+            bmmo::OwnedCompressedBallState, bmmo::OwnedDeltaBallState, bmmo::OwnedQuantizedBallState,
+            bmmo::LatencyData, bmmo::LoginAcceptedV2, bmmo::LoginAcceptedV3, bmmo::LoginAcceptedV4, bmmo::PlayerConnectedV2,
+            bmmo::HighscoreTimerCalibration, bmmo::NameUpdate, bmmo::OwnedCheatState, bmmo::OwnedCheatToggle,
+            bmmo::PlayerKicked, bmmo::ActionDenied, bmmo::ExtraLife, bmmo::OpState, bmmo::KeyboardInput,
+        });
+    }
+
+    // Blocks until GNS has got new network activity for us or `deadline` is reached.
+    // Tasks posted by other threads can't wake GNS up, so the wait is cut into slices
+    // of POSTED_TASK_LATENCY with a look at `tasks_posted_` in between.
+    void wait_for_events(std::chrono::steady_clock::time_point deadline) {
+        auto now = std::chrono::steady_clock::now();
+#ifdef STEAMNETWORKINGSOCKETS_OPENSOURCE
+        while (true) {
+            const auto slice_end = std::min(deadline, now + POSTED_TASK_LATENCY);
+            // still poll with a zero timeout if we're already late; GNS only does its work in here
+            SteamNetworkingSockets_Poll((int) std::max<int64_t>(0,
+                    std::chrono::ceil<std::chrono::milliseconds>(slice_end - now).count()));
+            now = std::chrono::steady_clock::now();
+            // returning early means GNS had network activity for us
+            if (now < slice_end || slice_end == deadline || tasks_posted_.load(std::memory_order_acquire))
+                return;
         }
+#else
+        if (deadline <= now || tasks_posted_.load(std::memory_order_acquire))
+            return;
+        // no manual polling available; fall back to our old receive interval
+        std::this_thread::sleep_until(std::min({deadline, now + bmmo::SERVER_RECEIVE_INTERVAL, now + POSTED_TASK_LATENCY}));
+#endif
+    }
 
-        // TODO: replace with actual message data structure handling
-//        std::string str;
-//        str.assign((const char*)networking_msg->m_pData, networking_msg->m_cbSize);
-//
-//        Printf("%s: %s", client_it->second.name.c_str(), str.c_str());
-//        interface_->SendMessageToConnection(client_it->first, str.c_str(), str.length() + 1,
-//                                            k_nSteamNetworkingSend_Reliable,
-//                                            nullptr);
+    void poll_connection_state_changes() override {
+        BMMO_PROFILE_SCOPE(stage_profiler::ConnectionChanges);
+        role::poll_connection_state_changes();
     }
 
     int poll_incoming_messages() override {
+        BMMO_PROFILE_SCOPE(stage_profiler::PollMessages);
         const int msg_count = interface_->ReceiveMessagesOnPollGroup(poll_group_, incoming_messages_, ONCE_RECV_MSG_COUNT);
         if (msg_count == 0)
             return 0;
@@ -1454,72 +1949,262 @@ protected:
         return msg_count;
     }
 
-    inline void tick() {
-        bmmo::owned_compressed_ball_state_msg ball_msg{};
-        pull_unupdated_ball_states(ball_msg.balls, ball_msg.unchanged_balls);
-        if (ball_msg.balls.empty() && ball_msg.unchanged_balls.empty())
-            return;
-        ball_msg.serialize();
-        if (config_.ghost_mode) {
-            for (const auto& i: ghost_spectator_clients_)
-                send(i, ball_msg.raw.str().data(), ball_msg.size(), k_nSteamNetworkingSend_UnreliableNoDelay);
-        } else {
-            broadcast_message(ball_msg.raw.str().data(), ball_msg.size(), k_nSteamNetworkingSend_UnreliableNoDelay);
+    // Runs on the room's own tick thread; rooms tick in parallel.
+    void tick(room_data& room) {
+        BMMO_PROFILE_FRAME(stage_profiler::Tick);
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        clock::duration serialization_time{};
+        relay_ball_states(room, serialization_time);
+        metrics_.tick_duration.observe(std::chrono::duration<double>(clock::now() - start).count());
+        metrics_.serialization_time.observe(std::chrono::duration<double>(serialization_time).count());
+    }
+
+    // Ball states only go to players on the same map, serialized once per map.
+    inline void relay_ball_states(room_data& room, std::chrono::steady_clock::duration& serialization_time) {
+        using clock = std::chrono::steady_clock;
+        const auto world = world_.load();
+        pull_interest_groups(room, *world);
+        auto& outgoing = room.outgoing;
+        for (auto& [_, group]: room.interest_groups) {
+            for (auto [id, encoder]: group.delta_recipients) {
+                bmmo::owned_delta_ball_state_msg delta_msg{};
+                bool encoded;
+                {
+                    BMMO_PROFILE_SCOPE(stage_profiler::Serialize);
+                    const auto encode_start = clock::now();
+                    encoded = encoder->encode(group.snapshot, delta_msg);
+                    serialization_time += clock::now() - encode_start;
+                }
+                if (!encoded)
+                    continue;
+                auto* payload = make_payload(delta_msg);
+                outgoing.add(std::views::single(id), payload, k_nSteamNetworkingSend_UnreliableNoDelay);
+                payload->release();
+            }
+            if (group.balls.empty() && group.unchanged_balls.empty())
+                continue;
+            if (!group.quantized_recipients.empty()) {
+                bmmo::owned_quantized_ball_state_msg quantized_msg{};
+                quantized_msg.position_bits = quantized_position_bits_.load(std::memory_order_relaxed);
+                std::swap(quantized_msg.balls, group.balls);
+                std::swap(quantized_msg.unchanged_balls, group.unchanged_balls);
+                bool serialized;
+                {
+                    BMMO_PROFILE_SCOPE(stage_profiler::Serialize);
+                    const auto serialize_start = clock::now();
+                    serialized = quantized_msg.serialize();
+                    serialization_time += clock::now() - serialize_start;
+                }
+                std::swap(quantized_msg.balls, group.balls);
+                std::swap(quantized_msg.unchanged_balls, group.unchanged_balls);
+                if (serialized) {
+                    auto* payload = make_payload(quantized_msg);
+                    outgoing.add(group.quantized_recipients, payload, k_nSteamNetworkingSend_UnreliableNoDelay);
+                    payload->release();
+                } else { // positions it can't hold, like ones at infinity
+                    group.recipients.insert(group.recipients.end(),
+                            group.quantized_recipients.begin(), group.quantized_recipients.end());
+                }
+            }
+            if (group.recipients.empty())
+                continue;
+            bmmo::owned_compressed_ball_state_msg ball_msg{};
+            std::swap(ball_msg.balls, group.balls);
+            std::swap(ball_msg.unchanged_balls, group.unchanged_balls);
+            {
+                BMMO_PROFILE_SCOPE(stage_profiler::Serialize);
+                const auto serialize_start = clock::now();
+                ball_msg.serialize();
+                serialization_time += clock::now() - serialize_start;
+            }
+            auto* payload = make_payload(ball_msg);
+            outgoing.add(group.recipients, payload, k_nSteamNetworkingSend_UnreliableNoDelay);
+            payload->release();
+            // hand the buffers back so that they can be reused next tick
+            std::swap(ball_msg.balls, group.balls);
+            std::swap(ball_msg.unchanged_balls, group.unchanged_balls);
         }
+        if (outgoing.empty())
+            return;
 
-        ++ping_data_counter_;
-        if (ping_data_counter_ >= bmmo::PING_INTERVAL_TICKS) {
+        // the player list is server-wide, so is the latency data
+        if (++room.ping_data_counter >= bmmo::PING_INTERVAL_TICKS) {
             bmmo::latency_data_msg ping_msg{};
-            ping_msg.data.reserve(clients_.size());
-            for (const auto& i: clients_) {
+            ping_msg.data.reserve(world->roster->clients.size());
+            for (const auto& client: world->roster->clients) {
                 SteamNetConnectionRealTimeStatus_t status{};
-                interface_->GetConnectionRealTimeStatus(i.first, &status, 0, nullptr);
-                ping_msg.data.try_emplace(i.first,
+                interface_->GetConnectionRealTimeStatus(client.id, &status, 0, nullptr);
+                ping_msg.data.try_emplace(client.id,
                         (uint16_t) std::min(status.m_nPing, (int) std::numeric_limits<uint16_t>::max()));
             }
-            ping_msg.serialize();
-            ping_data_counter_ = 0;
-            broadcast_message(ping_msg.raw.str().data(), ping_msg.size(), k_nSteamNetworkingSend_Reliable);
+            {
+                BMMO_PROFILE_SCOPE(stage_profiler::Serialize);
+                const auto serialize_start = clock::now();
+                ping_msg.serialize();
+                serialization_time += clock::now() - serialize_start;
+            }
+            room.ping_data_counter = 0;
+            auto* payload = make_payload(ping_msg);
+            outgoing.add(room.tick_members, payload, k_nSteamNetworkingSend_Reliable);
+            payload->release();
         }
+        BMMO_PROFILE_SCOPE(stage_profiler::SendOutgoing);
+        outgoing.flush(interface_);
     };
 
-    void start_ticking() {
-        ticking_ = true;
-        // ticking_thread_ = std::thread([&]() {
-        Printf("Ticking started.");
-        //     while (ticking_) {
-        //         auto next_tick = std::chrono::steady_clock::now() + TICK_INTERVAL;
-        //         tick();
-        //         std::this_thread::sleep_until(next_tick);
+    // Rooms only tick while there's more than one player in them.
+    void update_room_ticking(room_data& room) {
+        const bool should_tick = room.members.size() > 1;
+        if (should_tick == room.ticker->running())
+            return;
+        if (should_tick) {
+            room.phase_estimator.reset();
+            room.ticker->start();
+            Printf("Ticking started in room \"%s\".", room.name);
+        } else {
+            room.ticker->stop();
+            Printf("Ticking stopped in room \"%s\" (%llu ticks, %llu skipped in total).", room.name,
+                    room.ticker->get_tick_count(), room.ticker->get_skipped_tick_count());
+        }
     }
-    void stop_ticking() {
-        ticking_ = false;
-        // ticking_thread_.join();
-        Printf("Ticking stopped.");
+
+    // Rankings and bulletins are reset once everyone has left a room.
+    void on_room_left(room_data& room) {
+        if (!room.members.empty())
+            return;
+        room.maps.clear();
+        room.bulletin = {};
+        room.bulletin_payload.invalidate();
     }
 
+    // @returns `true` if any tasks were run.
+    bool run_posted_tasks() {
+        BMMO_PROFILE_SCOPE(stage_profiler::PostedTasks);
+        bool ran = false;
+        tasks_posted_.store(false, std::memory_order_relaxed);
+        while (auto task = posted_tasks_.pop()) {
+            (*task)();
+            ran = true;
+        }
+        return ran;
+    }
+
+    void run_due_timers(std::chrono::steady_clock::time_point now) {
+        BMMO_PROFILE_SCOPE(stage_profiler::Timers);
+        while (!timers_.empty() && timers_.begin()->first <= now) {
+            auto task = std::move(timers_.begin()->second);
+            timers_.erase(timers_.begin());
+            task();
+        }
+    }
+
+    // Feeds the arrival time of a client ball state into its room's phase estimator.
+    void add_phase_sample(const client_data& client, SteamNetworkingMicroseconds time_received) {
+        if (!config_.align_tick_phase)
+            return;
+        const auto delay = std::chrono::microseconds(SteamNetworkingUtils()->GetLocalTimestamp() - time_received);
+        rooms_.at(client.room).phase_estimator.add_sample(tick_scheduler::clock::now() - delay);
+    }
+
+    // Moves each room's ticks to shortly after most of its clients' ball states tend to arrive,
+    // so that they get relayed with as little waiting as possible.
+    void align_tick_phase() {
+        if (!config_.align_tick_phase)
+            return;
+        for (auto& [_, room]: rooms_) {
+            if (!room.ticker->running())
+                continue;
+            if (tick_scheduler::clock::time_point phase; room.phase_estimator.get_phase(phase))
+                room.ticker->align_phase(phase, bmmo::SERVER_TICK_DELAY);
+            room.phase_estimator.reset();
+        }
+    }
+
+    // Refreshes the gauges and samples everyone's connection status.
+    void update_metrics() {
+        metrics_.clients.set(double(clients_.size()));
+        metrics_.rooms.set(double(rooms_.size()));
+        size_t ticking_rooms = 0;
+        uint64_t skipped_ticks = 0;
+        for (const auto& [_, room]: rooms_) {
+            if (!room.ticker->running())
+                continue;
+            ++ticking_rooms;
+            skipped_ticks += room.ticker->get_skipped_tick_count();
+        }
+        metrics_.ticking_rooms.set(double(ticking_rooms));
+        metrics_.skipped_ticks.set(double(skipped_ticks));
+        metrics_.persistence_pending.set(double(persistence_.pending_count()));
+        for (const auto& [id, _]: clients_) {
+            SteamNetConnectionRealTimeStatus_t status{};
+            if (interface_->GetConnectionRealTimeStatus(id, &status, 0, nullptr) != k_EResultOK)
+                continue;
+            metrics_.ping.observe(status.m_nPing / 1000.0);
+            if (status.m_flConnectionQualityLocal >= 0) // negative if unknown yet
+                metrics_.connection_quality.observe(status.m_flConnectionQualityLocal);
+        }
+    }
+
+    // Exports the metrics every `metrics_interval_s` seconds; connection samples are taken even without a file to write to.
+    void schedule_metrics_export() {
+        schedule(std::chrono::seconds(config_.metrics_interval_s), [this] {
+            update_metrics();
+            if (!config_.metrics_file.empty())
+                persistence_.write(config_.metrics_file, metrics_.registry.to_prometheus());
+            schedule_metrics_export();
+        });
+    }
+
+    static constexpr std::chrono::seconds PHASE_ALIGNMENT_INTERVAL{5};
+
     uint16_t port_ = 0;
     HSteamListenSocket listen_socket_ = k_HSteamListenSocket_Invalid;
     HSteamNetPollGroup poll_group_ = k_HSteamNetPollGroup_Invalid;
 //    std::thread server_thread_;
+    // Client and room data belong to the server thread; everyone else reads `world_`.
     client_data_collection clients_;
-    std::map<std::string, HSteamNetConnection> username_; // Note: this stores names converted to all-lowercases
+    bmmo::name_index<HSteamNetConnection> username_; // case-insensitive
     std::unordered_set<HSteamNetConnection> ghost_spectator_clients_; // ghost mode - only operators and spectators can see other players
-    std::mutex client_data_mutex_;
-    std::pair<std::string, std::string> permanent_notification_; // <username (title), text>
+    world_publisher world_;
+    std::shared_ptr<const world_roster> roster_ = std::make_shared<const world_roster>(); // as last published
+    bool roster_changed_ = true; // anything in `world_roster` changed since it was last published
+    uint64_t published_serial_ = 0;
+    bool publish_pending_ = false; // the last publish_world() found no free buffer
 
     std::mutex startup_mutex_;
     std::condition_variable startup_cv_;
 
-    // std::thread ticking_thread_;
-    std::atomic_bool ticking_ = false;
-    int ping_data_counter_ = 0;
-    map_data_collection maps_;
-    bmmo::map last_countdown_map_{};
-
+    bmmo::mpsc_queue<std::function<void()>> posted_tasks_;
+    std::atomic_bool tasks_posted_ = false; // since the server thread last looked at `posted_tasks_`
+    std::atomic_bool tasks_discarded_ = false; // set once the server thread stops running `posted_tasks_`
+    std::atomic<std::thread::id> server_thread_id_;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers_; // server thread only
+    std::atomic_bool shutting_down_ = false;
+    std::atomic_int quantized_position_bits_ = bmmo::owned_quantized_ball_state_msg::DEFAULT_POSITION_BITS; // for tick threads
+
+    server_metrics metrics_; // recorded into from any thread
+    stage_profiler profiler_{metrics_.registry};
+    persistence_worker persistence_;
     config_manager config_;
-
-    std::unordered_map<std::string, std::string> map_names_;
+    login_journal login_history_;
+    leaderboard_store leaderboard_;
+
+    bmmo::map_name_table map_names_;
+    message_batch broadcast_batch_; // server thread only
+    login_snapshot_cache login_cache_; // server thread only
+    bmmo::message_dispatcher<client_data_collection::iterator> dispatcher_; // server thread only
+
+    static constexpr const char* DEFAULT_ROOM = "main";
+    // longest a task posted to an idle server waits before it's run
+    static constexpr std::chrono::milliseconds POSTED_TASK_LATENCY{10};
+    static constexpr size_t MAX_NAME_SUGGESTION_DISTANCE = 2; // for "did you mean" with unknown names
+    static constexpr size_t LEADERBOARD_PRINT_COUNT = 10, LEADERBOARD_SCORE_LIST_COUNT = 100;
+    static constexpr bmmo::capability_set SUPPORTED_CAPABILITIES{
+        .encodings = bmmo::capability::DeltaBallState | bmmo::capability::QuantizedBallState,
+    };
+    room_collection rooms_; // destroyed first, which stops the tick threads
+    std::string console_room_ = DEFAULT_ROOM;
 };
 
 // parse arguments (optional port and help/version/log) with getopt
@@ -1586,8 +2271,13 @@ int main(int argc, char** argv) {
         }
         bmmo::set_log_file(log_file);
     }
+    bmmo::start_log_writer();
 
     printf("Initializing sockets...\n");
+#ifdef STEAMNETWORKINGSOCKETS_OPENSOURCE
+    // no service thread; our main loop polls GNS itself and sleeps in between
+    SteamNetworkingSockets_SetManualPollMode(true);
+#endif
     server::init_socket();
 
     printf("Starting server at port %u.\n", port);
@@ -1608,7 +2298,7 @@ int main(int argc, char** argv) {
         msg.chat_content = console.get_rest_of_line();
         msg.serialize();
 
-        server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
         Printf("([Server]): %s", msg.chat_content);
     });
     auto get_client_id_from_console = [&]() -> HSteamNetConnection {
@@ -1626,10 +2316,10 @@ int main(int argc, char** argv) {
         msg.text_content = console.get_rest_of_line();
         msg.serialize();
         if (broadcast) {
-            server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
             Printf("[Plain]: %s", msg.text_content);
         } else {
-            server.send(client, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
             Printf("[Plain -> %s]: %s", server.get_client_name(client), msg.text_content);
         }
     };
@@ -1661,9 +2351,9 @@ int main(int argc, char** argv) {
         }
         msg.serialize();
         if (broadcast)
-            server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
         else
-            server.send(client, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         Printf(bmmo::color_code(msg.code), "[Popup -> %s] {%s}: %s",
                 client == k_HSteamNetConnection_Invalid ? "[all]" : server.get_client_name(client),
                 msg.title, msg.text_content);
@@ -1679,9 +2369,9 @@ int main(int argc, char** argv) {
         msg.type = type;
         msg.serialize();
         if (broadcast)
-            server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
         else
-            server.send(client, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         Printf(msg.get_ansi_color(), "[%s] ([Server])%s: %s",
                 msg.get_type_name(), broadcast ? "" : " -> " + server.get_client_name(client),
                 msg.chat_content);
@@ -1723,7 +2413,7 @@ int main(int argc, char** argv) {
         bmmo::private_chat_msg msg{};
         msg.chat_content = text;
         msg.serialize();
-        server.send(client, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+        server.send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         Printf(bmmo::color_code(msg.code), "([Server]) -> %s: %s", server.get_client_name(client), msg.chat_content);
     });
     console.register_command("ban", [&] {
@@ -1761,19 +2451,19 @@ int main(int argc, char** argv) {
         if (console.empty()) { print_hint(); return; }
         std::string hash = console.get_next_word(true);
         if (console.empty()) { print_hint(); return; }
-        bmmo::map map{.type = bmmo::map_type::OriginalLevel, .level = std::clamp(console.get_next_int(), 0, 13)};
-        if (hash == "level")
-            bmmo::hex_chars_from_string(map.md5, bmmo::map::original_map_hashes[map.level]);
-        else
-            bmmo::hex_chars_from_string(map.md5, hash);
+        bmmo::map map{};
+        map.set_original_level(console.get_next_int());
+        if (hash != "level")
+            bmmo::hex_chars_from_string(map.md5, std::string_view(hash).substr(0, sizeof(map.md5) * 2));
         bmmo::countdown_msg msg{.content = {.map = map}};
         if (!console.empty() && console.get_next_word(true) == "hs")
             msg.content.mode = bmmo::level_mode::Highscore;
         if (console.empty()) {
             for (int i = 3; i >= 0; --i) {
-                msg.content.type = static_cast<bmmo::countdown_type>(i);
-                server.receive(&msg, sizeof(msg), client);
-                if (i != 0) std::this_thread::sleep_for(std::chrono::seconds(1));
+                server.schedule(std::chrono::seconds(3 - i), [&server, msg, client, i]() mutable {
+                    msg.content.type = static_cast<bmmo::countdown_type>(i);
+                    server.receive(&msg, sizeof(msg), client);
+                });
             }
         } else {
             msg.content.type = static_cast<bmmo::countdown_type>(console.get_next_int());
@@ -1787,25 +2477,29 @@ int main(int argc, char** argv) {
             msg.content.mode = bmmo::level_mode::Highscore;
         msg.content.map.type = bmmo::map_type::OriginalLevel;
         for (int i = 3; i >= 0; --i) {
-            msg.content.type = static_cast<bmmo::countdown_type>(i);
-            server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
-            Printf(bmmo::color_code(msg.code), "[[Server]]: Countdown%s - %s",
-                msg.content.mode == bmmo::level_mode::Highscore ? " <HS>" : "",
-                i == 0 ? "Go!" : std::to_string(i));
-            if (i != 0)
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+            server.schedule(std::chrono::seconds(3 - i), [&server, msg, i, room_name = server.get_console_room().name]() mutable {
+                auto* room = server.find_room(room_name);
+                if (!room) return;
+                msg.content.type = static_cast<bmmo::countdown_type>(i);
+                server.broadcast_to_room(*room, msg, k_nSteamNetworkingSend_Reliable);
+                Printf(bmmo::color_code(msg.code), "[[Server]] (%s): Countdown%s - %s", room_name,
+                    msg.content.mode == bmmo::level_mode::Highscore ? " <HS>" : "",
+                    i == 0 ? "Go!" : std::to_string(i));
+            });
         }
     });
     console.register_command("bulletin", [&] {
-        auto& bulletin = server.get_bulletin();
+        auto& room = server.get_console_room();
+        auto& bulletin = room.bulletin;
         if (console.get_command_name() == "bulletin") {
             bulletin = {"[Server]", console.get_rest_of_line()};
+            room.bulletin_payload.invalidate();
             bmmo::permanent_notification_msg msg{};
             std::tie(msg.title, msg.text_content) = bulletin;
             msg.serialize();
-            server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.broadcast_to_room(room, msg, k_nSteamNetworkingSend_Reliable);
         }
-        Printf(bmmo::color_code(bmmo::PermanentNotification), "[Bulletin] %s%s", bulletin.first,
+        Printf(bmmo::color_code(bmmo::PermanentNotification), "[Bulletin] (%s) %s%s", room.name, bulletin.first,
             bulletin.second.empty() ? " - Empty" : ": " + bulletin.second);
     });
     console.register_aliases("bulletin", {"getbulletin"});
@@ -1825,7 +2519,7 @@ int main(int argc, char** argv) {
             std::stringstream temp; temp << sounds;
             Printf(bmmo::ansi::WhiteInverse, "Playing sound - %s", temp.str());
             msg.serialize();
-            server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
         } catch (const std::exception& e) { Printf(e.what()); return; }
     });
     console.register_command("playstream", [&] {
@@ -1863,15 +2557,22 @@ int main(int argc, char** argv) {
             }
             Printf(bmmo::ansi::WhiteInverse, "Sound <%s> (size: %d) sent to %s",
                     msg.path, (uint32_t) msg.size(), broadcast ? "[all]" : std::to_string(client));
-            if (broadcast) server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
-            else server.send(client, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            if (broadcast) server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
+            else server.send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         } catch (const std::exception& e) { Printf(e.what()); return; }
     });
     console.register_aliases("playstream", {"playstream#"});
     console.register_command("scores", [&] {
         if (console.empty()) { Printf("Usage: \"scores <hs|sr> [map]\""); return; }
         bool hs_mode = (console.get_next_word(true) == "hs");
-        server.print_scores(hs_mode, console.empty() ? server.get_last_countdown_map() : static_cast<bmmo::map>(console.get_next_map()));
+        auto& room = server.get_console_room();
+        server.print_scores(hs_mode, console.empty() ? room.last_countdown_map : static_cast<bmmo::map>(console.get_next_map()), room);
+    });
+    console.register_command("leaderboard", [&] {
+        if (console.empty()) { Printf("Usage: \"leaderboard <hs|sr> [map]\""); return; }
+        bool hs_mode = (console.get_next_word(true) == "hs");
+        auto& room = server.get_console_room();
+        server.print_leaderboard(hs_mode, console.empty() ? room.last_countdown_map : static_cast<bmmo::map>(console.get_next_map()));
     });
     console.register_command("sendscores", [&] {
         HSteamNetConnection client{};
@@ -1881,17 +2582,18 @@ int main(int argc, char** argv) {
         }
         bmmo::score_list_msg msg{};
         msg.mode = (console.get_next_word(true) == "hs") ? bmmo::level_mode::Highscore : bmmo::level_mode::Speedrun;
-        msg.map = console.empty() ? server.get_last_countdown_map() : static_cast<bmmo::map>(console.get_next_map());
-        auto* rankings = server.get_map_rankings(msg.map);
+        auto& room = server.get_console_room();
+        msg.map = console.empty() ? room.last_countdown_map : static_cast<bmmo::map>(console.get_next_map());
+        auto* rankings = server.get_map_rankings(msg.map, room);
         if (!rankings) {
             Printf(bmmo::ansi::BrightRed, "Error: ranking info not found for the specified map.");
             return;
         }
-        msg.serialize(*rankings);
+        msg.serialize(rankings->serialized());
         if (client == 0)
-            server.broadcast_message(msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.broadcast_message(msg, k_nSteamNetworkingSend_Reliable);
         else
-            server.send(client, msg.raw.str().data(), msg.size(), k_nSteamNetworkingSend_Reliable);
+            server.send(client, msg.data(), msg.size(), k_nSteamNetworkingSend_Reliable);
         Printf(bmmo::color_code(msg.code), "Score list data sent to #%u.", client);
     });
     console.register_aliases("sendscores", {"sendscores#"});
@@ -1903,29 +2605,90 @@ int main(int argc, char** argv) {
         server.broadcast_message(msg);
         Printf(bmmo::color_code(msg.code), "Requested to restart #%u's current level.", client);
     });
+    console.register_command("room", [&] {
+        auto print_hint = [] {
+            Printf("Usage: \"room list\", \"room create|remove|select <room>\", "
+                   "\"room move <player> <room>\" or \"room ghost <room> on|off\".");
+        };
+        if (console.empty()) { print_hint(); return; }
+        const auto action = console.get_next_word(true);
+        if (action == "list") {
+            server.print_rooms();
+            return;
+        }
+        if (console.empty()) { print_hint(); return; }
+        if (action == "move") {
+            auto client = get_client_id_from_console();
+            if (client == k_HSteamNetConnection_Invalid || console.empty()) return;
+            server.move_client(client, console.get_next_word());
+            return;
+        }
+        const auto room_name = console.get_next_word();
+        if (action == "create") {
+            if (server.create_room(room_name))
+                Printf("Created room \"%s\".", room_name);
+        } else if (action == "remove") {
+            if (server.remove_room(room_name))
+                Printf("Removed room \"%s\".", room_name);
+        } else if (action == "select") {
+            if (server.select_console_room(room_name))
+                Printf("Console commands now apply to room \"%s\".", room_name);
+        } else if (action == "ghost") {
+            auto* room = server.find_room(room_name);
+            if (!room) { Printf("Error: room \"%s\" not found.", room_name); return; }
+            server.set_room_ghost_mode(*room, console.get_next_word(true) == "on");
+        } else {
+            print_hint();
+        }
+    });
+    console.register_command("opstats", [&] {
+        if (console.get_next_word(true) == "reset") {
+            server.reset_opstats();
+            Printf("Opcode statistics have been reset.");
+            return;
+        }
+        server.print_opstats();
+    });
+    console.register_command("stats", [&] { server.print_stats(); });
+    console.register_command("profiler", [&] {
+        const auto action = console.get_next_word(true);
+        if (action == "on" || action == "off")
+            server.set_profiling(action == "on");
+        else
+            server.print_profiling_status();
+    });
+    console.register_command("loginhistory", [&] {
+        if (console.empty()) { Printf("Usage: \"loginhistory <uuid|ip|playername|#id> [count]\""); return; }
+        std::string key = console.get_next_word();
+        const size_t count = console.empty() ? 20 : std::max(console.get_next_int(), 1);
+        server.print_login_history(key, count);
+    });
     console.register_command("flushlog", bmmo::flush_log);
     console.register_command("help", [&] { Printf(console.get_help_string().c_str()); });
 
     server.wait_till_started();
 
     if (dry_run)
-        server.shutdown();
+        server.call([&server] { server.shutdown(); });
 
-    while (server.running()) {
+    while (server.running() && !server.shutting_down()) {
         std::string line;
         if (!console.read_input(line)) {
             puts("stop");
-            server.shutdown();
+            server.call([&server] { server.shutdown(); });
             break;
         };
         LogFileOutput(("> " + line).c_str());
 
-        if (!console.execute(line) && !console.get_command_name().empty()) {
-            std::string extra_text;
-            if (auto hints = console.get_command_hints(true); !hints.empty())
-                extra_text = " Did you mean: " + bmmo::string_utils::join_strings(hints, 0, ", ") + "?";
-            Printf("Error: unknown command \"%s\".%s", console.get_command_name(), extra_text);
-        }
+        // commands touch server state, so they have to run on the server thread
+        server.call([&] {
+            if (!console.execute(line) && !console.get_command_name().empty()) {
+                std::string extra_text;
+                if (auto hints = console.get_command_hints(true); !hints.empty())
+                    extra_text = " Did you mean: " + bmmo::string_utils::join_strings(hints, 0, ", ") + "?";
+                Printf("Error: unknown command \"%s\".%s", console.get_command_name(), extra_text);
+            }
+        });
     }
 
     std::cout << "Stopping..." << std::endl;
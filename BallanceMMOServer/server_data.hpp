@@ -2,30 +2,83 @@
 #define BALLANCEMMOSERVER_SERVER_DATA_HPP
 #include <steam/steamnetworkingsockets.h>
 #include <steam/isteamnetworkingutils.h>
+#include <memory>
+#include <unordered_set>
 #include "../BallanceMMOCommon/common.hpp"
+#include "tick_scheduler.hpp"
+#include "message_batch.hpp"
+#include "login_snapshot_cache.hpp"
+#include "client_table.hpp"
+#include "ranking_board.hpp"
+#include "send_strategy.hpp"
 
 struct client_data {
     std::string name;
     bool cheated = false;
-    bool state_updated = true;
-    bool timestamp_updated = true;
     bool ready = false;
     bool dnf = false;
-    bmmo::timed_ball_state state{};
     bmmo::map current_map{};
     int32_t current_sector = 0;
     uint8_t uuid[16]{};
     int64_t login_time{};
+    std::string room;
+    bmmo::capability_set capabilities; // negotiated at login
+    send_strategy strategy; // chosen from `capabilities`
+    std::shared_ptr<bmmo::ball_delta_encoder> delta_encoder; // only with ball_encoding::Delta
 };
 
 struct map_data {
     int rank = 0;
     SteamNetworkingMicroseconds start_time = 0;
     bmmo::level_mode mode = bmmo::level_mode::Speedrun;
-    bmmo::ranking_entry::player_rankings rankings{};
+    ranking_board rankings{};
 };
 
-typedef std::unordered_map<std::string, map_data> map_data_collection;
-typedef std::unordered_map<HSteamNetConnection, client_data> client_data_collection;
+typedef bmmo::map_key_table<map_data> map_data_collection;
+
+// Players on the same map; only they get each other's ball states.
+struct interest_group {
+    std::vector<bmmo::owned_timed_ball_state> balls;
+    std::vector<bmmo::owned_timestamp> unchanged_balls;
+    std::vector<HSteamNetConnection> recipients;
+    std::vector<HSteamNetConnection> quantized_recipients; // same balls, as OwnedQuantizedBallState
+    // clients with delta ball states get everything on the map, diffed against what they acknowledged
+    bmmo::ball_snapshot snapshot;
+    std::vector<std::pair<HSteamNetConnection, bmmo::ball_delta_encoder*>> delta_recipients;
+
+    bool has_recipients() const { return !recipients.empty() || !quantized_recipients.empty() || !delta_recipients.empty(); }
+
+    void clear() {
+        balls.clear();
+        unchanged_balls.clear();
+        recipients.clear();
+        quantized_recipients.clear();
+        snapshot.clear();
+        delta_recipients.clear();
+    }
+};
+
+// Players in a room only see each other's balls and share rankings and a bulletin;
+// chat and the player list stay server-wide.
+struct room_data {
+    std::string name;
+    std::unordered_set<HSteamNetConnection> members;
+    map_data_collection maps;
+    bmmo::map last_countdown_map{};
+    std::pair<std::string, std::string> bulletin; // <username (title), text>
+    cached_payload bulletin_payload; // `bulletin` as a permanent_notification_msg; server thread only
+    bool ghost_mode = false; // only operators and spectators can see other players
+    std::unique_ptr<tick_scheduler> ticker;
+    tick_phase_estimator phase_estimator{bmmo::SERVER_TICK_INTERVAL};
+    int ping_data_counter = 0; // tick thread only
+    bmmo::map_key_table<interest_group> interest_groups; // tick thread only
+    std::vector<HSteamNetConnection> tick_members; // members in the snapshot being relayed; tick thread only
+    uint64_t relayed_serial = 0; // newest change relayed, see `world_snapshot`; tick thread only
+    message_batch outgoing; // everything sent in a tick, flushed at its end; tick thread only
+};
+
+// Ball states of clients are kept in the table itself; see `client_table`.
+typedef client_table<client_data, room_data> client_data_collection;
+typedef std::map<std::string, room_data> room_collection; // node-based; tick threads keep references
 
 #endif //BALLANCEMMOSERVER_SERVER_DATA_HPP
@@ -0,0 +1,75 @@
+#ifndef BALLANCEMMOSERVER_SERVER_METRICS_HPP
+#define BALLANCEMMOSERVER_SERVER_METRICS_HPP
+#include <array>
+#include <cstring>
+#include "metrics_registry.hpp"
+
+// Messages and bytes per opcode in one direction.
+class opcode_traffic {
+public:
+    opcode_traffic(metrics_registry& registry, const std::string& direction) {
+        for (size_t code = 0; code < OPCODE_COUNT; ++code) {
+            const std::string labels = std::string("opcode=\"") + bmmo::opcode_name(bmmo::opcode(code)) + '"';
+            messages_[code] = &registry.counter("bmmo_messages_" + direction + "_total",
+                                                "Number of messages " + direction + ", by opcode.", labels);
+            bytes_[code] = &registry.counter("bmmo_bytes_" + direction + "_total",
+                                             "Size of messages " + direction + " in bytes, by opcode.", labels);
+        }
+    }
+
+    opcode_traffic(const opcode_traffic&) = delete;
+    opcode_traffic& operator=(const opcode_traffic&) = delete;
+
+    // Records `count` messages of `size` bytes each, starting with an opcode at `data`.
+    void record(const void* data, size_t size, uint64_t count = 1) const {
+        bmmo::opcode code = bmmo::None;
+        if (size >= sizeof(code))
+            std::memcpy(&code, data, sizeof(code));
+        const size_t index = (code < OPCODE_COUNT) ? size_t(code) : 0; // unknown ones are counted as None
+        messages_[index]->add(count);
+        bytes_[index]->add(size * count);
+    }
+
+private:
+    static constexpr size_t OPCODE_COUNT = bmmo::LoginAcceptedV4 + 1;
+
+    std::array<metric_counter*, OPCODE_COUNT> messages_{}, bytes_{};
+};
+
+// Everything the server exports. All of it is registered here up front,
+// so recording never has to look anything up.
+struct server_metrics {
+    metrics_registry registry;
+
+    opcode_traffic received{registry, "received"};
+    opcode_traffic sent{registry, "sent"};
+
+    metric_histogram& tick_duration = registry.histogram("bmmo_tick_duration_seconds",
+            "Time taken by room ticks.", duration_buckets());
+    metric_histogram& serialization_time = registry.histogram("bmmo_tick_serialization_seconds",
+            "Time spent encoding ball states and latency data in room ticks.", duration_buckets());
+    metric_gauge& skipped_ticks = registry.gauge("bmmo_skipped_ticks",
+            "Ticks skipped by rooms which are ticking right now, for running late.");
+
+    metric_gauge& clients = registry.gauge("bmmo_clients", "Number of players logged in.");
+    metric_gauge& rooms = registry.gauge("bmmo_rooms", "Number of rooms.");
+    metric_gauge& ticking_rooms = registry.gauge("bmmo_ticking_rooms", "Number of rooms relaying ball states.");
+    metric_counter& logins = registry.counter("bmmo_logins_total", "Number of successful logins.");
+    metric_counter& disconnections = registry.counter("bmmo_disconnections_total",
+            "Number of players disconnected after logging in.");
+    metric_histogram& ping = registry.histogram("bmmo_ping_seconds",
+            "Round-trip times of players, sampled on every export.",
+            {0.01, 0.025, 0.05, 0.075, 0.1, 0.15, 0.2, 0.3, 0.5, 1});
+    metric_histogram& connection_quality = registry.histogram("bmmo_connection_quality",
+            "Fraction of packets from players delivered intact and in order, sampled on every export.",
+            {0.5, 0.75, 0.9, 0.95, 0.98, 0.99, 1});
+
+    metric_gauge& persistence_pending = registry.gauge("bmmo_persistence_pending_files",
+            "Number of files waiting to be saved.");
+
+    static std::vector<double> duration_buckets() {
+        return {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1};
+    }
+};
+
+#endif //BALLANCEMMOSERVER_SERVER_METRICS_HPP
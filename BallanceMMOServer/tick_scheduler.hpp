@@ -0,0 +1,152 @@
+#ifndef BALLANCEMMOSERVER_TICK_SCHEDULER_HPP
+#define BALLANCEMMOSERVER_TICK_SCHEDULER_HPP
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+
+// Runs a callback at a fixed rate on its own thread.
+// Deadlines are absolute (start + n * interval), so the cadence doesn't drift with
+// however long each tick takes. If a tick overruns, at most `max_catch_up_ticks`
+// missed ticks are run back-to-back; the rest are skipped and the schedule resumes
+// at the next point of the original grid.
+class tick_scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    tick_scheduler(clock::duration interval, std::function<void()> on_tick, int max_catch_up_ticks = 1):
+        interval_(interval), on_tick_(std::move(on_tick)), max_catch_up_ticks_(max_catch_up_ticks) {}
+
+    tick_scheduler(const tick_scheduler&) = delete;
+    tick_scheduler& operator=(const tick_scheduler&) = delete;
+
+    ~tick_scheduler() { stop(); }
+
+    void start() {
+        std::lock_guard control_lk(control_mutex_);
+        if (thread_.joinable())
+            return;
+        {
+            std::lock_guard lk(mutex_);
+            stop_requested_ = false;
+        }
+        thread_ = std::thread([this] { loop(); });
+    }
+
+    void stop() {
+        std::lock_guard control_lk(control_mutex_);
+        if (!thread_.joinable())
+            return;
+        {
+            std::lock_guard lk(mutex_);
+            stop_requested_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    bool running() const noexcept { return !stop_requested_; }
+
+    // Moves the tick grid onto `reference + offset + n * interval`.
+    // Takes effect from the next tick on; the nearest grid point is chosen
+    // so that a single alignment never delays a tick by more than half an interval.
+    void align_phase(clock::time_point reference, clock::duration offset) {
+        std::lock_guard lk(mutex_);
+        phase_reference_ = reference + offset;
+        phase_pending_ = true;
+    }
+
+    uint64_t get_tick_count() const noexcept { return tick_count_; }
+    uint64_t get_skipped_tick_count() const noexcept { return skipped_tick_count_; }
+
+private:
+    void loop() {
+        std::unique_lock lk(mutex_);
+        auto next_tick = clock::now();
+        while (!cv_.wait_until(lk, next_tick, [this] { return stop_requested_.load(); })) {
+            lk.unlock();
+            on_tick_();
+            lk.lock();
+            ++tick_count_;
+
+            next_tick += interval_;
+            if (phase_pending_) {
+                const auto shift = (next_tick - phase_reference_) % interval_;
+                next_tick -= (shift > interval_ / 2) ? shift - interval_ : shift;
+                phase_pending_ = false;
+            }
+            const auto now = clock::now();
+            if (now <= next_tick)
+                continue;
+            // number of grid points we're already late for, including `next_tick` itself
+            const auto missed = (now - next_tick) / interval_ + 1;
+            if (missed > max_catch_up_ticks_) {
+                const auto skipped = missed - max_catch_up_ticks_;
+                next_tick += skipped * interval_;
+                skipped_tick_count_ += skipped;
+            }
+        }
+    }
+
+    const clock::duration interval_;
+    const std::function<void()> on_tick_;
+    const int max_catch_up_ticks_;
+
+    std::thread thread_;
+    std::mutex control_mutex_, mutex_;
+    std::condition_variable cv_;
+    std::atomic_bool stop_requested_ = true;
+    bool phase_pending_ = false;
+    clock::time_point phase_reference_{};
+    std::atomic_uint64_t tick_count_ = 0, skipped_tick_count_ = 0;
+};
+
+// Estimates at which phase of the tick interval incoming ball states tend to arrive,
+// using the circular mean of their arrival times folded into [0, interval).
+class tick_phase_estimator {
+public:
+    using clock = tick_scheduler::clock;
+
+    explicit tick_phase_estimator(clock::duration interval): interval_(interval) {}
+
+    void add_sample(clock::time_point time) {
+        const double angle = 2 * std::numbers::pi * double((time.time_since_epoch() % interval_).count())
+                / double(interval_.count());
+        sin_sum_ += std::sin(angle);
+        cos_sum_ += std::cos(angle);
+        ++sample_count_;
+    }
+
+    // @returns `false` if there are too few samples, or if they are spread out
+    // too evenly over the interval for any phase to be preferable.
+    bool get_phase(clock::time_point& reference) const {
+        if (sample_count_ < MIN_SAMPLE_COUNT)
+            return false;
+        if (std::hypot(sin_sum_, cos_sum_) / sample_count_ < MIN_CONCENTRATION)
+            return false;
+        double angle = std::atan2(sin_sum_, cos_sum_);
+        if (angle < 0) angle += 2 * std::numbers::pi;
+        reference = clock::time_point{clock::duration{
+                clock::rep(angle / (2 * std::numbers::pi) * double(interval_.count()))}};
+        return true;
+    }
+
+    void reset() {
+        sin_sum_ = cos_sum_ = 0;
+        sample_count_ = 0;
+    }
+
+private:
+    static constexpr int MIN_SAMPLE_COUNT = 64;
+    static constexpr double MIN_CONCENTRATION = 0.3;
+
+    const clock::duration interval_;
+    double sin_sum_ = 0, cos_sum_ = 0;
+    int sample_count_ = 0;
+};
+
+#endif //BALLANCEMMOSERVER_TICK_SCHEDULER_HPP
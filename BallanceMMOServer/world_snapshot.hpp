@@ -0,0 +1,117 @@
+#ifndef BALLANCEMMOSERVER_WORLD_SNAPSHOT_HPP
+#define BALLANCEMMOSERVER_WORLD_SNAPSHOT_HPP
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../BallanceMMOCommon/common.hpp"
+#include "send_strategy.hpp"
+
+struct room_data;
+
+// Who is where; only rebuilt when that changes, which is far less often than ball states.
+struct world_roster {
+    struct client {
+        HSteamNetConnection id;
+        std::string name;
+        const room_data* room;
+        bmmo::map_key map; // the current one
+        bool sees_balls; // false for everyone but spectators in rooms in ghost mode
+        send_strategy strategy;
+        std::shared_ptr<bmmo::ball_delta_encoder> delta_encoder; // only with ball_encoding::Delta
+    };
+
+    std::vector<client> clients;
+    bmmo::name_index<HSteamNetConnection> names; // of `clients`, for completion
+    std::vector<std::string> room_names;
+};
+
+// Everything threads other than the server thread read about players,
+// as of the end of a loop iteration of the server thread. Never changes once published.
+struct world_snapshot {
+    std::shared_ptr<const world_roster> roster;
+    // by index into `roster->clients`
+    std::vector<bmmo::timed_ball_state> states;
+    std::vector<uint64_t> state_serials, timestamp_serials; // see `client_table::touch_state`
+    uint64_t serial = 0; // the newest of the serials above
+};
+
+// Hands snapshots from the server thread to readers without either side locking.
+// Snapshots are filled in place in a fixed set of buffers; a buffer is only reused once
+// nobody is reading it anymore, which readers announce by counting themselves in on it.
+// A reader checks the buffer is still the published one after counting itself in, and
+// the server thread checks nobody counted in on a buffer before filling it; with both
+// sequentially consistent, at least one of them sees the other and backs off.
+class world_publisher {
+public:
+    static constexpr size_t BUFFER_COUNT = 8; // enough for a few rooms ticking at once plus the console
+
+    // Keeps the snapshot it points to from being reused while it's held.
+    class view {
+    public:
+        view(const view&) = delete;
+        view& operator=(const view&) = delete;
+        view(view&& other) noexcept: publisher_(std::exchange(other.publisher_, nullptr)), index_(other.index_) {}
+
+        ~view() {
+            if (publisher_)
+                publisher_->readers_[index_].fetch_sub(1, std::memory_order_release);
+        }
+
+        const world_snapshot& operator*() const { return publisher_->buffers_[index_]; }
+        const world_snapshot* operator->() const { return &publisher_->buffers_[index_]; }
+
+    private:
+        friend class world_publisher;
+        view(const world_publisher* publisher, size_t index): publisher_(publisher), index_(index) {}
+
+        const world_publisher* publisher_;
+        size_t index_;
+    };
+
+    world_publisher() {
+        for (auto& buffer: buffers_)
+            buffer.roster = std::make_shared<const world_roster>();
+    }
+
+    world_publisher(const world_publisher&) = delete;
+    world_publisher& operator=(const world_publisher&) = delete;
+
+    // Any thread.
+    view load() const {
+        while (true) {
+            const size_t index = current_.load();
+            readers_[index].fetch_add(1);
+            if (current_.load() == index)
+                return {this, index};
+            readers_[index].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    // Server thread only. The snapshot returned is to be filled and then published with `publish`.
+    // @returns `nullptr` if every buffer is still being read; try again later.
+    world_snapshot* prepare() {
+        const size_t current = current_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < BUFFER_COUNT; ++i) {
+            if (i != current && readers_[i].load() == 0) {
+                prepared_ = i;
+                return &buffers_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void publish() {
+        current_.store(prepared_);
+    }
+
+private:
+    std::array<world_snapshot, BUFFER_COUNT> buffers_;
+    mutable std::array<std::atomic<uint32_t>, BUFFER_COUNT> readers_{};
+    std::atomic<size_t> current_{0};
+    size_t prepared_ = 0;
+};
+
+#endif //BALLANCEMMOSERVER_WORLD_SNAPSHOT_HPP